@@ -0,0 +1,275 @@
+/// Microbenchmarks of the response codecs
+///
+/// Covers core/codecs.cpp on ADC-like data: 14 bits samples of a
+/// noisy sine in int16 and int32 containers, and float samples.
+/// The diff codec is measured on a table with a few changed entries.
+/// The compression ratios are printed on stderr before the timings.
+/// Builds without the generated sources:
+///
+///     make bench_codecs
+///
+/// Results are written as JSON on stdout (see runner.hpp).
+///
+/// Usage: bench_codecs [--filter SUBSTRING] [--repetitions N] [--min-time MS]
+///
+/// (c) Koheron
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+
+#include <core/codecs.hpp>
+
+#include "runner.hpp"
+
+using namespace kserver;
+
+constexpr size_t samples_num = 65536;
+
+struct Dataset
+{
+    std::string name;
+    size_t elem_size;
+    std::vector<unsigned char> bytes;
+};
+
+template<typename T>
+Dataset make_dataset(const std::string& name, double amplitude, double noise, bool quantize)
+{
+    std::mt19937 gen(42);
+    std::normal_distribution<double> dist(0.0, noise);
+    std::vector<T> samples(samples_num);
+
+    for (size_t i = 0; i < samples_num; i++) {
+        const double x = amplitude * std::sin(2 * M_PI * i / 1000.0) + dist(gen);
+        samples[i] = static_cast<T>(quantize ? std::round(x) : x);
+    }
+
+    Dataset dataset{name, sizeof(T), std::vector<unsigned char>(samples_num * sizeof(T))};
+    std::memcpy(dataset.bytes.data(), samples.data(), dataset.bytes.size());
+    return dataset;
+}
+
+std::vector<Dataset> make_datasets()
+{
+    return {
+        make_dataset<int16_t>("adc_i16", 8191, 4, true),   // 14 bits ADC
+        make_dataset<int32_t>("adc_i32", 8191, 4, true),
+        make_dataset<float>("adc_f32", 1.0, 0.001, false)
+    };
+}
+
+const char* codec_name(codecs::Codec codec)
+{
+    switch (codec) {
+      case codecs::RAW:
+        return "raw";
+      case codecs::LZ:
+        return "lz";
+      case codecs::SHUFFLE_DELTA:
+        return "shuffle_delta";
+      default:
+        return "unknown";
+    }
+}
+
+int decode_segment(const std::vector<unsigned char>& segment, std::vector<unsigned char>& out)
+{
+    const auto read_be32 = [&](size_t pos) {
+        return (uint32_t(segment[pos]) << 24) | (uint32_t(segment[pos + 1]) << 16)
+               | (uint32_t(segment[pos + 2]) << 8) | uint32_t(segment[pos + 3]);
+    };
+
+    const auto codec = segment[0];
+    const size_t elem_size = segment[1];
+    const size_t decoded_len = read_be32(2);
+    const size_t encoded_len = read_be32(6);
+    const unsigned char *data = segment.data() + codecs::segment_header_len;
+    out.resize(decoded_len);
+
+    if (codec == codecs::RAW) {
+        std::memcpy(out.data(), data, encoded_len);
+        return 0;
+    }
+
+    std::vector<unsigned char> tmp(decoded_len);
+
+    if (codecs::lz_decompress(data, encoded_len, tmp.data(), tmp.size())
+        != static_cast<int64_t>(decoded_len))
+        return -1;
+
+    if (codec == codecs::LZ)
+        out = tmp;
+    else
+        codecs::unshuffle_delta(tmp.data(), tmp.size(), elem_size, out.data());
+
+    return 0;
+}
+
+// The decoded segments must give back the data,
+// including for lengths that are not a multiple of the element size
+int check_round_trip(const std::vector<Dataset>& datasets)
+{
+    std::vector<unsigned char> segment, scratch, decoded;
+
+    for (const auto& dataset : datasets) {
+        for (auto codec : {codecs::LZ, codecs::SHUFFLE_DELTA}) {
+            for (size_t len : {size_t(0), size_t(13), size_t(1001), dataset.bytes.size()}) {
+                segment.clear();
+                codecs::append_segment(segment, codec, dataset.elem_size,
+                                       dataset.bytes.data(), len, scratch);
+
+                if (decode_segment(segment, decoded) < 0
+                    || decoded.size() != len
+                    || std::memcmp(decoded.data(), dataset.bytes.data(), len) != 0) {
+                    fprintf(stderr, "%s: round trip failed for %s (%zu bytes)\n",
+                            codec_name(codec), dataset.name.c_str(), len);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Table of 1024 entries with `changes` entries modified
+void make_tables(std::vector<uint32_t>& prev, std::vector<uint32_t>& next, size_t changes)
+{
+    std::mt19937 gen(42);
+    prev.resize(1024);
+    next.resize(1024);
+
+    for (auto& x : prev)
+        x = gen();
+
+    next = prev;
+
+    for (size_t i = 0; i < changes; i++)
+        next[gen() % next.size()] = gen();
+}
+
+int check_diff()
+{
+    std::vector<uint32_t> prev, next;
+    std::vector<unsigned char> segment;
+
+    for (size_t changes : {0, 1, 10, 100}) {
+        make_tables(prev, next, changes);
+        const size_t len = next.size() * sizeof(uint32_t);
+        segment.clear();
+
+        if (codecs::append_diff_segment(segment, sizeof(uint32_t),
+                reinterpret_cast<const unsigned char*>(prev.data()),
+                reinterpret_cast<const unsigned char*>(next.data()), len) < 0
+            || codecs::diff_decode(segment.data() + codecs::segment_header_len,
+                                   segment.size() - codecs::segment_header_len,
+                                   reinterpret_cast<unsigned char*>(prev.data()), len) < 0
+            || prev != next) {
+            fprintf(stderr, "diff: round trip failed for %zu changes\n", changes);
+            return -1;
+        }
+
+        const std::string name = "ratio/diff/table_" + std::to_string(changes);
+        fprintf(stderr, "%-48s %12.3f\n", name.c_str(), double(segment.size()) / len);
+    }
+
+    return 0;
+}
+
+void bench_diff(Runner& runner, size_t changes)
+{
+    std::vector<uint32_t> prev, next;
+    std::vector<unsigned char> segment;
+    make_tables(prev, next, changes);
+    const size_t len = next.size() * sizeof(uint32_t);
+    segment.reserve(codecs::segment_header_len + len);
+
+    runner.run("encode/diff/table_" + std::to_string(changes), len, [&]() {
+        segment.clear();
+        codecs::append_diff_segment(segment, sizeof(uint32_t),
+                                    reinterpret_cast<const unsigned char*>(prev.data()),
+                                    reinterpret_cast<const unsigned char*>(next.data()), len);
+        do_not_optimize(segment[0]);
+    });
+}
+
+void print_ratios(const std::vector<Dataset>& datasets)
+{
+    std::vector<unsigned char> segment, scratch;
+
+    for (const auto& dataset : datasets) {
+        for (auto codec : {codecs::LZ, codecs::SHUFFLE_DELTA}) {
+            segment.clear();
+            codecs::append_segment(segment, codec, dataset.elem_size,
+                                   dataset.bytes.data(), dataset.bytes.size(), scratch);
+            const std::string name = std::string("ratio/") + codec_name(codec) + "/" + dataset.name;
+            fprintf(stderr, "%-48s %12.3f\n", name.c_str(),
+                    double(segment.size()) / dataset.bytes.size());
+        }
+    }
+}
+
+void bench_codecs(Runner& runner, const Dataset& dataset)
+{
+    const size_t len = dataset.bytes.size();
+    std::vector<unsigned char> segment, scratch, shuffled(len), decoded(len);
+    segment.reserve(codecs::segment_header_len + codecs::lz_bound(len));
+
+    for (auto codec : {codecs::LZ, codecs::SHUFFLE_DELTA}) {
+        const std::string name = std::string(codec_name(codec)) + "/" + dataset.name;
+
+        runner.run("encode/" + name, len, [&]() {
+            segment.clear();
+            codecs::append_segment(segment, codec, dataset.elem_size,
+                                   dataset.bytes.data(), len, scratch);
+            do_not_optimize(segment[0]);
+        });
+
+        // Incompressible data are sent raw
+        if (segment[0] == codecs::RAW)
+            continue;
+
+        runner.run("decode/" + name, len, [&]() {
+            const auto n = codecs::lz_decompress(segment.data() + codecs::segment_header_len,
+                                                 segment.size() - codecs::segment_header_len,
+                                                 shuffled.data(), len);
+
+            if (segment[0] == codecs::SHUFFLE_DELTA)
+                codecs::unshuffle_delta(shuffled.data(), n, dataset.elem_size, decoded.data());
+
+            do_not_optimize(decoded[len / 2]);
+        });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options opts;
+
+    if (parse_options(argc, argv, opts) < 0) {
+        fprintf(stderr, "Usage: %s [--filter SUBSTRING] [--repetitions N] [--min-time MS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const auto datasets = make_datasets();
+
+    if (check_round_trip(datasets) < 0 || check_diff() < 0)
+        return EXIT_FAILURE;
+
+    print_ratios(datasets);
+    Runner runner(opts);
+
+    for (const auto& dataset : datasets)
+        bench_codecs(runner, dataset);
+
+    for (size_t changes : {1, 10, 100})
+        bench_diff(runner, changes);
+
+    runner.print_json();
+    return EXIT_SUCCESS;
+}
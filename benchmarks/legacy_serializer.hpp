@@ -0,0 +1,227 @@
+/// Reference big-endian codec
+///
+/// Byte per byte implementation of extract, append, deserialize and
+/// serialize, as used before the scalar pack codec. Kept to benchmark
+/// core/serializer_deserializer.hpp against it and to check that both
+/// produce the same wire format.
+///
+/// (c) Koheron
+
+#ifndef __LEGACY_SERIALIZER_HPP__
+#define __LEGACY_SERIALIZER_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <array>
+
+#include <core/serializer_deserializer.hpp>
+
+namespace legacy {
+
+using kserver::size_of;
+using kserver::pseudo_cast;
+using kserver::required_buffer_size;
+
+template<typename Tp> Tp extract(const char *buff);
+template<typename Tp> void append(unsigned char *buff, Tp value);
+
+template<>
+inline uint8_t extract<uint8_t>(const char *buff)
+{
+    return (unsigned char)buff[0];
+}
+
+template<>
+inline void append<uint8_t>(unsigned char *buff, uint8_t value)
+{
+    buff[0] = value;
+}
+
+template<>
+inline int8_t extract<int8_t>(const char *buff)
+{
+    return buff[0];
+}
+
+template<>
+inline void append<int8_t>(unsigned char *buff, int8_t value)
+{
+    buff[0] = reinterpret_cast<uint8_t&>(value);
+}
+
+template<>
+inline uint16_t extract<uint16_t>(const char *buff)
+{
+    return (unsigned char)buff[1] + ((unsigned char)buff[0] << 8);
+}
+
+template<>
+inline void append<uint16_t>(unsigned char *buff, uint16_t value)
+{
+    buff[0] = (value >> 8) & 0xff;
+    buff[1] = value & 0xff;
+}
+
+template<>
+inline int16_t extract<int16_t>(const char *buff)
+{
+    uint16_t tmp = extract<uint16_t>(buff);
+    return *reinterpret_cast<int16_t*>(&tmp);
+}
+
+template<>
+inline void append<int16_t>(unsigned char *buff, int16_t value)
+{
+    append<uint16_t>(buff, reinterpret_cast<uint16_t&>(value));
+}
+
+template<>
+inline uint32_t extract<uint32_t>(const char *buff)
+{
+    return (unsigned char)buff[3] + ((unsigned char)buff[2] << 8)
+           + ((unsigned char)buff[1] << 16) + ((unsigned char)buff[0] << 24);
+}
+
+template<>
+inline void append<uint32_t>(unsigned char *buff, uint32_t value)
+{
+    buff[0] = (value >> 24) & 0xff;
+    buff[1] = (value >> 16) & 0xff;
+    buff[2] = (value >>  8) & 0xff;
+    buff[3] = value & 0xff;
+}
+
+template<>
+inline int32_t extract<int32_t>(const char *buff)
+{
+    uint32_t tmp = extract<uint32_t>(buff);
+    return *reinterpret_cast<int32_t*>(&tmp);
+}
+
+template<>
+inline void append<int32_t>(unsigned char *buff, int32_t value)
+{
+    append<uint32_t>(buff, reinterpret_cast<uint32_t&>(value));
+}
+
+template<>
+inline uint64_t extract<uint64_t>(const char *buff)
+{
+    uint32_t u1 = extract<uint32_t>(buff);
+    uint32_t u2 = extract<uint32_t>(buff + size_of<uint32_t>);
+    return static_cast<uint64_t>(u2) + (static_cast<uint64_t>(u1) << 32);
+}
+
+template<>
+inline void append<uint64_t>(unsigned char *buff, uint64_t value)
+{
+    append<uint32_t>(buff, (value >> 32));
+    append<uint32_t>(buff + size_of<uint32_t>, value);
+}
+
+template<>
+inline int64_t extract<int64_t>(const char *buff)
+{
+    uint64_t tmp = extract<uint64_t>(buff);
+    return *reinterpret_cast<int64_t*>(&tmp);
+}
+
+template<>
+inline void append<int64_t>(unsigned char *buff, int64_t value)
+{
+    append<uint64_t>(buff, reinterpret_cast<uint64_t&>(value));
+}
+
+template<>
+inline float extract<float>(const char *buff)
+{
+    return pseudo_cast<float, uint32_t>(extract<uint32_t>(buff));
+}
+
+template<>
+inline void append<float>(unsigned char *buff, float value)
+{
+    append<uint32_t>(buff, pseudo_cast<uint32_t, float>(value));
+}
+
+template<>
+inline double extract<double>(const char *buff)
+{
+    return pseudo_cast<double, uint64_t>(extract<uint64_t>(buff));
+}
+
+template<>
+inline void append<double>(unsigned char *buff, double value)
+{
+    append<uint64_t>(buff, pseudo_cast<uint64_t, double>(value));
+}
+
+template<>
+inline bool extract<bool>(const char *buff)
+{
+    return (unsigned char)buff[0] == 1;
+}
+
+template<>
+inline void append<bool>(unsigned char *buff, bool value)
+{
+    value ? buff[0] = 1 : buff[0] = 0;
+}
+
+namespace detail {
+    template<size_t position, typename... Tp>
+    inline std::enable_if_t<0 == sizeof...(Tp), std::tuple<Tp...>>
+    deserialize(const char *buff)
+    {
+        return std::make_tuple();
+    }
+
+    template<size_t position, typename Tp0, typename... Tp>
+    inline std::enable_if_t<0 == sizeof...(Tp), std::tuple<Tp0, Tp...>>
+    deserialize(const char *buff)
+    {
+        return std::make_tuple(extract<Tp0>(&buff[position]));
+    }
+
+    template<size_t position, typename Tp0, typename... Tp>
+    inline std::enable_if_t<0 < sizeof...(Tp), std::tuple<Tp0, Tp...>>
+    deserialize(const char *buff)
+    {
+        return std::tuple_cat(std::make_tuple(extract<Tp0>(&buff[position])),
+                              deserialize<position + size_of<Tp0>, Tp...>(buff));
+    }
+
+    template<size_t buff_pos, size_t I, typename... Tp>
+    inline std::enable_if_t<I == sizeof...(Tp), void>
+    serialize(const std::tuple<Tp...>& t, unsigned char *buff)
+    {}
+
+    template<size_t buff_pos, size_t I, typename... Tp>
+    inline std::enable_if_t<I < sizeof...(Tp), void>
+    serialize(const std::tuple<Tp...>& t, unsigned char *buff)
+    {
+        using type = typename std::tuple_element_t<I, std::tuple<Tp...>>;
+        append<type>(&buff[buff_pos], std::get<I>(t));
+        serialize<buff_pos + size_of<type>, I + 1, Tp...>(t, &buff[0]);
+    }
+}
+
+template<size_t position, typename... Tp>
+inline std::tuple<Tp...> deserialize(const char *buff)
+{
+    return detail::deserialize<position, Tp...>(buff);
+}
+
+template<typename... Tp>
+inline std::array<unsigned char, required_buffer_size<Tp...>()>
+serialize(const std::tuple<Tp...>& t)
+{
+    std::array<unsigned char, required_buffer_size<Tp...>()> arr;
+    detail::serialize<0, 0, Tp...>(t, arr.data());
+    return arr;
+}
+
+} // namespace legacy
+
+#endif // __LEGACY_SERIALIZER_HPP__
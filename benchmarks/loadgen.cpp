@@ -0,0 +1,797 @@
+/// Load generator for the Benchmarks device (tests/benchmarks.hpp)
+///
+/// Drives a running server with the binary protocol over TCP,
+/// Unix socket or WebSocket, and prints the throughput and the
+/// latency distribution as JSON on stdout.
+///
+/// Usage: loadgen [options]
+///   --transport tcp|unix|websocket  Connection type (default tcp)
+///   --host HOST                     Server address (default 127.0.0.1)
+///   --port PORT                     TCP or WebSocket port (default 36000 / 8080)
+///   --unix-path PATH                Unix socket path (default /tmp/kserver_local.sock)
+///   --connections N                 Number of parallel connections (default 1)
+///   --pipeline N                    Requests in flight per connection (default 1)
+///   --duration SECONDS              Duration of the run (default 5)
+///   --mix OP:WEIGHT,...             Operations mix (see operations_specs)
+///   --connect-timeout SECONDS       Wait for the server to start (default 10)
+///
+/// Device and operation ids are resolved with KServer::GET_CMDS.
+///
+/// (c) Koheron
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+extern "C" {
+  #include <unistd.h>
+  #include <netdb.h>
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <arpa/inet.h>
+}
+
+#include <core/clock.hpp>
+#include <core/histogram.hpp>
+#include <core/gason.hpp>
+
+using kserver::LogHistogram;
+using kserver::clock_ns;
+
+// ------------------------------------------
+// Operations
+// ------------------------------------------
+
+enum ResponseKind {
+    FIXED_SIZE,      ///< Scalars or std::array
+    LENGTH_PREFIXED  ///< std::vector or std::string
+};
+
+struct OperationSpec
+{
+    const char *device;
+    const char *name;
+    std::vector<unsigned char> (*make_payload)();
+    ResponseKind response_kind;
+    uint32_t response_size; ///< For FIXED_SIZE responses
+};
+
+std::vector<unsigned char> no_payload()
+{
+    return {};
+}
+
+// Vectors are sent with their length in bytes (big-endian)
+// followed by the data in host order.
+std::vector<unsigned char> vector_u32_payload()
+{
+    const uint32_t len = 16384 * sizeof(uint32_t);
+    std::vector<unsigned char> payload(sizeof(uint32_t) + len, 0);
+    const uint32_t len_be = htonl(len);
+    memcpy(payload.data(), &len_be, sizeof(len_be));
+    return payload;
+}
+
+// Arrays are sent raw
+std::vector<unsigned char> array_u32_payload()
+{
+    return std::vector<unsigned char>(5000 * sizeof(uint32_t), 0);
+}
+
+// Scalars are sent big-endian
+std::vector<unsigned char> scalars_payload()
+{
+    return {0, 0, 0, 1, 0, 0, 0, 2};
+}
+
+const std::vector<OperationSpec> operations_specs = {
+    {"KServer", "get_version", no_payload, LENGTH_PREFIXED, 0},
+    {"Benchmarks", "std_vector_u32_to_client", no_payload, LENGTH_PREFIXED, 0},
+    {"Benchmarks", "std_vector_f_to_client", no_payload, LENGTH_PREFIXED, 0},
+    {"Benchmarks", "std_array_u32_to_client", no_payload, FIXED_SIZE, 16384 * sizeof(uint32_t)},
+    {"Benchmarks", "std_vector_u32_from_client", vector_u32_payload, FIXED_SIZE, sizeof(bool)},
+    {"Benchmarks", "std_array_u32_from_client", array_u32_payload, FIXED_SIZE, sizeof(bool)},
+    {"Benchmarks", "scalars_round_trip", scalars_payload, FIXED_SIZE, sizeof(uint32_t)}
+};
+
+const char *default_mix = "std_vector_u32_to_client:1,std_array_u32_to_client:1,"
+                          "std_vector_u32_from_client:1";
+
+struct Operation
+{
+    const OperationSpec *spec;
+    uint16_t dev_id;
+    uint16_t op_id;
+    double weight;
+    std::vector<unsigned char> message; ///< Header and payload
+};
+
+std::vector<unsigned char> build_message(uint16_t dev_id, uint16_t op_id,
+                                         const std::vector<unsigned char>& payload)
+{
+    // |      RESERVED     | dev_id  |  op_id  |   payload
+    // |  0 |  1 |  2 |  3 |  4 |  5 |  6 |  7 |  8 | ...
+    std::vector<unsigned char> msg(8, 0);
+    msg[4] = dev_id >> 8;
+    msg[5] = dev_id & 0xFF;
+    msg[6] = op_id >> 8;
+    msg[7] = op_id & 0xFF;
+    msg.insert(msg.end(), payload.begin(), payload.end());
+    return msg;
+}
+
+// ------------------------------------------
+// Options
+// ------------------------------------------
+
+enum Transport {TCP, UNIX, WEBSOCK};
+
+struct Options
+{
+    Transport transport = TCP;
+    std::string host = "127.0.0.1";
+    int port = -1;
+    std::string unix_path = "/tmp/kserver_local.sock";
+    unsigned int connections = 1;
+    unsigned int pipeline = 1;
+    double duration = 5.0;
+    double connect_timeout = 10.0;
+    std::string mix = default_mix;
+};
+
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--transport tcp|unix|websocket] [--host HOST] [--port PORT]\n"
+                    "          [--unix-path PATH] [--connections N] [--pipeline N]\n"
+                    "          [--duration SECONDS] [--mix OP:WEIGHT,...]\n"
+                    "          [--connect-timeout SECONDS]\n", prog);
+    fprintf(stderr, "Operations:");
+
+    for (auto& spec : operations_specs)
+        fprintf(stderr, " %s", spec.name);
+
+    fprintf(stderr, "\n");
+}
+
+int parse_options(int argc, char **argv, Options& opts)
+{
+    for (int i = 1; i < argc; i++) {
+        const std::string arg(argv[i]);
+
+        if (i + 1 >= argc)
+            return -1;
+
+        const char *value = argv[++i];
+
+        if (arg == "--transport") {
+            if (strcmp(value, "tcp") == 0)
+                opts.transport = TCP;
+            else if (strcmp(value, "unix") == 0)
+                opts.transport = UNIX;
+            else if (strcmp(value, "websocket") == 0)
+                opts.transport = WEBSOCK;
+            else
+                return -1;
+        }
+        else if (arg == "--host")
+            opts.host = value;
+        else if (arg == "--port")
+            opts.port = atoi(value);
+        else if (arg == "--unix-path")
+            opts.unix_path = value;
+        else if (arg == "--connections")
+            opts.connections = std::max(1, atoi(value));
+        else if (arg == "--pipeline")
+            opts.pipeline = std::max(1, atoi(value));
+        else if (arg == "--duration")
+            opts.duration = atof(value);
+        else if (arg == "--connect-timeout")
+            opts.connect_timeout = atof(value);
+        else if (arg == "--mix")
+            opts.mix = value;
+        else
+            return -1;
+    }
+
+    if (opts.port < 0)
+        opts.port = (opts.transport == WEBSOCK) ? 8080 : 36000;
+
+    return 0;
+}
+
+// ------------------------------------------
+// Connection
+// ------------------------------------------
+
+class Connection
+{
+  public:
+    Connection(const Options& opts_)
+    : opts(opts_)
+    , fd(-1)
+    {}
+
+    ~Connection() {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    /// Retry until the server accepts the connection
+    int open() {
+        const auto deadline = clock_ns() + static_cast<uint64_t>(opts.connect_timeout * 1E9);
+
+        while (try_open() < 0) {
+            if (clock_ns() > deadline) {
+                fprintf(stderr, "Cannot connect to the server\n");
+                return -1;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        if (opts.transport == WEBSOCK)
+            return websocket_handshake();
+
+        return 0;
+    }
+
+    /// Encapsulate a message in a WebSocket frame if required
+    std::vector<unsigned char> frame(const std::vector<unsigned char>& msg) const {
+        if (opts.transport != WEBSOCK)
+            return msg;
+
+        // Binary frame sent by a client must be masked.
+        // A null masking key leaves the payload unchanged,
+        // keeping the masking cost out of the client.
+        std::vector<unsigned char> frm;
+        frm.push_back(0x80 | 0x2);
+
+        if (msg.size() <= 125) {
+            frm.push_back(0x80 | msg.size());
+        } else if (msg.size() <= 0xFFFF) {
+            frm.push_back(0x80 | 126);
+            frm.push_back(msg.size() >> 8);
+            frm.push_back(msg.size() & 0xFF);
+        } else {
+            frm.push_back(0x80 | 127);
+
+            for (int i = 7; i >= 0; i--)
+                frm.push_back((static_cast<uint64_t>(msg.size()) >> (8 * i)) & 0xFF);
+        }
+
+        frm.insert(frm.end(), 4, 0); // Masking key
+        frm.insert(frm.end(), msg.begin(), msg.end());
+        return frm;
+    }
+
+    int send(const std::vector<unsigned char>& frm) {
+        return write_all(frm.data(), frm.size());
+    }
+
+    /// Read the response of an operation.
+    /// Returns the size of the response or -1 on error.
+    int64_t receive(const Operation& op, std::vector<unsigned char>& data) {
+        if (opts.transport == WEBSOCK) {
+            if (read_frame(data) < 0)
+                return -1;
+        } else {
+            data.resize(8);
+
+            if (read_all(data.data(), 8) < 0)
+                return -1;
+
+            uint32_t len = op.spec->response_size;
+
+            if (op.spec->response_kind == LENGTH_PREFIXED) {
+                uint32_t len_be;
+
+                if (read_all(&len_be, sizeof(len_be)) < 0)
+                    return -1;
+
+                len = ntohl(len_be);
+                data.resize(8 + sizeof(len_be) + len);
+                memcpy(&data[8], &len_be, sizeof(len_be));
+            } else {
+                data.resize(8 + len);
+            }
+
+            if (read_all(&data[data.size() - len], len) < 0)
+                return -1;
+        }
+
+        if (data.size() < 8
+            || data[4] != (op.dev_id >> 8) || data[5] != (op.dev_id & 0xFF)
+            || data[6] != (op.op_id >> 8) || data[7] != (op.op_id & 0xFF)) {
+            fprintf(stderr, "Invalid response header for %s\n", op.spec->name);
+            return -1;
+        }
+
+        if (op.spec->response_kind == FIXED_SIZE
+            && data.size() != 8 + op.spec->response_size) {
+            fprintf(stderr, "Invalid response size for %s\n", op.spec->name);
+            return -1;
+        }
+
+        return data.size();
+    }
+
+  private:
+    const Options& opts;
+    int fd;
+
+    int try_open() {
+        if (fd >= 0)
+            close(fd);
+
+        if (opts.transport == UNIX) {
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, opts.unix_path.c_str(), sizeof(addr.sun_path) - 1);
+            return connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+        }
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(opts.port);
+
+        if (inet_pton(AF_INET, opts.host.c_str(), &addr.sin_addr) != 1) {
+            struct hostent *host = gethostbyname(opts.host.c_str());
+
+            if (host == nullptr)
+                return -1;
+
+            memcpy(&addr.sin_addr, host->h_addr, host->h_length);
+        }
+
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            return -1;
+
+        int one = 1;
+        return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    int websocket_handshake() {
+        const std::string request =
+            "GET / HTTP/1.1\r\n"
+            "Host: " + opts.host + "\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+            "Sec-WebSocket-Version: 13\r\n\r\n";
+
+        if (write_all(request.data(), request.size()) < 0)
+            return -1;
+
+        // The server does not send anything before the
+        // first request, so read byte per byte up to the end
+        // of the HTTP response.
+        std::string response;
+        char c;
+
+        while (response.size() < 4 || response.compare(response.size() - 4, 4, "\r\n\r\n") != 0) {
+            if (read_all(&c, 1) < 0)
+                return -1;
+
+            response += c;
+        }
+
+        if (response.find(" 101 ") == std::string::npos) {
+            fprintf(stderr, "WebSocket handshake failed\n");
+            return -1;
+        }
+
+        return 0;
+    }
+
+    /// Read a message, reassembling the fragmented ones
+    int read_frame(std::vector<unsigned char>& data) {
+        data.clear();
+        unsigned char hdr[2];
+
+        do {
+            if (read_all(hdr, 2) < 0)
+                return -1;
+
+            uint64_t len = hdr[1] & 0x7F;
+
+            if (len == 126) {
+                unsigned char ext[2];
+
+                if (read_all(ext, 2) < 0)
+                    return -1;
+
+                len = (ext[0] << 8) | ext[1];
+            } else if (len == 127) {
+                unsigned char ext[8];
+
+                if (read_all(ext, 8) < 0)
+                    return -1;
+
+                len = 0;
+
+                for (int i = 0; i < 8; i++)
+                    len = (len << 8) | ext[i];
+            }
+
+            if ((hdr[0] & 0x0F) == 0x8) {
+                fprintf(stderr, "WebSocket closed by the server\n");
+                return -1;
+            }
+
+            const size_t offset = data.size();
+            data.resize(offset + len);
+
+            if (read_all(data.data() + offset, len) < 0)
+                return -1;
+        } while (!(hdr[0] & 0x80));
+
+        return 0;
+    }
+
+    int write_all(const void *buf, size_t len) {
+        auto ptr = static_cast<const char *>(buf);
+
+        while (len > 0) {
+            const auto n = write(fd, ptr, len);
+
+            if (n <= 0) {
+                fprintf(stderr, "Cannot write to the server\n");
+                return -1;
+            }
+
+            ptr += n;
+            len -= n;
+        }
+
+        return 0;
+    }
+
+    int read_all(void *buf, size_t len) {
+        auto ptr = static_cast<char *>(buf);
+
+        while (len > 0) {
+            const auto n = read(fd, ptr, len);
+
+            if (n <= 0) {
+                fprintf(stderr, "Cannot read from the server\n");
+                return -1;
+            }
+
+            ptr += n;
+            len -= n;
+        }
+
+        return 0;
+    }
+};
+
+// ------------------------------------------
+// Operations resolution
+// ------------------------------------------
+
+int find_ids(JsonValue devices, const OperationSpec& spec,
+             uint16_t& dev_id, uint16_t& op_id)
+{
+    for (auto dev : devices) {
+        int id = -1;
+        bool is_device = false;
+        JsonValue functions;
+
+        for (auto field : dev->value) {
+            if (strcmp(field->key, "class") == 0)
+                is_device = (strcmp(field->value.toString(), spec.device) == 0);
+            else if (strcmp(field->key, "id") == 0)
+                id = field->value.toNumber();
+            else if (strcmp(field->key, "functions") == 0)
+                functions = field->value;
+        }
+
+        if (!is_device || functions.getTag() != JSON_ARRAY)
+            continue;
+
+        for (auto func : functions) {
+            bool is_op = false;
+            int func_id = -1;
+
+            for (auto field : func->value) {
+                if (strcmp(field->key, "name") == 0)
+                    is_op = (strcmp(field->value.toString(), spec.name) == 0);
+                else if (strcmp(field->key, "id") == 0)
+                    func_id = field->value.toNumber();
+            }
+
+            if (is_op) {
+                dev_id = id;
+                op_id = func_id;
+                return 0;
+            }
+        }
+    }
+
+    fprintf(stderr, "Operation %s.%s not found on the server\n", spec.device, spec.name);
+    return -1;
+}
+
+int resolve_operations(const Options& opts, std::vector<Operation>& ops)
+{
+    Connection conn(opts);
+
+    if (conn.open() < 0)
+        return -1;
+
+    // KServer::GET_CMDS
+    OperationSpec get_cmds_spec = {"KServer", "get_cmds", no_payload, LENGTH_PREFIXED, 0};
+    Operation get_cmds = {&get_cmds_spec, 1, 1, 0, build_message(1, 1, {})};
+    std::vector<unsigned char> data;
+
+    if (conn.send(conn.frame(get_cmds.message)) < 0 || conn.receive(get_cmds, data) < 0)
+        return -1;
+
+    std::string json(data.begin() + 12, data.end());
+    char *endptr;
+    JsonValue devices;
+    JsonAllocator allocator;
+
+    if (jsonParse(&json[0], &endptr, &devices, allocator) != JSON_OK
+        || devices.getTag() != JSON_ARRAY) {
+        fprintf(stderr, "Cannot parse the server commands\n");
+        return -1;
+    }
+
+    // Mix: "op_name:weight,op_name:weight,..."
+    std::string mix = opts.mix + ",";
+    size_t pos;
+
+    while ((pos = mix.find(',')) != std::string::npos) {
+        const std::string item = mix.substr(0, pos);
+        mix.erase(0, pos + 1);
+
+        if (item.empty())
+            continue;
+
+        const auto sep = item.find(':');
+        const std::string name = item.substr(0, sep);
+        const double weight = (sep == std::string::npos) ? 1.0 : atof(item.substr(sep + 1).c_str());
+
+        auto spec = std::find_if(operations_specs.begin(), operations_specs.end(),
+                                 [&](auto& s) { return name == s.name; });
+
+        if (spec == operations_specs.end() || weight <= 0) {
+            fprintf(stderr, "Invalid operation in mix: %s\n", item.c_str());
+            return -1;
+        }
+
+        Operation op;
+        op.spec = &*spec;
+        op.weight = weight;
+
+        if (find_ids(devices, *spec, op.dev_id, op.op_id) < 0)
+            return -1;
+
+        op.message = conn.frame(build_message(op.dev_id, op.op_id, spec->make_payload()));
+        ops.push_back(std::move(op));
+    }
+
+    if (ops.empty()) {
+        fprintf(stderr, "Empty operations mix\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// ------------------------------------------
+// Load
+// ------------------------------------------
+
+struct Results
+{
+    Results(size_t ops_num)
+    : ops_latency(ops_num)
+    , ops_count(ops_num, 0)
+    {}
+
+    LogHistogram latency;
+    std::vector<LogHistogram> ops_latency;
+    std::vector<uint64_t> ops_count;
+    uint64_t bytes_sent = 0;
+    uint64_t bytes_rcvd = 0;
+    bool failed = false;
+
+    void merge(const Results& res) {
+        latency.merge(res.latency);
+
+        for (size_t i = 0; i < ops_latency.size(); i++) {
+            ops_latency[i].merge(res.ops_latency[i]);
+            ops_count[i] += res.ops_count[i];
+        }
+
+        bytes_sent += res.bytes_sent;
+        bytes_rcvd += res.bytes_rcvd;
+        failed = failed || res.failed;
+    }
+};
+
+void run_connection(const Options& opts, const std::vector<Operation>& ops,
+                    unsigned int seed, std::atomic<bool>& start, Results& res)
+{
+    Connection conn(opts);
+
+    if (conn.open() < 0) {
+        res.failed = true;
+        return;
+    }
+
+    std::vector<double> weights;
+
+    for (auto& op : ops)
+        weights.push_back(op.weight);
+
+    std::mt19937 rng(seed);
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+
+    struct Pending {
+        size_t op_idx;
+        uint64_t send_ns;
+    };
+
+    std::deque<Pending> in_flight;
+    std::vector<unsigned char> data;
+
+    const auto send_next = [&]() {
+        const auto idx = pick(rng);
+        in_flight.push_back({idx, clock_ns()});
+        res.bytes_sent += ops[idx].message.size();
+        return conn.send(ops[idx].message);
+    };
+
+    while (!start.load())
+        std::this_thread::yield();
+
+    const auto end_ns = clock_ns() + static_cast<uint64_t>(opts.duration * 1E9);
+
+    for (unsigned int i = 0; i < opts.pipeline; i++) {
+        if (send_next() < 0) {
+            res.failed = true;
+            return;
+        }
+    }
+
+    while (!in_flight.empty()) {
+        const auto pending = in_flight.front();
+        in_flight.pop_front();
+
+        const auto len = conn.receive(ops[pending.op_idx], data);
+
+        if (len < 0) {
+            res.failed = true;
+            return;
+        }
+
+        const auto now = clock_ns();
+        res.latency.record(now - pending.send_ns);
+        res.ops_latency[pending.op_idx].record(now - pending.send_ns);
+        res.ops_count[pending.op_idx]++;
+        res.bytes_rcvd += len;
+
+        if (now < end_ns && send_next() < 0) {
+            res.failed = true;
+            return;
+        }
+    }
+}
+
+// ------------------------------------------
+// Report
+// ------------------------------------------
+
+void print_latency(const LogHistogram& hist)
+{
+    printf("{\"count\": %llu, \"mean\": %.0f, \"p50\": %llu, \"p90\": %llu, "
+           "\"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+           (unsigned long long)hist.count,
+           hist.count > 0 ? double(hist.sum) / hist.count : 0.0,
+           (unsigned long long)hist.quantile(0.5),
+           (unsigned long long)hist.quantile(0.9),
+           (unsigned long long)hist.quantile(0.99),
+           (unsigned long long)hist.quantile(0.999),
+           (unsigned long long)hist.quantile(1.0));
+}
+
+void print_report(const Options& opts, const std::vector<Operation>& ops,
+                  const Results& res, double elapsed)
+{
+    static const char *transports_names[] = {"tcp", "unix", "websocket"};
+
+    printf("{\n");
+    printf("  \"transport\": \"%s\",\n", transports_names[opts.transport]);
+    printf("  \"connections\": %u,\n", opts.connections);
+    printf("  \"pipeline\": %u,\n", opts.pipeline);
+    printf("  \"duration_s\": %.3f,\n", elapsed);
+    printf("  \"requests\": %llu,\n", (unsigned long long)res.latency.count);
+    printf("  \"requests_per_s\": %.1f,\n", res.latency.count / elapsed);
+    printf("  \"bytes_sent_per_s\": %.0f,\n", res.bytes_sent / elapsed);
+    printf("  \"bytes_rcvd_per_s\": %.0f,\n", res.bytes_rcvd / elapsed);
+    printf("  \"latency_ns\": ");
+    print_latency(res.latency);
+    printf(",\n  \"operations\": {");
+
+    for (size_t i = 0; i < ops.size(); i++) {
+        printf("%s\n    \"%s\": ", i == 0 ? "" : ",", ops[i].spec->name);
+        print_latency(res.ops_latency[i]);
+    }
+
+    // Non-empty buckets of the latency histogram: [upper bound (ns), count]
+    printf("\n  },\n  \"histogram_ns\": [");
+    bool first = true;
+
+    for (size_t i = 0; i < kserver::histogram::BUCKETS_NUM; i++) {
+        if (res.latency.counts[i] == 0)
+            continue;
+
+        printf("%s[%llu, %llu]", first ? "" : ", ",
+               (unsigned long long)kserver::histogram::bucket_upper_bound(i),
+               (unsigned long long)res.latency.counts[i]);
+        first = false;
+    }
+
+    printf("]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    Options opts;
+
+    if (parse_options(argc, argv, opts) < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Operation> ops;
+
+    if (resolve_operations(opts, ops) < 0)
+        return EXIT_FAILURE;
+
+    std::atomic<bool> start(false);
+    std::vector<Results> results(opts.connections, Results(ops.size()));
+    std::vector<std::thread> threads;
+
+    for (unsigned int i = 0; i < opts.connections; i++)
+        threads.emplace_back(run_connection, std::cref(opts), std::cref(ops),
+                             i, std::ref(start), std::ref(results[i]));
+
+    const auto begin_ns = clock_ns();
+    start.store(true);
+
+    for (auto& thread : threads)
+        thread.join();
+
+    const double elapsed = (clock_ns() - begin_ns) * 1E-9;
+    Results total(ops.size());
+
+    for (auto& res : results)
+        total.merge(res);
+
+    print_report(opts, ops, total, elapsed);
+
+    if (total.failed || total.latency.count == 0) {
+        fprintf(stderr, "Load generation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/// Microbenchmarks of the response reductions
+///
+/// Covers core/reductions.hpp on 1M samples reduced to 2000 points.
+/// Benchmarks prefixed with "scalar/" run the element per element
+/// loop, which the compiler only vectorizes for integers.
+/// Builds without the generated sources:
+///
+///     make bench_reductions
+///
+/// Results are written as JSON on stdout (see runner.hpp).
+///
+/// Usage: bench_reductions [--filter SUBSTRING] [--repetitions N] [--min-time MS]
+///
+/// (c) Koheron
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+
+#include <core/reductions.hpp>
+
+#include "runner.hpp"
+
+using namespace kserver;
+
+constexpr size_t samples_num = 1048576;
+constexpr size_t points = 2000;
+
+template<typename T>
+void envelope_scalar(const T *data, size_t n, size_t points, std::vector<T>& out)
+{
+    const size_t buckets = std::min(n, points);
+    out.resize(2 * buckets);
+
+    for (size_t k = 0; k < buckets; k++) {
+        const size_t begin = reductions::bucket_begin(n, buckets, k);
+        const size_t end = reductions::bucket_begin(n, buckets, k + 1);
+        T lo = data[begin];
+        T hi = data[begin];
+
+        for (size_t i = begin + 1; i < end; i++) {
+            lo = std::min(lo, data[i]);
+            hi = std::max(hi, data[i]);
+        }
+
+        out[2 * k] = lo;
+        out[2 * k + 1] = hi;
+    }
+}
+
+template<typename T>
+std::vector<T> make_samples()
+{
+    std::mt19937 gen(42);
+    std::normal_distribution<double> dist(0.0, 4.0);
+    std::vector<T> samples(samples_num);
+
+    for (size_t i = 0; i < samples_num; i++)
+        samples[i] = static_cast<T>(8191 * std::sin(2 * M_PI * i / 10000.0) + dist(gen));
+
+    return samples;
+}
+
+template<typename T>
+int check_envelope(const std::vector<T>& samples, const std::string& name)
+{
+    std::vector<T> out, ref;
+
+    for (size_t n : {size_t(1), size_t(15), size_t(1001), samples.size()}) {
+        for (size_t p : {size_t(1), size_t(7), points}) {
+            reductions::envelope(samples.data(), n, p, out);
+            envelope_scalar(samples.data(), n, p, ref);
+
+            if (out != ref) {
+                fprintf(stderr, "envelope/%s differs from the reference (n = %zu, points = %zu)\n",
+                        name.c_str(), n, p);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+template<typename T>
+void bench_reductions(Runner& runner, const std::vector<T>& samples, const std::string& name)
+{
+    const size_t len = samples.size() * sizeof(T);
+    std::vector<T> out;
+    std::vector<double> means;
+    std::vector<uint32_t> counts;
+
+    runner.run("envelope/" + name, len, [&]() {
+        reductions::envelope(samples.data(), samples.size(), points, out);
+        do_not_optimize(out[0]);
+    });
+
+    runner.run("scalar/envelope/" + name, len, [&]() {
+        envelope_scalar(samples.data(), samples.size(), points, out);
+        do_not_optimize(out[0]);
+    });
+
+    runner.run("mean/" + name, len, [&]() {
+        reductions::mean(samples.data(), samples.size(), points, means);
+        do_not_optimize(means[0]);
+    });
+
+    runner.run("histogram/" + name, len, [&]() {
+        double min, max;
+        reductions::histogram(samples.data(), samples.size(), points, min, max, counts);
+        do_not_optimize(counts[0]);
+    });
+
+    runner.run("decimate/" + name, len, [&]() {
+        reductions::decimate(samples.data(), samples.size(), points, out);
+        do_not_optimize(out[0]);
+    });
+}
+
+int main(int argc, char **argv)
+{
+    Options opts;
+
+    if (parse_options(argc, argv, opts) < 0) {
+        fprintf(stderr, "Usage: %s [--filter SUBSTRING] [--repetitions N] [--min-time MS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const auto samples_i16 = make_samples<int16_t>();
+    const auto samples_i32 = make_samples<int32_t>();
+    const auto samples_f32 = make_samples<float>();
+
+    if (check_envelope(samples_i16, "i16") < 0
+        || check_envelope(samples_i32, "i32") < 0
+        || check_envelope(samples_f32, "f32") < 0)
+        return EXIT_FAILURE;
+
+    Runner runner(opts);
+    bench_reductions(runner, samples_i16, "i16");
+    bench_reductions(runner, samples_i32, "i32");
+    bench_reductions(runner, samples_f32, "f32");
+    runner.print_json();
+    return EXIT_SUCCESS;
+}
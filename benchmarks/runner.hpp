@@ -0,0 +1,145 @@
+/// Microbenchmarks runner
+///
+/// Times a function over several repetitions and prints
+/// the results as JSON (see serializer.cpp).
+///
+/// (c) Koheron
+
+#ifndef __BENCHMARKS_RUNNER_HPP__
+#define __BENCHMARKS_RUNNER_HPP__
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <core/clock.hpp>
+
+/// Prevent the compiler from optimizing out a result
+template<typename T>
+inline void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "m"(value) : "memory");
+}
+
+struct Options
+{
+    std::string filter;
+    unsigned int repetitions = 5;
+    uint64_t min_time_ns = 20000000;
+};
+
+struct Result
+{
+    std::string name;
+    uint64_t bytes_per_op;
+    uint64_t iterations;  ///< Iterations per repetition
+    double ns_min;
+    double ns_median;
+    double ns_max;
+};
+
+class Runner
+{
+  public:
+    Runner(const Options& opts_)
+    : opts(opts_)
+    {}
+
+    template<typename Func>
+    void run(const std::string& name, uint64_t bytes_per_op, Func&& func) {
+        if (name.find(opts.filter) == std::string::npos)
+            return;
+
+        // Calibrate the number of iterations per repetition
+        uint64_t iterations = 1;
+
+        while (time_ns(iterations, func) < opts.min_time_ns / 4 && iterations < (1ULL << 40))
+            iterations *= 2;
+
+        iterations = std::max<uint64_t>(1, iterations * 4);
+        std::vector<double> ns_per_op;
+
+        for (unsigned int i = 0; i < opts.repetitions; i++)
+            ns_per_op.push_back(double(time_ns(iterations, func)) / iterations);
+
+        std::sort(ns_per_op.begin(), ns_per_op.end());
+        results.push_back({name, bytes_per_op, iterations, ns_per_op.front(),
+                           ns_per_op[ns_per_op.size() / 2], ns_per_op.back()});
+        fprintf(stderr, "%-48s %12.1f ns\n", name.c_str(), ns_per_op[ns_per_op.size() / 2]);
+    }
+
+    void print_json() const {
+        printf("{\n");
+        printf("  \"arch\": \"%s\",\n", arch());
+        printf("  \"compiler\": \"%s\",\n", __VERSION__);
+        printf("  \"repetitions\": %u,\n", opts.repetitions);
+        printf("  \"results\": [");
+
+        for (size_t i = 0; i < results.size(); i++) {
+            const auto& res = results[i];
+            const double mb_per_s = res.bytes_per_op > 0 ? res.bytes_per_op * 1E3 / res.ns_median : 0.0;
+
+            printf("%s\n    {\"name\": \"%s\", \"bytes_per_op\": %llu, \"iterations\": %llu, "
+                   "\"ns_per_op_min\": %.3f, \"ns_per_op_median\": %.3f, \"ns_per_op_max\": %.3f, "
+                   "\"mb_per_s\": %.1f}",
+                   i == 0 ? "" : ",", res.name.c_str(),
+                   (unsigned long long)res.bytes_per_op, (unsigned long long)res.iterations,
+                   res.ns_min, res.ns_median, res.ns_max, mb_per_s);
+        }
+
+        printf("\n  ]\n}\n");
+    }
+
+  private:
+    const Options& opts;
+    std::vector<Result> results;
+
+    template<typename Func>
+    static uint64_t time_ns(uint64_t iterations, Func& func) {
+        const auto begin = kserver::clock_ns();
+
+        for (uint64_t i = 0; i < iterations; i++)
+            func();
+
+        return kserver::clock_ns() - begin;
+    }
+
+    static constexpr const char* arch() {
+#if defined(__x86_64__)
+        return "x86_64";
+#elif defined(__aarch64__)
+        return "aarch64";
+#elif defined(__arm__)
+        return "arm";
+#else
+        return "unknown";
+#endif
+    }
+};
+
+inline int parse_options(int argc, char **argv, Options& opts)
+{
+    for (int i = 1; i < argc; i++) {
+        const std::string arg(argv[i]);
+
+        if (i + 1 >= argc)
+            return -1;
+
+        const char *value = argv[++i];
+
+        if (arg == "--filter")
+            opts.filter = value;
+        else if (arg == "--repetitions")
+            opts.repetitions = std::max(1, atoi(value));
+        else if (arg == "--min-time")
+            opts.min_time_ns = std::max(1, atoi(value)) * 1000000ULL;
+        else
+            return -1;
+    }
+
+    return 0;
+}
+
+#endif // __BENCHMARKS_RUNNER_HPP__
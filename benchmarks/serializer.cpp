@@ -0,0 +1,278 @@
+/// Microbenchmarks of the serializer and deserializer
+///
+/// Covers core/serializer_deserializer.hpp and core/buffer.hpp.
+/// Benchmarks prefixed with "legacy/" run the byte per byte
+/// reference codec of legacy_serializer.hpp for comparison, and
+/// those prefixed with "native/" the host byte order codec.
+/// Builds without the generated sources:
+///
+///     make bench_serializer
+///
+/// Results are written as JSON on stdout. For each benchmark the
+/// time per operation is measured over several repetitions, each
+/// repetition lasting at least --min-time milliseconds.
+///
+/// Usage: bench_serializer [--filter SUBSTRING] [--repetitions N] [--min-time MS]
+///
+/// (c) Koheron
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <array>
+#include <tuple>
+#include <memory>
+#include <algorithm>
+
+#include <core/serializer_deserializer.hpp>
+#include <core/buffer.hpp>
+
+#include "runner.hpp"
+#include "legacy_serializer.hpp"
+
+using namespace kserver;
+
+// ------------------------------------------
+// extract / append
+// ------------------------------------------
+
+constexpr size_t scalars_num = 4096;
+
+template<typename T>
+void bench_extract(Runner& runner, const char *type_name)
+{
+    std::vector<char> buff(scalars_num * size_of<T>);
+
+    for (size_t i = 0; i < buff.size(); i++)
+        buff[i] = static_cast<char>(i * 7);
+
+    runner.run(std::string("extract<") + type_name + ">/4096", buff.size(), [&]() {
+        const char *p = buff.data();
+        do_not_optimize(p);
+
+        for (size_t i = 0; i < scalars_num; i++) {
+            auto value = extract<T>(p + i * size_of<T>);
+            do_not_optimize(value);
+        }
+    });
+
+    runner.run(std::string("legacy/extract<") + type_name + ">/4096", buff.size(), [&]() {
+        const char *p = buff.data();
+        do_not_optimize(p);
+
+        for (size_t i = 0; i < scalars_num; i++) {
+            auto value = legacy::extract<T>(p + i * size_of<T>);
+            do_not_optimize(value);
+        }
+    });
+}
+
+template<typename T>
+void bench_append(Runner& runner, const char *type_name)
+{
+    std::vector<unsigned char> buff(scalars_num * size_of<T>);
+    std::vector<T> values(scalars_num);
+
+    for (size_t i = 0; i < scalars_num; i++)
+        values[i] = static_cast<T>(i * 3 + 1);
+
+    runner.run(std::string("append<") + type_name + ">/4096", buff.size(), [&]() {
+        for (size_t i = 0; i < scalars_num; i++)
+            append<T>(buff.data() + i * size_of<T>, values[i]);
+
+        do_not_optimize(buff[0]);
+    });
+
+    runner.run(std::string("legacy/append<") + type_name + ">/4096", buff.size(), [&]() {
+        for (size_t i = 0; i < scalars_num; i++)
+            legacy::append<T>(buff.data() + i * size_of<T>, values[i]);
+
+        do_not_optimize(buff[0]);
+    });
+}
+
+// ------------------------------------------
+// deserialize / serialize
+// ------------------------------------------
+
+template<typename... Tp>
+void bench_pack(Runner& runner, const std::string& name, const std::tuple<Tp...>& tup)
+{
+    constexpr auto len = required_buffer_size<Tp...>();
+    const auto buff = serialize<Tp...>(tup);
+    const char *data = reinterpret_cast<const char *>(buff.data());
+
+    runner.run("deserialize<" + name + ">", len, [&]() {
+        do_not_optimize(data);
+        auto res = deserialize<0, Tp...>(data);
+        do_not_optimize(res);
+    });
+
+    runner.run("legacy/deserialize<" + name + ">", len, [&]() {
+        do_not_optimize(data);
+        auto res = legacy::deserialize<0, Tp...>(data);
+        do_not_optimize(res);
+    });
+
+    runner.run("native/deserialize<" + name + ">", len, [&]() {
+        do_not_optimize(data);
+        auto res = deserialize<ByteOrder::NATIVE, 0, Tp...>(data);
+        do_not_optimize(res);
+    });
+
+    runner.run("serialize(" + name + ")", len, [&]() {
+        do_not_optimize(tup);
+        auto arr = serialize<Tp...>(tup);
+        do_not_optimize(arr);
+    });
+
+    runner.run("native/serialize(" + name + ")", len, [&]() {
+        do_not_optimize(tup);
+        auto arr = serialize<ByteOrder::NATIVE, Tp...>(tup);
+        do_not_optimize(arr);
+    });
+
+    runner.run("legacy/serialize(" + name + ")", len, [&]() {
+        do_not_optimize(tup);
+        auto arr = legacy::serialize<Tp...>(tup);
+        do_not_optimize(arr);
+    });
+}
+
+void bench_packs(Runner& runner)
+{
+    bench_pack(runner, "u32,u32", std::make_tuple(uint32_t(1), uint32_t(2)));
+    bench_pack(runner, "u32,u16,u16", std::make_tuple(0U, uint16_t(2), uint16_t(3)));
+    bench_pack(runner, "u64,u64", std::make_tuple(uint64_t(1), uint64_t(2)));
+    bench_pack(runner, "bool,f32,f32,u8,u16",
+               std::make_tuple(true, 1.5f, 2.5f, uint8_t(3), uint16_t(4)));
+    bench_pack(runner, "i8,i8,i16,i16,i32,i32",
+               std::make_tuple(int8_t(1), int8_t(-1), int16_t(2), int16_t(-2), 3, -3));
+    bench_pack(runner, "u32,f32,u64,f64,i64",
+               std::make_tuple(uint32_t(1), 2.5f, uint64_t(3), 4.5, int64_t(-5)));
+    bench_pack(runner, "u32,f32,u64,f64,bool,i16",
+               std::make_tuple(uint32_t(42), 3.14f, uint64_t(1), 2.71828, true, int16_t(-12)));
+}
+
+// ------------------------------------------
+// DynamicSerializer
+// ------------------------------------------
+
+void bench_build_command(Runner& runner)
+{
+    // Same scalar pack size and buffer reuse as in Session
+    DynamicSerializer<1024> dyn_ser;
+    std::vector<unsigned char> buffer;
+
+    const auto run = [&](const std::string& name, auto&&... args) {
+        dyn_ser.build_command<2, 3>(buffer, args...);
+        const uint64_t len = buffer.size();
+
+        runner.run("build_command/" + name, len, [&]() {
+            dyn_ser.build_command<2, 3>(buffer, args...);
+            do_not_optimize(buffer[0]);
+        });
+    };
+
+    run("empty");
+    run("scalars(u32,f32,u64,f64,bool)", uint32_t(42), 3.14f, uint64_t(1), 2.71828, true);
+    run("tuple(u32,f32,u64,f64,bool)", std::make_tuple(uint32_t(42), 3.14f, uint64_t(1), 2.71828, true));
+    run("string/64", std::string(64, 'a'));
+    run("c_string/64", std::string(64, 'a').c_str());
+
+    const auto arr = std::make_unique<std::array<uint32_t, 16384>>();
+    arr->fill(0x01020304);
+    run("array<u32,16384>", *arr);
+
+    run("vector<u32>/4096", std::vector<uint32_t>(4096, 1));
+    run("vector<f32>/1M", std::vector<float>(1024 * 1024, 1.0f));
+    run("vector<f64>/1M", std::vector<double>(1024 * 1024, 1.0));
+    run("mixed(u32,vector<f32>/1024,f64,string/16)",
+        uint32_t(1), std::vector<float>(1024, 1.0f), 2.0, std::string(16, 'b'));
+}
+
+// ------------------------------------------
+// Buffer
+// ------------------------------------------
+
+template<size_t len, typename T>
+void bench_to_vector(Runner& runner, const std::string& name)
+{
+    // Allocated on the heap since len may be several MB
+    const auto buff = std::make_unique<Buffer<len>>();
+    buff->set();
+    std::vector<T> vec;
+    constexpr uint64_t length = len / sizeof(T);
+
+    runner.run("Buffer::to_vector<" + name, length * sizeof(T), [&]() {
+        buff->reset();
+        buff->to_vector(vec, length);
+        do_not_optimize(vec[0]);
+    });
+}
+
+void bench_buffer(Runner& runner)
+{
+    // CMD_PAYLOAD_BUFFER_LEN
+    bench_to_vector<16384 * 8, uint32_t>(runner, "u32>/128KB");
+    bench_to_vector<4 * 1024 * 1024, float>(runner, "f32>/4MB");
+
+    const auto buff = std::make_unique<Buffer<16384 * 8>>();
+    buff->set();
+    std::string str;
+
+    runner.run("Buffer::to_string/4096", 4096, [&]() {
+        buff->reset();
+        buff->to_string(str, 4096);
+        do_not_optimize(str[0]);
+    });
+
+    runner.run("Buffer::extract_array<u32,4096>", 4096 * sizeof(uint32_t), [&]() {
+        buff->reset();
+        const auto& arr = buff->extract_array<uint32_t, 4096>();
+        do_not_optimize(arr[0]);
+    });
+
+    runner.run("Buffer::deserialize<u32,f32,u64>", 16, [&]() {
+        buff->reset();
+        auto tup = buff->deserialize<uint32_t, float, uint64_t>();
+        do_not_optimize(tup);
+    });
+}
+
+// ------------------------------------------
+// Main
+// ------------------------------------------
+
+int main(int argc, char **argv)
+{
+    Options opts;
+
+    if (parse_options(argc, argv, opts) < 0) {
+        fprintf(stderr, "Usage: %s [--filter SUBSTRING] [--repetitions N] [--min-time MS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Runner runner(opts);
+
+    bench_extract<uint16_t>(runner, "u16");
+    bench_extract<uint32_t>(runner, "u32");
+    bench_extract<uint64_t>(runner, "u64");
+    bench_extract<float>(runner, "f32");
+    bench_extract<double>(runner, "f64");
+
+    bench_append<uint16_t>(runner, "u16");
+    bench_append<uint32_t>(runner, "u32");
+    bench_append<uint64_t>(runner, "u64");
+    bench_append<float>(runner, "f32");
+    bench_append<double>(runner, "f64");
+
+    bench_packs(runner);
+    bench_build_command(runner);
+    bench_buffer(runner);
+
+    runner.print_json();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,27 @@
+/// Monotonic clock for timing measurements
+///
+/// (c) Koheron
+
+#ifndef __CLOCK_HPP__
+#define __CLOCK_HPP__
+
+#include <cstdint>
+#include <ctime>
+
+namespace kserver {
+
+/// Monotonic time in nanoseconds
+///
+/// clock_gettime(CLOCK_MONOTONIC) is served by the vDSO on both
+/// x86 and ARM Linux, so no system call is involved.
+inline uint64_t clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL
+           + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+} // namespace kserver
+
+#endif // __CLOCK_HPP__
@@ -0,0 +1,494 @@
+/// Implementation of codecs.hpp
+///
+/// (c) Koheron
+
+#include "codecs.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace kserver {
+
+namespace codecs {
+
+// ------------------------------------------
+// LZ (LZ4 block format)
+// ------------------------------------------
+
+namespace {
+
+constexpr size_t min_match = 4;
+constexpr size_t last_literals = 5;   // The last 5 bytes are always literals
+constexpr size_t match_limit = 12;    // No match starts in the last 12 bytes
+constexpr size_t max_offset = 65535;
+constexpr int hash_log = 12;
+
+inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+inline uint32_t hash(uint32_t seq)
+{
+    return (seq * 2654435761U) >> (32 - hash_log);
+}
+
+// Number of equal bytes at p and ref, p not going past limit
+inline size_t match_length(const unsigned char *p, const unsigned char *ref,
+                           const unsigned char *limit)
+{
+    const unsigned char *start = p;
+
+    while (p + 8 <= limit) {
+        const uint64_t diff = read64(p) ^ read64(ref);
+
+        if (diff != 0) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return p - start + (__builtin_ctzll(diff) >> 3);
+#else
+            return p - start + (__builtin_clzll(diff) >> 3);
+#endif
+        }
+
+        p += 8;
+        ref += 8;
+    }
+
+    while (p < limit && *p == *ref) {
+        p++;
+        ref++;
+    }
+
+    return p - start;
+}
+
+inline unsigned char* write_length(unsigned char *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+
+    *op++ = static_cast<unsigned char>(len);
+    return op;
+}
+
+inline unsigned char* write_sequence(unsigned char *op, const unsigned char *literals,
+                                     size_t literals_len, size_t offset, size_t match_len)
+{
+    unsigned char *token = op++;
+    *token = static_cast<unsigned char>(std::min<size_t>(literals_len, 15) << 4);
+
+    if (literals_len >= 15)
+        op = write_length(op, literals_len - 15);
+
+    memcpy(op, literals, literals_len);
+    op += literals_len;
+
+    if (offset == 0) // Last literals
+        return op;
+
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    const size_t len = match_len - min_match;
+    *token |= std::min<size_t>(len, 15);
+
+    if (len >= 15)
+        op = write_length(op, len - 15);
+
+    return op;
+}
+
+} // namespace
+
+size_t lz_compress(const unsigned char *src, size_t n, unsigned char *dst)
+{
+    unsigned char *op = dst;
+    const unsigned char *anchor = src;
+
+    if (n >= match_limit + 1) {
+        uint32_t table[1 << hash_log];
+        memset(table, 0, sizeof(table));
+
+        const unsigned char *ip = src + 1;
+        const unsigned char *match_end = src + n - match_limit;
+        const unsigned char *extend_limit = src + n - last_literals;
+        unsigned int misses = 0;
+
+        while (ip < match_end) {
+            const uint32_t seq = read32(ip);
+            const uint32_t h = hash(seq);
+            const unsigned char *ref = src + table[h];
+            table[h] = ip - src;
+
+            if (ip - ref > static_cast<ptrdiff_t>(max_offset) || read32(ref) != seq) {
+                // Skip faster through incompressible data
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+
+            misses = 0;
+            const size_t len = min_match + match_length(ip + min_match, ref + min_match,
+                                                        extend_limit);
+            op = write_sequence(op, anchor, ip - anchor, ip - ref, len);
+            ip += len;
+            anchor = ip;
+
+            // Index a position inside the match
+            if (ip < match_end)
+                table[hash(read32(ip - 2))] = ip - 2 - src;
+        }
+    }
+
+    return write_sequence(op, anchor, src + n - anchor, 0, 0) - dst;
+}
+
+int64_t lz_decompress(const unsigned char *src, size_t n,
+                      unsigned char *dst, size_t dst_len)
+{
+    const unsigned char *ip = src;
+    const unsigned char *end = src + n;
+    unsigned char *op = dst;
+    unsigned char *op_end = dst + dst_len;
+
+    const auto read_length = [&](size_t& len) {
+        unsigned char b;
+
+        do {
+            if (ip >= end)
+                return false;
+
+            b = *ip++;
+            len += b;
+        } while (b == 255);
+
+        return true;
+    };
+
+    while (ip < end) {
+        const unsigned char token = *ip++;
+        size_t literals_len = token >> 4;
+
+        if (literals_len == 15 && !read_length(literals_len))
+            return -1;
+
+        if (literals_len > static_cast<size_t>(end - ip)
+            || literals_len > static_cast<size_t>(op_end - op))
+            return -1;
+
+        memcpy(op, ip, literals_len);
+        ip += literals_len;
+        op += literals_len;
+
+        if (ip == end) // Last literals
+            break;
+
+        if (end - ip < 2)
+            return -1;
+
+        const size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t len = token & 0x0f;
+
+        if (len == 15 && !read_length(len))
+            return -1;
+
+        len += min_match;
+
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)
+            || len > static_cast<size_t>(op_end - op))
+            return -1;
+
+        const unsigned char *ref = op - offset;
+
+        if (offset >= len) {
+            memcpy(op, ref, len);
+            op += len;
+            continue;
+        }
+
+        // Overlapping copy: the data from ref are periodic, so the
+        // pattern is duplicated until the distance is a whole word.
+        while (op - ref < 8 && len > 0) {
+            const size_t n = std::min<size_t>(op - ref, len);
+            memcpy(op, ref, n);
+            op += n;
+            len -= n;
+        }
+
+        for (; len >= 8; len -= 8, op += 8, ref += 8)
+            memcpy(op, ref, 8);
+
+        for (; len > 0; len--)
+            *op++ = *ref++;
+    }
+
+    return op - dst;
+}
+
+// ------------------------------------------
+// Shuffle delta
+// ------------------------------------------
+
+namespace {
+
+template<typename U>
+inline U load_elem(const unsigned char *p)
+{
+    U x;
+    memcpy(&x, p, sizeof(U));
+    return x;
+}
+
+template<typename U>
+void shuffle_delta_impl(const unsigned char *src, size_t count, unsigned char *dst)
+{
+    U prev = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const U x = load_elem<U>(src + i * sizeof(U));
+        const U delta = x - prev;
+        prev = x;
+
+        for (size_t b = 0; b < sizeof(U); b++)
+            dst[b * count + i] = static_cast<unsigned char>(delta >> (8 * b));
+    }
+}
+
+template<typename U>
+void unshuffle_delta_impl(const unsigned char *src, size_t count, unsigned char *dst)
+{
+    U prev = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        U delta = 0;
+
+        for (size_t b = 0; b < sizeof(U); b++)
+            delta |= static_cast<U>(src[b * count + i]) << (8 * b);
+
+        prev += delta;
+        memcpy(dst + i * sizeof(U), &prev, sizeof(U));
+    }
+}
+
+} // namespace
+
+void shuffle_delta(const unsigned char *src, size_t n, size_t elem_size,
+                   unsigned char *dst)
+{
+    const size_t count = n / elem_size;
+
+    switch (elem_size) {
+      case 2:
+        shuffle_delta_impl<uint16_t>(src, count, dst);
+        break;
+      case 4:
+        shuffle_delta_impl<uint32_t>(src, count, dst);
+        break;
+      case 8:
+        shuffle_delta_impl<uint64_t>(src, count, dst);
+        break;
+    }
+
+    const size_t done = count * elem_size;
+    memcpy(dst + done, src + done, n - done);
+}
+
+void unshuffle_delta(const unsigned char *src, size_t n, size_t elem_size,
+                     unsigned char *dst)
+{
+    const size_t count = n / elem_size;
+
+    switch (elem_size) {
+      case 2:
+        unshuffle_delta_impl<uint16_t>(src, count, dst);
+        break;
+      case 4:
+        unshuffle_delta_impl<uint32_t>(src, count, dst);
+        break;
+      case 8:
+        unshuffle_delta_impl<uint64_t>(src, count, dst);
+        break;
+    }
+
+    const size_t done = count * elem_size;
+    memcpy(dst + done, src + done, n - done);
+}
+
+// ------------------------------------------
+// Diff
+// ------------------------------------------
+
+namespace {
+
+constexpr size_t run_header_len = 8;
+
+inline void write_be32(unsigned char *p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+inline uint32_t read_be32(const unsigned char *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+           | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+} // namespace
+
+int64_t diff_encode(const unsigned char *prev, const unsigned char *data, size_t n,
+                    unsigned char *dst, size_t max_len)
+{
+    unsigned char *op = dst;
+    size_t last_end = 0;
+    size_t i = 0;
+
+    while (i < n) {
+        // Skip the unchanged words
+        while (i + 8 <= n && read64(prev + i) == read64(data + i))
+            i += 8;
+
+        while (i < n && prev[i] == data[i])
+            i++;
+
+        if (i == n)
+            break;
+
+        // The run ends after run_header_len unchanged bytes
+        const size_t begin = i;
+        size_t end = i + 1;
+
+        for (i = end; i < n && i - end < run_header_len; i++) {
+            if (prev[i] != data[i])
+                end = i + 1;
+        }
+
+        const size_t len = end - begin;
+
+        if (static_cast<size_t>(op - dst) + run_header_len + len > max_len)
+            return -1;
+
+        write_be32(op, begin - last_end);
+        write_be32(op + 4, len);
+        memcpy(op + run_header_len, data + begin, len);
+        op += run_header_len + len;
+        last_end = end;
+        i = end;
+    }
+
+    return op - dst;
+}
+
+int diff_decode(const unsigned char *src, size_t len, unsigned char *data, size_t n)
+{
+    const unsigned char *end = src + len;
+    size_t pos = 0;
+
+    while (src < end) {
+        if (static_cast<size_t>(end - src) < run_header_len)
+            return -1;
+
+        const size_t skip = read_be32(src);
+        const size_t run_len = read_be32(src + 4);
+        src += run_header_len;
+
+        if (run_len > static_cast<size_t>(end - src) || skip > n - pos || run_len > n - pos - skip)
+            return -1;
+
+        pos += skip;
+        memcpy(data + pos, src, run_len);
+        src += run_len;
+        pos += run_len;
+    }
+
+    return 0;
+}
+
+// ------------------------------------------
+// Segments
+// ------------------------------------------
+
+Codec select(uint32_t codecs_mask, size_t elem_size)
+{
+    if ((codecs_mask & (1U << SHUFFLE_DELTA))
+        && (elem_size == 2 || elem_size == 4 || elem_size == 8))
+        return SHUFFLE_DELTA;
+
+    if (codecs_mask & (1U << LZ))
+        return LZ;
+
+    return RAW;
+}
+
+void append_segment(std::vector<unsigned char>& out, Codec codec, size_t elem_size,
+                    const unsigned char *data, size_t n,
+                    std::vector<unsigned char>& scratch)
+{
+    const size_t begin = out.size();
+    out.resize(begin + segment_header_len + (codec == RAW ? n : lz_bound(n)));
+    unsigned char *header = out.data() + begin;
+    unsigned char *payload = header + segment_header_len;
+    size_t encoded_len = n;
+
+    if (codec == LZ) {
+        encoded_len = lz_compress(data, n, payload);
+    } else if (codec == SHUFFLE_DELTA) {
+        if (scratch.size() < n)
+            scratch.resize(n);
+
+        shuffle_delta(data, n, elem_size, scratch.data());
+        encoded_len = lz_compress(scratch.data(), n, payload);
+    }
+
+    if (codec != RAW && encoded_len >= n) {
+        codec = RAW;
+        encoded_len = n;
+    }
+
+    if (codec == RAW)
+        memcpy(payload, data, n);
+
+    header[0] = codec;
+    header[1] = static_cast<unsigned char>(elem_size);
+    write_be32(header + 2, n);
+    write_be32(header + 6, encoded_len);
+    out.resize(begin + segment_header_len + encoded_len);
+}
+
+int append_diff_segment(std::vector<unsigned char>& out, size_t elem_size,
+                        const unsigned char *prev, const unsigned char *data, size_t n)
+{
+    if (n == 0)
+        return -1;
+
+    const size_t begin = out.size();
+    out.resize(begin + segment_header_len + n);
+    unsigned char *header = out.data() + begin;
+    const auto encoded_len = diff_encode(prev, data, n, header + segment_header_len, n - 1);
+
+    if (encoded_len < 0) {
+        out.resize(begin);
+        return -1;
+    }
+
+    header[0] = DIFF;
+    header[1] = static_cast<unsigned char>(elem_size);
+    write_be32(header + 2, n);
+    write_be32(header + 6, encoded_len);
+    out.resize(begin + segment_header_len + encoded_len);
+    return 0;
+}
+
+} // namespace codecs
+
+} // namespace kserver
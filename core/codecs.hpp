@@ -0,0 +1,117 @@
+/// Response codecs
+///
+/// Compression of the large containers of the responses,
+/// negotiated per session (KServer::SET_RESPONSE_CODECS).
+///
+/// Codecs:
+/// - LZ: LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md)
+/// - SHUFFLE_DELTA: for arrays of 2, 4 or 8 bytes numbers. Each element is
+///   replaced by its difference with the previous one (as an unsigned integer,
+///   modulo 2^(8 * elem_size)), then the bytes are grouped by significance
+///   (all the least significant bytes first) and the result compressed with LZ.
+///   Remaining bytes of an incomplete element are appended unchanged.
+/// - DIFF: changes relative to the segment at the same position in the
+///   previous encoded response of the same operation (see diff_encode).
+///   The client keeps the decoded segments of the last encoded response
+///   of each (device, operation). The server sends a full segment, encoded
+///   with the other codecs of the mask, on the first call, when the size
+///   changes or when the diff is not smaller than the data. The history
+///   of both sides is reset by KServer::SET_RESPONSE_CODECS.
+///
+/// Encoded responses have the RESPONSE_ENCODED flag set in the first
+/// reserved byte of the header. The payload following the header is
+/// a sequence of segments, each made of a 10 bytes segment header:
+///
+///     | codec (u8) | elem_size (u8) | decoded_len (u32) | encoded_len (u32) |
+///
+/// (lengths in network byte order) followed by the encoded_len bytes of
+/// the segment. Concatenating the decoded segments gives the payload
+/// of the response.
+///
+/// (c) Koheron
+
+#ifndef __CODECS_HPP__
+#define __CODECS_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace kserver {
+
+namespace codecs {
+
+enum Codec : uint8_t {
+    RAW = 0,
+    LZ = 1,
+    SHUFFLE_DELTA = 2,
+    DIFF = 3,
+    codecs_num
+};
+
+/// Bit mask of the codecs implemented by the server
+constexpr uint32_t supported_mask = (1U << LZ) | (1U << SHUFFLE_DELTA) | (1U << DIFF);
+
+/// Flag of the first header byte marking an encoded response
+constexpr uint8_t RESPONSE_ENCODED = 0x01;
+
+constexpr size_t segment_header_len = 10;
+
+/// Maximum LZ compressed size of n bytes
+constexpr size_t lz_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+/// Compress n bytes of src into dst, which must hold lz_bound(n) bytes.
+/// Returns the compressed size.
+size_t lz_compress(const unsigned char *src, size_t n, unsigned char *dst);
+
+/// Decompress the n bytes of src into dst, which holds dst_len bytes.
+/// Returns the decompressed size, or -1 if the data are invalid.
+int64_t lz_decompress(const unsigned char *src, size_t n,
+                      unsigned char *dst, size_t dst_len);
+
+/// Delta and byte shuffle of n bytes (elem_size = 2, 4 or 8)
+void shuffle_delta(const unsigned char *src, size_t n, size_t elem_size,
+                   unsigned char *dst);
+
+/// Inverse of shuffle_delta
+void unshuffle_delta(const unsigned char *src, size_t n, size_t elem_size,
+                     unsigned char *dst);
+
+/// Changed runs of the n bytes of data relative to prev, as a sequence of
+///
+///     | skip (u32) | len (u32) | len bytes |
+///
+/// (network byte order) where skip is the number of unchanged bytes since
+/// the end of the previous run. Runs separated by less unchanged bytes
+/// than a run header are merged.
+/// Returns the encoded size, or -1 if it would exceed max_len bytes.
+int64_t diff_encode(const unsigned char *prev, const unsigned char *data, size_t n,
+                    unsigned char *dst, size_t max_len);
+
+/// Apply the runs of src to the n bytes of data.
+/// Returns 0 on success and -1 if the runs are invalid.
+int diff_decode(const unsigned char *src, size_t len, unsigned char *data, size_t n);
+
+/// Codec used for a container of elements of elem_size bytes,
+/// among the codecs of the mask
+Codec select(uint32_t codecs_mask, size_t elem_size);
+
+/// Append to out a segment with the n bytes of data encoded with codec.
+/// A RAW segment is written if the encoding does not reduce the size.
+/// scratch is a working buffer reused between calls.
+void append_segment(std::vector<unsigned char>& out, Codec codec, size_t elem_size,
+                    const unsigned char *data, size_t n,
+                    std::vector<unsigned char>& scratch);
+
+/// Append to out a DIFF segment of the n bytes of data relative to prev.
+/// Returns -1 without appending if the diff is not smaller than the data.
+int append_diff_segment(std::vector<unsigned char>& out, size_t elem_size,
+                        const unsigned char *prev, const unsigned char *data, size_t n);
+
+} // namespace codecs
+
+} // namespace kserver
+
+#endif // __CODECS_HPP__
@@ -22,13 +22,21 @@ KServerConfig::KServerConfig()
   tcp_worker_connections(DFLT_WORKER_CONNECTIONS),
   websock_port(WEBSOCKET_DFLT_PORT),
   websock_worker_connections(DFLT_WORKER_CONNECTIONS),
-  unixsock_worker_connections(DFLT_WORKER_CONNECTIONS)
+  websock_max_message_size(WEBSOCKET_DFLT_MAX_MESSAGE_SIZE),
+  websock_deflate(false),
+  websock_deflate_threshold(WEBSOCKET_DFLT_DEFLATE_THRESHOLD),
+  websock_deflate_context_takeover(true),
+  unixsock_worker_connections(DFLT_WORKER_CONNECTIONS),
+  tracing(false)
 {
     memset(unixsock_path, 0, UNIX_SOCKET_PATH_LEN);
     strcpy(unixsock_path, DFLT_UNIX_SOCK_PATH);
 
     memset(notify_socket, 0, UNIX_SOCKET_PATH_LEN);
     strcpy(notify_socket, DFLT_NOTIFY_SOCKET);
+
+    memset(trace_file, 0, TRACE_FILE_PATH_LEN);
+    strcpy(trace_file, DFLT_TRACE_FILE);
 }
 
 char* KServerConfig::_get_source(char *filename)
@@ -193,6 +201,48 @@ int KServerConfig::_read_server(JsonValue value, server_t serv_type)
                 websock_worker_connections = i->value.toNumber();
             else if (serv_type == UNIXSOCK_SERVER)        
                 unixsock_worker_connections = i->value.toNumber();
+        }
+        else if (strcmp(i->key, "max_message_size") == 0) {
+            if (serv_type != WEBSOCK_SERVER) {
+                fprintf(stderr, "Field max_message_size only valid for websocket\n");
+                return -1;
+            }
+
+            if (i->value.getTag() != JSON_NUMBER || i->value.toNumber() < 0) {
+                fprintf(stderr, "Invalid value in field max_message_size\n");
+                return -1;
+            }
+
+            websock_max_message_size = i->value.toNumber();
+        }
+        else if (strcmp(i->key, "deflate") == 0) {
+            int status = is_on(i->value);
+
+            if (serv_type != WEBSOCK_SERVER || status < 0) {
+                fprintf(stderr, "Invalid field deflate\n");
+                return -1;
+            }
+
+            websock_deflate = status;
+        }
+        else if (strcmp(i->key, "deflate_threshold") == 0) {
+            if (serv_type != WEBSOCK_SERVER || i->value.getTag() != JSON_NUMBER
+                || i->value.toNumber() < 0) {
+                fprintf(stderr, "Invalid field deflate_threshold\n");
+                return -1;
+            }
+
+            websock_deflate_threshold = i->value.toNumber();
+        }
+        else if (strcmp(i->key, "deflate_context_takeover") == 0) {
+            int status = is_on(i->value);
+
+            if (serv_type != WEBSOCK_SERVER || status < 0) {
+                fprintf(stderr, "Invalid field deflate_context_takeover\n");
+                return -1;
+            }
+
+            websock_deflate_context_takeover = status;
         } else {
             fprintf(stderr, "Unknown server key %s\n", i->key);
             return -1;
@@ -217,6 +267,41 @@ int KServerConfig::_read_unixsocket(JsonValue value)
     return _read_server(value, UNIXSOCK_SERVER);
 }
 
+int KServerConfig::_read_tracing(JsonValue value)
+{
+    if (value.getTag() != JSON_OBJECT) {
+        fprintf(stderr, "Invalid field tracing\n");
+        return -1;
+    }
+
+    for (auto i : value) {
+        if (strcmp(i->key, "enable") == 0) {
+            int status = is_on(i->value);
+
+            if (status < 0) {
+                fprintf(stderr, "Invalid field enable in tracing\n");
+                return -1;
+            }
+
+            tracing = status;
+        }
+        else if (strcmp(i->key, "file") == 0) {
+            if (i->value.getTag() != JSON_STRING
+                || strlen(i->value.toString()) >= TRACE_FILE_PATH_LEN) {
+                fprintf(stderr, "Invalid field file in tracing\n");
+                return -1;
+            }
+
+            strcpy(trace_file, i->value.toString());
+        } else {
+            fprintf(stderr, "Invalid key in tracing\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 void KServerConfig::_check_config()
 {
     if (daemon) {
@@ -245,6 +330,7 @@ void KServerConfig::_check_config()
 #define IS_TCP             TEST_KEY("TCP")
 #define IS_WEBSOCKET       TEST_KEY("websocket")
 #define IS_UNIX            TEST_KEY("unix")
+#define IS_TRACING         TEST_KEY("tracing")
 
 int KServerConfig::load_file(char *filename)
 {
@@ -315,6 +401,10 @@ int KServerConfig::load_file(char *filename)
         else if (IS_UNIX) {
             if (_read_unixsocket(i->value) < 0)
                 return -1;
+        }
+        else if (IS_TRACING) {
+            if (_read_tracing(i->value) < 0)
+                return -1;
         } else {
             fprintf(stderr, "Unknown field %s in configuration file\n", i->key);
             return -1;
@@ -344,10 +434,18 @@ void KServerConfig::show()
     printf("TCP workers: %u\n\n", tcp_worker_connections);
 
     printf("Websocket listen: %u\n", websock_port);
-    printf("Websocket workers: %u\n\n", websock_worker_connections);
+    printf("Websocket workers: %u\n", websock_worker_connections);
+    printf("Websocket max message size: %" PRIu64 " bytes\n", websock_max_message_size);
+    printf("Websocket deflate: %s\n", websock_deflate ? "ON": "OFF");
+    printf("Websocket deflate threshold: %" PRIu64 " bytes\n", websock_deflate_threshold);
+    printf("Websocket deflate context takeover: %s\n\n",
+           websock_deflate_context_takeover ? "ON": "OFF");
 
     printf("Unix socket path: %s\n", unixsock_path);
     printf("Unix socket workers: %u\n\n", unixsock_worker_connections);
+
+    printf("Tracing: %s\n", tracing ? "ON": "OFF");
+    printf("Trace file: %s\n\n", trace_file);
 }
 
 } // namespace kserver
@@ -57,12 +57,25 @@ struct KServerConfig
     unsigned int websock_port;
     /// Websocket max parallel connections
     unsigned int websock_worker_connections;
+    /// Websocket max size of a received message (bytes)
+    uint64_t websock_max_message_size;
+    /// Websocket permessage-deflate compression
+    bool websock_deflate;
+    /// Websocket size under which messages are sent uncompressed (bytes)
+    uint64_t websock_deflate_threshold;
+    /// Websocket compression context kept from one message to the next
+    bool websock_deflate_context_takeover;
 
     /// Unix socket file path
     char unixsock_path[UNIX_SOCKET_PATH_LEN];
     /// Unix socket max parallel connections
     unsigned int unixsock_worker_connections;
 
+    /// Trace the commands at startup
+    bool tracing;
+    /// File where the traces are dumped
+    char trace_file[TRACE_FILE_PATH_LEN];
+
   private:
     char* _get_source(char *filename);
 
@@ -78,6 +91,7 @@ struct KServerConfig
     int _read_tcp(JsonValue value);
     int _read_websocket(JsonValue value);
     int _read_unixsocket(JsonValue value);
+    int _read_tracing(JsonValue value);
 };
 
 } // namespace kserver
@@ -5,11 +5,13 @@
 
 #include <core/kserver_defs.hpp>
 #include <core/syslog.hpp>
+#include <core/triple_buffer.hpp>
 #include <devices_table.hpp>
 
 namespace kserver {
     class DeviceManager;
     class KServer;
+    class Stream;
 }
 
 class ContextBase
@@ -26,6 +28,9 @@ class ContextBase
         syslog = syslog_;
     }
 
+    void invalidate_device_cache(device_id dev);
+    kserver::Stream* add_device_stream(device_id dev, uint32_t block_size, uint32_t capacity);
+
   public:
     template<class Dev>
     Dev& get() const;
@@ -41,6 +46,25 @@ class ContextBase
                               dev_id_of<Dev>>(std::forward<Args>(args)...);
     }
 
+    /// Invalidate the cached responses (@cache) of the operations of Dev
+    template<class Dev>
+    void invalidate_cache() {
+        invalidate_device_cache(dev_id_of<Dev>);
+    }
+
+    /// Invalidate the cached responses of an operation
+    /// (op::Device::operation in operations.hpp)
+    void invalidate_cache(uint32_t op);
+
+    /// Add a stream of blocks of at most block_size bytes to Dev,
+    /// buffered in a ring of capacity blocks (see core/streams.hpp).
+    /// The streams of a device are indexed in the order they are added.
+    /// Returns nullptr on failure.
+    template<class Dev>
+    kserver::Stream* add_stream(uint32_t block_size, uint32_t capacity) {
+        return add_device_stream(dev_id_of<Dev>, block_size, capacity);
+    }
+
   protected:
     virtual int init() { return 0; }
 
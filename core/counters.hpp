@@ -0,0 +1,141 @@
+/// Statistics counters
+///
+/// Counters are either sharded per thread or owned by a
+/// single writer, so that incrementing a counter never
+/// touches a cache line written by another thread.
+/// Values are only aggregated when read.
+///
+/// (c) Koheron
+
+#ifndef __COUNTERS_HPP__
+#define __COUNTERS_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+
+#include "kserver_defs.hpp"
+
+namespace kserver {
+
+/// Shard associated to the calling thread
+inline size_t thread_shard()
+{
+    static std::atomic<size_t> threads_num(0);
+    static thread_local size_t shard = threads_num++ % KSERVER_METRICS_SHARDS;
+    return shard;
+}
+
+/// Counter incremented from many threads
+class ShardedCounter
+{
+  public:
+    ShardedCounter() {
+        for (auto& s : shards)
+            s.value.store(0, std::memory_order_relaxed);
+    }
+
+    void add(uint64_t n = 1) {
+        shards[thread_shard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t load() const {
+        uint64_t sum = 0;
+
+        for (auto& s : shards)
+            sum += s.value.load(std::memory_order_relaxed);
+
+        return sum;
+    }
+
+  private:
+    // Padding rather than alignas: over-aligned types
+    // are not supported by operator new before C++17.
+    struct Shard {
+        std::atomic<uint64_t> value;
+        char padding[KSERVER_CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::array<Shard, KSERVER_METRICS_SHARDS> shards;
+};
+
+/// Counter incremented by a single thread.
+///
+/// Other threads may read it at any time. Since there is only
+/// one writer, no atomic read-modify-write is required.
+class LocalCounter
+{
+  public:
+    LocalCounter() {
+        value.store(0, std::memory_order_relaxed);
+    }
+
+    void add(uint64_t n = 1) {
+        value.store(value.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+    }
+
+    uint64_t load() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<uint64_t> value;
+};
+
+/// Statistics of a session, written by the session thread only
+struct SessionStats
+{
+    LocalCounter requests_num;  ///< Number of requests received
+    LocalCounter errors_num;    ///< Number of requests errors
+    LocalCounter bytes_rcvd;    ///< Number of bytes received
+    LocalCounter bytes_sent;    ///< Number of bytes sent
+    LocalCounter recv_calls;    ///< Number of read system calls
+    LocalCounter send_calls;    ///< Number of write system calls
+
+    // WebSocket permessage-deflate
+    LocalCounter deflate_in;    ///< Number of bytes compressed
+    LocalCounter deflate_out;   ///< Number of bytes after compression
+    LocalCounter deflate_ns;    ///< Time spent compressing (ns)
+    LocalCounter inflate_in;    ///< Number of bytes decompressed
+    LocalCounter inflate_out;   ///< Number of bytes after decompression
+    LocalCounter inflate_ns;    ///< Time spent decompressing (ns)
+};
+
+/// Values of the statistics, aggregated on read
+struct StatsSnapshot
+{
+    uint64_t requests_num = 0;
+    uint64_t errors_num = 0;
+    uint64_t bytes_rcvd = 0;
+    uint64_t bytes_sent = 0;
+    uint64_t recv_calls = 0;
+    uint64_t send_calls = 0;
+    uint64_t deflate_in = 0;
+    uint64_t deflate_out = 0;
+    uint64_t deflate_ns = 0;
+    uint64_t inflate_in = 0;
+    uint64_t inflate_out = 0;
+    uint64_t inflate_ns = 0;
+
+    StatsSnapshot& operator+=(const SessionStats& stats) {
+        requests_num += stats.requests_num.load();
+        errors_num += stats.errors_num.load();
+        bytes_rcvd += stats.bytes_rcvd.load();
+        bytes_sent += stats.bytes_sent.load();
+        recv_calls += stats.recv_calls.load();
+        send_calls += stats.send_calls.load();
+        deflate_in += stats.deflate_in.load();
+        deflate_out += stats.deflate_out.load();
+        deflate_ns += stats.deflate_ns.load();
+        inflate_in += stats.inflate_in.load();
+        inflate_out += stats.inflate_out.load();
+        inflate_ns += stats.inflate_ns.load();
+        return *this;
+    }
+};
+
+} // namespace kserver
+
+#endif // __COUNTERS_HPP__
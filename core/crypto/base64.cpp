@@ -81,6 +81,23 @@ std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_
 
 }
 
+void base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len, char *out) {
+  for (; in_len >= 3; in_len -= 3, bytes_to_encode += 3) {
+    *out++ = base64_chars[bytes_to_encode[0] >> 2];
+    *out++ = base64_chars[((bytes_to_encode[0] & 0x03) << 4) + (bytes_to_encode[1] >> 4)];
+    *out++ = base64_chars[((bytes_to_encode[1] & 0x0f) << 2) + (bytes_to_encode[2] >> 6)];
+    *out++ = base64_chars[bytes_to_encode[2] & 0x3f];
+  }
+
+  if (in_len) {
+    const unsigned char b1 = (in_len == 2) ? bytes_to_encode[1] : 0;
+    *out++ = base64_chars[bytes_to_encode[0] >> 2];
+    *out++ = base64_chars[((bytes_to_encode[0] & 0x03) << 4) + (b1 >> 4)];
+    *out++ = (in_len == 2) ? base64_chars[(b1 & 0x0f) << 2] : '=';
+    *out++ = '=';
+  }
+}
+
 std::string base64_decode(std::string const& encoded_string) {
   int in_len = encoded_string.size();
   int i = 0;
@@ -5,6 +5,9 @@
 #include <string>
 
 std::string base64_encode(unsigned char const* , unsigned int len);
+
+// Write the 4 * ((len + 2) / 3) characters of the encoding to out
+void base64_encode(unsigned char const* , unsigned int len, char *out);
 std::string base64_decode(std::string const& s);
 
 #endif // __BASE64_HPP__
@@ -1,338 +1,171 @@
-/*
- * Copyright (C) 1995, 1996, 1997, and 1998 WIDE Project.
- * All rights reserved.
- *
- * Redistribution and use in source and binary forms, with or without
- * modification, are permitted provided that the following conditions
- * are met:
- * 1. Redistributions of source code must retain the above copyright
- *    notice, this list of conditions and the following disclaimer.
- * 2. Redistributions in binary form must reproduce the above copyright
- *    notice, this list of conditions and the following disclaimer in the
- *    documentation and/or other materials provided with the distribution.
- * 3. Neither the name of the project nor the names of its contributors
- *    may be used to endorse or promote products derived from this software
- *    without specific prior written permission.
- *
- * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
- * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
- * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
- * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
- * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
- * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
- * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
- * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
- * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
- * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
- * SUCH DAMAGE.
- */
-/*
- * FIPS pub 180-1: Secure Hash Algorithm (SHA-1)
- * based on: http://csrc.nist.gov/fips/fip180-1.txt
- * implemented by Jun-ichiro itojun Itoh <itojun@itojun.org>
- */
-
-#include <sys/types.h>
+/// SHA-1 (FIPS 180-4)
+///
+/// The compression function uses the x86 SHA extensions when
+/// compiled for them (-msha or -march=native on a CPU with SHA-NI),
+/// and a portable implementation otherwise.
+///
+/// (c) Koheron
 
-#include <cstdint>
-
-#ifdef WIN32
+#include "sha1.h"
 
-#ifndef BIG_ENDIAN
-#define BIG_ENDIAN    4321  /* to show byte order (taken from gcc) */
-#endif
-#ifndef LITTLE_ENDIAN
-#define LITTLE_ENDIAN 1234
-#endif
-#ifndef BYTE_ORDER
-#define BYTE_ORDER LITTLE_ENDIAN
-#endif
-
-//typedef unsigned char u_int8_t;
-//typedef unsigned int u_int32_t;
-//typedef unsigned __int64 u_int64_t;
-typedef uint8_t u_int8_t;
-typedef uint32_t u_int32_t;
-typedef uint64_t u_int64_t;
-
-typedef void* caddr_t;
-
-#undef __P
-#ifndef __P
-#if __STDC__
-#define __P(protos) protos
-#else
-#define __P(protos) ()
-#endif
-#endif
-
-#define bzero(b,len) (memset((b), '\0', (len)), (void) 0)
+#include <cstdint>
+#include <cstring>
 
-#else
-#include <sys/stat.h>
-#include <sys/cdefs.h>
-#include <sys/time.h>
+#if defined(__SHA__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#define SHA1_HAS_SHA_NI 1
 #endif
 
-#include <string.h>
-
-struct sha1_ctxt {
-	union {
-		u_int8_t	b8[20];
-		u_int32_t	b32[5];
-	} h;
-	union {
-		u_int8_t	b8[8];
-		u_int64_t	b64[1];
-	} c;
-	union {
-		u_int8_t	b8[64];
-		u_int32_t	b32[16];
-	} m;
-	u_int8_t	count;
-};
-
-/* sanity check */
-#if BYTE_ORDER != BIG_ENDIAN
-# if BYTE_ORDER != LITTLE_ENDIAN
-#  define unsupported 1
-# endif
-#endif
+namespace {
 
-#ifndef unsupported
-
-/* constant table */
-static const u_int32_t _K[] = { 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6 };
-#define	K(t)	_K[(t) / 20]
-
-#define	F0(b, c, d)	(((b) & (c)) | ((~(b)) & (d)))
-#define	F1(b, c, d)	(((b) ^ (c)) ^ (d))
-#define	F2(b, c, d)	(((b) & (c)) | ((b) & (d)) | ((c) & (d)))
-#define	F3(b, c, d)	(((b) ^ (c)) ^ (d))
-
-#define	S(n, x)		(((x) << (n)) | ((x) >> (32 - n)))
-
-#define	H(n)	(ctxt->h.b32[(n)])
-#define	COUNT	(ctxt->count)
-#define	BCOUNT	(ctxt->c.b64[0] / 8)
-#define	W(n)	(ctxt->m.b32[(n)])
-
-#define	PUTBYTE(x)	{ \
-	ctxt->m.b8[(COUNT % 64)] = (x);		\
-	COUNT++;				\
-	COUNT %= 64;				\
-	ctxt->c.b64[0] += 8;			\
-	if (COUNT % 64 == 0)			\
-		sha1_step(ctxt);		\
-     }
-
-#define	PUTPAD(x)	{ \
-	ctxt->m.b8[(COUNT % 64)] = (x);		\
-	COUNT++;				\
-	COUNT %= 64;				\
-	if (COUNT % 64 == 0)			\
-		sha1_step(ctxt);		\
-     }
-
-static void sha1_step __P((struct sha1_ctxt *));
-
-static void
-sha1_step(struct sha1_ctxt *ctxt)
+inline uint32_t load_be32(const unsigned char *p)
 {
-	u_int32_t	a, b, c, d, e;
-	size_t t, s;
-	u_int32_t	tmp;
-
-#if BYTE_ORDER == LITTLE_ENDIAN
-	struct sha1_ctxt tctxt;
-
-	memcpy(&tctxt.m.b8[0], &ctxt->m.b8[0], 64);
-	ctxt->m.b8[0] = tctxt.m.b8[3]; ctxt->m.b8[1] = tctxt.m.b8[2];
-	ctxt->m.b8[2] = tctxt.m.b8[1]; ctxt->m.b8[3] = tctxt.m.b8[0];
-	ctxt->m.b8[4] = tctxt.m.b8[7]; ctxt->m.b8[5] = tctxt.m.b8[6];
-	ctxt->m.b8[6] = tctxt.m.b8[5]; ctxt->m.b8[7] = tctxt.m.b8[4];
-	ctxt->m.b8[8] = tctxt.m.b8[11]; ctxt->m.b8[9] = tctxt.m.b8[10];
-	ctxt->m.b8[10] = tctxt.m.b8[9]; ctxt->m.b8[11] = tctxt.m.b8[8];
-	ctxt->m.b8[12] = tctxt.m.b8[15]; ctxt->m.b8[13] = tctxt.m.b8[14];
-	ctxt->m.b8[14] = tctxt.m.b8[13]; ctxt->m.b8[15] = tctxt.m.b8[12];
-	ctxt->m.b8[16] = tctxt.m.b8[19]; ctxt->m.b8[17] = tctxt.m.b8[18];
-	ctxt->m.b8[18] = tctxt.m.b8[17]; ctxt->m.b8[19] = tctxt.m.b8[16];
-	ctxt->m.b8[20] = tctxt.m.b8[23]; ctxt->m.b8[21] = tctxt.m.b8[22];
-	ctxt->m.b8[22] = tctxt.m.b8[21]; ctxt->m.b8[23] = tctxt.m.b8[20];
-	ctxt->m.b8[24] = tctxt.m.b8[27]; ctxt->m.b8[25] = tctxt.m.b8[26];
-	ctxt->m.b8[26] = tctxt.m.b8[25]; ctxt->m.b8[27] = tctxt.m.b8[24];
-	ctxt->m.b8[28] = tctxt.m.b8[31]; ctxt->m.b8[29] = tctxt.m.b8[30];
-	ctxt->m.b8[30] = tctxt.m.b8[29]; ctxt->m.b8[31] = tctxt.m.b8[28];
-	ctxt->m.b8[32] = tctxt.m.b8[35]; ctxt->m.b8[33] = tctxt.m.b8[34];
-	ctxt->m.b8[34] = tctxt.m.b8[33]; ctxt->m.b8[35] = tctxt.m.b8[32];
-	ctxt->m.b8[36] = tctxt.m.b8[39]; ctxt->m.b8[37] = tctxt.m.b8[38];
-	ctxt->m.b8[38] = tctxt.m.b8[37]; ctxt->m.b8[39] = tctxt.m.b8[36];
-	ctxt->m.b8[40] = tctxt.m.b8[43]; ctxt->m.b8[41] = tctxt.m.b8[42];
-	ctxt->m.b8[42] = tctxt.m.b8[41]; ctxt->m.b8[43] = tctxt.m.b8[40];
-	ctxt->m.b8[44] = tctxt.m.b8[47]; ctxt->m.b8[45] = tctxt.m.b8[46];
-	ctxt->m.b8[46] = tctxt.m.b8[45]; ctxt->m.b8[47] = tctxt.m.b8[44];
-	ctxt->m.b8[48] = tctxt.m.b8[51]; ctxt->m.b8[49] = tctxt.m.b8[50];
-	ctxt->m.b8[50] = tctxt.m.b8[49]; ctxt->m.b8[51] = tctxt.m.b8[48];
-	ctxt->m.b8[52] = tctxt.m.b8[55]; ctxt->m.b8[53] = tctxt.m.b8[54];
-	ctxt->m.b8[54] = tctxt.m.b8[53]; ctxt->m.b8[55] = tctxt.m.b8[52];
-	ctxt->m.b8[56] = tctxt.m.b8[59]; ctxt->m.b8[57] = tctxt.m.b8[58];
-	ctxt->m.b8[58] = tctxt.m.b8[57]; ctxt->m.b8[59] = tctxt.m.b8[56];
-	ctxt->m.b8[60] = tctxt.m.b8[63]; ctxt->m.b8[61] = tctxt.m.b8[62];
-	ctxt->m.b8[62] = tctxt.m.b8[61]; ctxt->m.b8[63] = tctxt.m.b8[60];
-#endif
-
-	a = H(0); b = H(1); c = H(2); d = H(3); e = H(4);
-
-	for (t = 0; t < 20; t++) {
-		s = t & 0x0f;
-		if (t >= 16)
-			W(s) = S(1, W((s+13) & 0x0f) ^ W((s+8) & 0x0f) ^
-							W((s+2) & 0x0f) ^ W(s));
-
-		tmp = S(5, a) + F0(b, c, d) + e + W(s) + K(t);
-		e = d; d = c; c = S(30, b); b = a; a = tmp;
-	}
-	for (t = 20; t < 40; t++) {
-		s = t & 0x0f;
-		W(s) = S(1, W((s+13) & 0x0f) ^ W((s+8) & 0x0f) ^
-							W((s+2) & 0x0f) ^ W(s));
-		tmp = S(5, a) + F1(b, c, d) + e + W(s) + K(t);
-		e = d; d = c; c = S(30, b); b = a; a = tmp;
-	}
-	for (t = 40; t < 60; t++) {
-		s = t & 0x0f;
-		W(s) = S(1, W((s+13) & 0x0f) ^ W((s+8) & 0x0f) ^
-							W((s+2) & 0x0f) ^ W(s));
-		tmp = S(5, a) + F2(b, c, d) + e + W(s) + K(t);
-		e = d; d = c; c = S(30, b); b = a; a = tmp;
-	}
-	for (t = 60; t < 80; t++) {
-		s = t & 0x0f;
-		W(s) = S(1, W((s+13) & 0x0f) ^ W((s+8) & 0x0f) ^
-							W((s+2) & 0x0f) ^ W(s));
-		tmp = S(5, a) + F3(b, c, d) + e + W(s) + K(t);
-		e = d; d = c; c = S(30, b); b = a; a = tmp;
-	}
-
-	H(0) = H(0) + a;
-	H(1) = H(1) + b;
-	H(2) = H(2) + c;
-	H(3) = H(3) + d;
-	H(4) = H(4) + e;
-
-	bzero(&ctxt->m.b8[0], 64);
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+           | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
 }
 
-/*------------------------------------------------------------*/
-
-void
-sha1_init(struct sha1_ctxt *ctxt)
+inline void store_be32(unsigned char *p, uint32_t x)
 {
-	bzero(ctxt, sizeof(struct sha1_ctxt));
-	H(0) = 0x67452301;
-	H(1) = 0xefcdab89;
-	H(2) = 0x98badcfe;
-	H(3) = 0x10325476;
-	H(4) = 0xc3d2e1f0;
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
 }
 
-void
-sha1_pad(struct sha1_ctxt *ctxt)
+inline uint32_t rotl(uint32_t x, int n)
 {
-	size_t padlen;		/*pad length in bytes*/
-	size_t padstart;
-
-	PUTPAD(0x80);
-
-	padstart = COUNT % 64;
-	padlen = 64 - padstart;
-	if (padlen < 8) {
-		bzero(&ctxt->m.b8[padstart], padlen);
-		COUNT += padlen;
-		COUNT %= 64;
-		sha1_step(ctxt);
-		padstart = COUNT % 64;	/* should be 0 */
-		padlen = 64 - padstart;	/* should be 64 */
-	}
-	bzero(&ctxt->m.b8[padstart], padlen - 8);
-	COUNT += (padlen - 8);
-	COUNT %= 64;
-#if BYTE_ORDER == BIG_ENDIAN
-	PUTPAD(ctxt->c.b8[0]); PUTPAD(ctxt->c.b8[1]);
-	PUTPAD(ctxt->c.b8[2]); PUTPAD(ctxt->c.b8[3]);
-	PUTPAD(ctxt->c.b8[4]); PUTPAD(ctxt->c.b8[5]);
-	PUTPAD(ctxt->c.b8[6]); PUTPAD(ctxt->c.b8[7]);
-#else
-	PUTPAD(ctxt->c.b8[7]); PUTPAD(ctxt->c.b8[6]);
-	PUTPAD(ctxt->c.b8[5]); PUTPAD(ctxt->c.b8[4]);
-	PUTPAD(ctxt->c.b8[3]); PUTPAD(ctxt->c.b8[2]);
-	PUTPAD(ctxt->c.b8[1]); PUTPAD(ctxt->c.b8[0]);
-#endif
+    return (x << n) | (x >> (32 - n));
 }
 
-void
-sha1_loop(struct sha1_ctxt *ctxt, const u_int8_t *input, size_t len)
+#if SHA1_HAS_SHA_NI
+
+// Four rounds per instruction. Group g covers the rounds 4g to 4g+3:
+// the message schedule of the group g+1 to g+3 is computed meanwhile.
+#define SHA1_GROUP(g)                                                         \
+    if (g < 4)                                                                \
+        msg[g % 4] = _mm_shuffle_epi8(                                        \
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * g)), \
+            bswap);                                                           \
+    e[g % 2] = (g == 0) ? _mm_add_epi32(e[0], msg[0])                         \
+                        : _mm_sha1nexte_epu32(e[g % 2], msg[g % 4]);          \
+    e[(g + 1) % 2] = abcd;                                                    \
+    if (g >= 3 && g <= 18)                                                    \
+        msg[(g + 1) % 4] = _mm_sha1msg2_epu32(msg[(g + 1) % 4], msg[g % 4]);  \
+    abcd = _mm_sha1rnds4_epu32(abcd, e[g % 2], g / 5);                        \
+    if (g >= 1 && g <= 16)                                                    \
+        msg[(g + 3) % 4] = _mm_sha1msg1_epu32(msg[(g + 3) % 4], msg[g % 4]);  \
+    if (g >= 2 && g <= 17)                                                    \
+        msg[(g + 2) % 4] = _mm_xor_si128(msg[(g + 2) % 4], msg[g % 4]);
+
+void sha1_blocks(uint32_t state[5], const unsigned char *data, size_t blocks)
 {
-	size_t gaplen;
-	size_t gapstart;
-	size_t off;
-	size_t copysiz;
-
-	off = 0;
-
-	while (off < len) {
-		gapstart = COUNT % 64;
-		gaplen = 64 - gapstart;
-
-		copysiz = (gaplen < len - off) ? gaplen : len - off;
-		memcpy(&ctxt->m.b8[gapstart], &input[off], copysiz);
-		COUNT += copysiz;
-		COUNT %= 64;
-		ctxt->c.b64[0] += copysiz * 8;
-		if (COUNT % 64 == 0)
-			sha1_step(ctxt);
-		off += copysiz;
-	}
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+    __m128i e[2];
+    __m128i msg[4];
+    e[0] = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (; blocks > 0; blocks--, data += 64) {
+        const __m128i abcd_save = abcd;
+        const __m128i e_save = e[0];
+
+        SHA1_GROUP(0)  SHA1_GROUP(1)  SHA1_GROUP(2)  SHA1_GROUP(3)
+        SHA1_GROUP(4)  SHA1_GROUP(5)  SHA1_GROUP(6)  SHA1_GROUP(7)
+        SHA1_GROUP(8)  SHA1_GROUP(9)  SHA1_GROUP(10) SHA1_GROUP(11)
+        SHA1_GROUP(12) SHA1_GROUP(13) SHA1_GROUP(14) SHA1_GROUP(15)
+        SHA1_GROUP(16) SHA1_GROUP(17) SHA1_GROUP(18) SHA1_GROUP(19)
+
+        e[0] = _mm_sha1nexte_epu32(e[0], e_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = _mm_extract_epi32(e[0], 3);
 }
 
-void
-sha1_result(struct sha1_ctxt *ctxt, caddr_t digest0)
+#undef SHA1_GROUP
+
+#else // SHA1_HAS_SHA_NI
+
+// Fully unrolled: the roles of the working variables rotate
+// instead of being moved, and the message schedule is kept
+// in a 16 words ring.
+#define F0(b, c, d) (d ^ (b & (c ^ d)))
+#define F1(b, c, d) (b ^ c ^ d)
+#define F2(b, c, d) ((b & c) | (d & (b | c)))
+
+#define SHA1_W(t)                                                          \
+    ((t) < 16 ? w[(t) & 15]                                                \
+              : (w[(t) & 15] = rotl(w[((t) + 13) & 15] ^ w[((t) + 8) & 15] \
+                                    ^ w[((t) + 2) & 15] ^ w[(t) & 15], 1)))
+
+#define SHA1_ROUND(a, b, c, d, e, f, k, t)              \
+    e += rotl(a, 5) + f(b, c, d) + k + SHA1_W(t);       \
+    b = rotl(b, 30);
+
+#define SHA1_ROUNDS5(f, k, t)                           \
+    SHA1_ROUND(a, b, c, d, e, f, k, t)                  \
+    SHA1_ROUND(e, a, b, c, d, f, k, t + 1)              \
+    SHA1_ROUND(d, e, a, b, c, f, k, t + 2)              \
+    SHA1_ROUND(c, d, e, a, b, f, k, t + 3)              \
+    SHA1_ROUND(b, c, d, e, a, f, k, t + 4)
+
+void sha1_blocks(uint32_t state[5], const unsigned char *data, size_t blocks)
 {
-	u_int8_t *digest;
-
-	digest = (u_int8_t *)digest0;
-	sha1_pad(ctxt);
-#if BYTE_ORDER == BIG_ENDIAN
-	memcpy(digest, &ctxt->h.b8[0], 20);
-#else
-	digest[0] = ctxt->h.b8[3]; digest[1] = ctxt->h.b8[2];
-	digest[2] = ctxt->h.b8[1]; digest[3] = ctxt->h.b8[0];
-	digest[4] = ctxt->h.b8[7]; digest[5] = ctxt->h.b8[6];
-	digest[6] = ctxt->h.b8[5]; digest[7] = ctxt->h.b8[4];
-	digest[8] = ctxt->h.b8[11]; digest[9] = ctxt->h.b8[10];
-	digest[10] = ctxt->h.b8[9]; digest[11] = ctxt->h.b8[8];
-	digest[12] = ctxt->h.b8[15]; digest[13] = ctxt->h.b8[14];
-	digest[14] = ctxt->h.b8[13]; digest[15] = ctxt->h.b8[12];
-	digest[16] = ctxt->h.b8[19]; digest[17] = ctxt->h.b8[18];
-	digest[18] = ctxt->h.b8[17]; digest[19] = ctxt->h.b8[16];
-#endif
+    for (; blocks > 0; blocks--, data += 64) {
+        uint32_t w[16];
+
+        for (int t = 0; t < 16; t++)
+            w[t] = load_be32(data + 4 * t);
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+        SHA1_ROUNDS5(F0, 0x5a827999, 0)  SHA1_ROUNDS5(F0, 0x5a827999, 5)
+        SHA1_ROUNDS5(F0, 0x5a827999, 10) SHA1_ROUNDS5(F0, 0x5a827999, 15)
+        SHA1_ROUNDS5(F1, 0x6ed9eba1, 20) SHA1_ROUNDS5(F1, 0x6ed9eba1, 25)
+        SHA1_ROUNDS5(F1, 0x6ed9eba1, 30) SHA1_ROUNDS5(F1, 0x6ed9eba1, 35)
+        SHA1_ROUNDS5(F2, 0x8f1bbcdc, 40) SHA1_ROUNDS5(F2, 0x8f1bbcdc, 45)
+        SHA1_ROUNDS5(F2, 0x8f1bbcdc, 50) SHA1_ROUNDS5(F2, 0x8f1bbcdc, 55)
+        SHA1_ROUNDS5(F1, 0xca62c1d6, 60) SHA1_ROUNDS5(F1, 0xca62c1d6, 65)
+        SHA1_ROUNDS5(F1, 0xca62c1d6, 70) SHA1_ROUNDS5(F1, 0xca62c1d6, 75)
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
 }
 
-/*
- * This should look and work like the libcrypto implementation
- */
+#undef SHA1_ROUNDS5
+#undef SHA1_ROUND
+#undef SHA1_W
+#undef F0
+#undef F1
+#undef F2
+
+#endif // SHA1_HAS_SHA_NI
 
-unsigned char *
-SHA1(const unsigned char *d, size_t n, unsigned char *md)
+} // namespace
+
+unsigned char * SHA1(const unsigned char *d, size_t n, unsigned char *md)
 {
-	struct sha1_ctxt ctx;
+    uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
 
-	sha1_init(&ctx);
-	sha1_loop(&ctx, d, n);
-	sha1_result(&ctx, (caddr_t)md);
+    sha1_blocks(state, d, n / 64);
 
-	return md;
-}
+    // Padding: 0x80, zeros and the message length in bits
+    unsigned char last[128] = {};
+    const size_t rem = n % 64;
+    const size_t last_len = (rem + 9 <= 64) ? 64 : 128;
+    memcpy(last, d + n - rem, rem);
+    last[rem] = 0x80;
+    store_be32(last + last_len - 8, static_cast<uint32_t>(static_cast<uint64_t>(n) >> 29));
+    store_be32(last + last_len - 4, static_cast<uint32_t>(n << 3));
+    sha1_blocks(state, last, last_len / 64);
 
-#endif /*unsupported*/
+    for (int i = 0; i < 5; i++)
+        store_be32(md + 4 * i, state[i]);
 
+    return md;
+}
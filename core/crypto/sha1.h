@@ -2,6 +2,8 @@
 #ifndef __SHA1_H__
 #define __SHA1_H__
 
+#include <cstddef>
+
 unsigned char * SHA1(const unsigned char *d, size_t n, unsigned char *md);
 
 #endif // __SHA1_H__
@@ -7,6 +7,7 @@
 #include "commands.hpp"
 #include "syslog.tpp"
 #include "meta_utils.hpp"
+#include "clock.hpp"
 #include <ks_devices.hpp>
 
 namespace kserver {
@@ -40,7 +41,8 @@ int DevicesContainer::alloc() {
 //----------------------------------------------------------------------------
 
 DeviceManager::DeviceManager(KServer *kserver_)
-: kserver(kserver_)
+: streams(kserver_)
+, kserver(kserver_)
 , dev_cont(ctx, kserver->syslog)
 {
     ctx.set_device_manager(this);
@@ -113,49 +115,80 @@ int DeviceManager::init()
     return 0;
 }
 
-template<device_id dev0, device_id... devs>
+template<device_id dev0, device_id... devs, typename Func>
 std::enable_if_t<0 == sizeof...(devs) && 2 <= dev0, int>
-DeviceManager::execute_dev_impl(KDeviceAbstract *dev_abs, Command& cmd)
+DeviceManager::dispatch_dev_impl(KDeviceAbstract *dev_abs, Func&& func)
 {
     static_assert(dev0 < device_num, "");
     static_assert(dev0 >= 2, "");
-    return static_cast<KDevice<dev0>*>(dev_abs)->execute(cmd);
+    return func(static_cast<KDevice<dev0>*>(dev_abs));
 }
 
-template<device_id dev0, device_id... devs>
+template<device_id dev0, device_id... devs, typename Func>
 std::enable_if_t<0 < sizeof...(devs) && 2 <= dev0, int>
-DeviceManager::execute_dev_impl(KDeviceAbstract *dev_abs, Command& cmd)
+DeviceManager::dispatch_dev_impl(KDeviceAbstract *dev_abs, Func&& func)
 {
     static_assert(dev0 < device_num, "");
     static_assert(dev0 >= 2, "");
 
-    return dev_abs->kind == dev0 ? static_cast<KDevice<dev0>*>(dev_abs)->execute(cmd)
-                                 : execute_dev_impl<devs...>(dev_abs, cmd);
+    return dev_abs->kind == dev0 ? func(static_cast<KDevice<dev0>*>(dev_abs))
+                                 : dispatch_dev_impl<devs...>(dev_abs, std::forward<Func>(func));
 }
 
-template<device_id... devs>
-int DeviceManager::execute_dev(KDeviceAbstract *dev_abs, Command& cmd,
-                               std::index_sequence<devs...>)
+template<typename Func, device_id... devs>
+int DeviceManager::dispatch_dev(KDeviceAbstract *dev_abs, Func&& func,
+                                std::index_sequence<devs...>)
 {
     static_assert(sizeof...(devs) == device_num - 2, "");
-    return execute_dev_impl<devs...>(dev_abs, cmd);
+    return dispatch_dev_impl<devs...>(dev_abs, std::forward<Func>(func));
 }
 
 int DeviceManager::execute(Command& cmd)
 {
     assert(cmd.device < device_num);
 
-    if (cmd.device == 0) {
+    if (cmd.device == 0)
         return 0;
-    } else if (cmd.device == 1) {
-        return kserver->execute(cmd);
+
+    queue_depth.enter(cmd.device);
+    const auto start_ns = clock_ns();
+    int ret;
+
+    if (cmd.device == 1) {
+        ret = kserver->execute(cmd);
     } else {
         if (unlikely(! is_started[cmd.device - 2]))
             start(cmd.device, make_index_sequence_in_range<2, device_num>());
 
-        return execute_dev(device_list[cmd.device - 2].get(), cmd,
+        ret = dispatch_dev(device_list[cmd.device - 2].get(),
+                           [&](auto *device) { return device->execute(cmd); },
                            make_index_sequence_in_range<2, device_num>());
     }
+
+    ops_latency.record(cmd.device, cmd.operation, clock_ns() - start_ns);
+    queue_depth.leave(cmd.device);
+    return ret;
+}
+
+int DeviceManager::start_device(device_id dev)
+{
+    if (dev < 2 || dev >= device_num)
+        return -1;
+
+    if (unlikely(! is_started[dev - 2]))
+        start(dev, make_index_sequence_in_range<2, device_num>());
+
+    return is_started[dev - 2] ? 0 : -1;
+}
+
+int DeviceManager::poll(device_id dev, int op, SnapshotBuilder& builder, Snapshot& snapshot)
+{
+    if (start_device(dev) < 0)
+        return -1;
+
+    return dispatch_dev(device_list[dev - 2].get(),
+                        [&](auto *device) { return device->poll(op, builder, snapshot); },
+                        make_index_sequence_in_range<2, device_num>());
 }
 
 } // namespace kserver
@@ -14,6 +14,10 @@
 #endif
 
 #include "kdevice.hpp"
+#include "metrics.hpp"
+#include "response_cache.hpp"
+#include "single_flight.hpp"
+#include "streams.hpp"
 
 #include <devices_table.hpp>
 #include <devices.hpp>
@@ -60,6 +64,9 @@ class DeviceManager
     int init();
     int execute(Command &cmd);
 
+    /// Build the snapshot of the polled operation op (see polling.hpp)
+    int poll(device_id dev, int op, SnapshotBuilder& builder, Snapshot& snapshot);
+
     template<device_id dev>
     auto& get() {
         if (! std::get<dev - 2>(is_started))
@@ -67,6 +74,25 @@ class DeviceManager
         return dev_cont.get<dev>();
     }
 
+    /// Execution time of the operations
+    OperationsLatency ops_latency;
+
+    /// Commands pending on each device
+    DevicesQueueDepth queue_depth;
+
+    /// Responses of the operations annotated @cache
+    ResponseCache response_cache;
+
+    /// Calls in flight of the operations annotated @shared
+    SingleFlight flights;
+
+    /// Streams of the devices (destroyed after the devices)
+    StreamManager streams;
+
+    /// Start the device dev if needed.
+    /// Returns -1 if the device cannot be started.
+    int start_device(device_id dev);
+
   private:
     // Store devices (except KServer) as unique_ptr
     std::array<std::unique_ptr<KDeviceAbstract>, device_num - 2> device_list;
@@ -95,19 +121,19 @@ class DeviceManager
     std::enable_if_t<0 < sizeof...(devs) && 2 <= dev0, void>
     start_impl(device_id dev);
 
-    // Execute
+    // Call func(device) with the KDevice of dev_abs
 
-    template<device_id... devs>
-    int execute_dev(KDeviceAbstract *dev_abs, Command& cmd,
-                    std::index_sequence<devs...>);
+    template<typename Func, device_id... devs>
+    int dispatch_dev(KDeviceAbstract *dev_abs, Func&& func,
+                     std::index_sequence<devs...>);
 
-    template<device_id dev0, device_id... devs>
+    template<device_id dev0, device_id... devs, typename Func>
     std::enable_if_t<0 == sizeof...(devs) && 2 <= dev0, int>
-    execute_dev_impl(KDeviceAbstract *dev_abs, Command& cmd);
+    dispatch_dev_impl(KDeviceAbstract *dev_abs, Func&& func);
 
-    template<device_id dev0, device_id... devs>
+    template<device_id dev0, device_id... devs, typename Func>
     std::enable_if_t<0 < sizeof...(devs) && 2 <= dev0, int>
-    execute_dev_impl(KDeviceAbstract *dev_abs, Command& cmd);
+    dispatch_dev_impl(KDeviceAbstract *dev_abs, Func&& func);
 };
 
 } // namespace kserver
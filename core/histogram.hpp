@@ -0,0 +1,152 @@
+/// Log-bucketed histogram
+///
+/// HDR-style histogram: each power of two is split into
+/// 2^SUB_BUCKET_BITS linear sub-buckets, so that the relative
+/// error on a recorded value is bounded by 2^-SUB_BUCKET_BITS.
+///
+/// (c) Koheron
+
+#ifndef __HISTOGRAM_HPP__
+#define __HISTOGRAM_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+
+namespace kserver {
+
+namespace histogram {
+
+/// 8 sub-buckets per power of two (12.5 % resolution)
+constexpr uint32_t SUB_BUCKET_BITS = 3;
+constexpr uint64_t SUB_BUCKET_NUM = 1ULL << SUB_BUCKET_BITS;
+
+/// Values are clamped to 2^MAX_VALUE_BITS - 1 (about 18 minutes in ns)
+constexpr uint32_t MAX_VALUE_BITS = 40;
+
+constexpr size_t BUCKETS_NUM = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_NUM;
+
+inline size_t bucket_index(uint64_t value)
+{
+    constexpr uint64_t max_value = (1ULL << MAX_VALUE_BITS) - 1;
+
+    if (value > max_value)
+        value = max_value;
+
+    if (value < 2 * SUB_BUCKET_NUM)
+        return value;
+
+    const uint32_t msb = 63 - __builtin_clzll(value);
+    const uint32_t shift = msb - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS)
+           + ((value >> shift) & (SUB_BUCKET_NUM - 1));
+}
+
+/// Smallest value recorded in a bucket
+constexpr uint64_t bucket_lower_bound(size_t idx)
+{
+    return (idx < 2 * SUB_BUCKET_NUM)
+           ? idx
+           : (SUB_BUCKET_NUM + (idx & (SUB_BUCKET_NUM - 1)))
+                << ((idx >> SUB_BUCKET_BITS) - 1);
+}
+
+/// Highest value recorded in a bucket
+constexpr uint64_t bucket_upper_bound(size_t idx)
+{
+    return bucket_lower_bound(idx + 1) - 1;
+}
+
+} // namespace histogram
+
+/// Histogram with atomic counters.
+///
+/// Concurrent writers are allowed but should be rare:
+/// use one histogram per thread (shard) and merge on read.
+struct AtomicLogHistogram
+{
+    AtomicLogHistogram() {
+        for (auto& c : counts)
+            c.store(0, std::memory_order_relaxed);
+
+        sum.store(0, std::memory_order_relaxed);
+    }
+
+    void record(uint64_t value) {
+        counts[histogram::bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, histogram::BUCKETS_NUM> counts;
+    std::atomic<uint64_t> sum;
+};
+
+/// Histogram used to merge the shards and compute the quantiles
+struct LogHistogram
+{
+    LogHistogram() {
+        reset();
+    }
+
+    void reset() {
+        counts.fill(0);
+        count = 0;
+        sum = 0;
+    }
+
+    void record(uint64_t value) {
+        counts[histogram::bucket_index(value)]++;
+        count++;
+        sum += value;
+    }
+
+    void merge(const AtomicLogHistogram& hist) {
+        for (size_t i = 0; i < histogram::BUCKETS_NUM; i++) {
+            const auto c = hist.counts[i].load(std::memory_order_relaxed);
+            counts[i] += c;
+            count += c;
+        }
+
+        sum += hist.sum.load(std::memory_order_relaxed);
+    }
+
+    void merge(const LogHistogram& hist) {
+        for (size_t i = 0; i < histogram::BUCKETS_NUM; i++)
+            counts[i] += hist.counts[i];
+
+        count += hist.count;
+        sum += hist.sum;
+    }
+
+    /// Value below which a fraction q of the recorded values fall.
+    /// Returns the upper bound of the bucket containing the quantile.
+    uint64_t quantile(double q) const {
+        if (count == 0)
+            return 0;
+
+        uint64_t rank = static_cast<uint64_t>(q * count);
+
+        if (rank >= count)
+            rank = count - 1;
+
+        uint64_t cumul = 0;
+
+        for (size_t i = 0; i < histogram::BUCKETS_NUM; i++) {
+            cumul += counts[i];
+
+            if (cumul > rank)
+                return histogram::bucket_upper_bound(i);
+        }
+
+        return histogram::bucket_upper_bound(histogram::BUCKETS_NUM - 1);
+    }
+
+    std::array<uint64_t, histogram::BUCKETS_NUM> counts;
+    uint64_t count;
+    uint64_t sum;
+};
+
+} // namespace kserver
+
+#endif // __HISTOGRAM_HPP__
@@ -14,6 +14,9 @@ namespace kserver {
 
 class KServer;
 struct Command;
+class SnapshotBuilder;
+struct Snapshot;
+template<int sock_type> class Session;
 
 class KDeviceAbstract {
   public:
@@ -10,6 +10,7 @@
 #include "kserver_session.hpp"
 #include "session_manager.hpp"
 #include "syslog.tpp"
+#include "tracing.hpp"
 
 extern "C" {
   #include <sys/un.h>
@@ -31,6 +32,7 @@ KServer::KServer(std::shared_ptr<kserver::KServerConfig> config_)
 #endif
   dev_manager(this),
   session_manager(*this, dev_manager),
+  polling(this),
   syslog(config_, sig_handler, session_manager),
   start_time(0)
 {
@@ -43,6 +45,13 @@ KServer::KServer(std::shared_ptr<kserver::KServerConfig> config_)
     exit_comm.store(false);
     exit_all.store(false);
 
+#if KSERVER_HAS_TRACING
+    trace::enabled.store(config->tracing);
+#else
+    if (config->tracing)
+        syslog.print<ERROR>("Tracing not supported\n");
+#endif
+
 #if KSERVER_HAS_TCP
     if (tcp_listener.init() < 0)
         exit(EXIT_FAILURE);
@@ -206,11 +215,36 @@ exit_notification_socket:
 }
 #endif
 
+int64_t KServer::dump_trace()
+{
+#if KSERVER_HAS_TRACING
+    const auto events_num = trace::dump(config->trace_file);
+
+    if (events_num < 0) {
+        syslog.print<ERROR>("Cannot write trace file %s\n", config->trace_file);
+        return -1;
+    }
+
+    syslog.print<INFO>("%li trace events written to %s\n",
+                       static_cast<long>(events_num), config->trace_file);
+    return events_num;
+#else
+    syslog.print<ERROR>("Tracing not supported\n");
+    return -1;
+#endif
+}
+
 int KServer::run()
 {
     bool ready_notified = false;
     start_time = std::time(nullptr);
 
+    if (dev_manager.streams.start() < 0)
+        return -1;
+
+    if (polling.start() < 0)
+        return -1;
+
     if (start_listeners_workers() < 0)
         return -1;
 
@@ -227,12 +261,17 @@ int KServer::run()
         if (sig_handler.interrupt() || exit_all) {
             syslog.print<INFO>("Interrupt received, killing Koheron server ...\n");
 
+            polling.stop();
+            dev_manager.streams.stop();
             session_manager.delete_all();
             close_listeners();
             syslog.close();
             return 0;
         }
 
+        if (sig_handler.dump_trace_requested())
+            dump_trace();
+
         std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
 
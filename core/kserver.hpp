@@ -21,9 +21,11 @@
 #include <utility>
 
 #include "devices_manager.hpp"
+#include "counters.hpp"
 #include "syslog.hpp"
 #include "signal_handler.hpp"
 #include "session_manager.hpp"
+#include "polling.hpp"
 
 namespace kserver {
 
@@ -32,12 +34,66 @@ template<int sock_type> class Session;
 ////////////////////////////////////////////////////////////////////////////
 /////// ListeningChannel
 
+/// Statistics of the closed sessions of a listener.
+///
+/// The statistics of the running sessions are added
+/// when the stats are read (see GET_STATS).
 template<int sock_type>
 struct ListenerStats
 {
-    int opened_sessions_num = 0; ///< Number of currently opened sessions
-    int total_sessions_num = 0;  ///< Total number of sessions
-    int total_requests_num = 0;  ///< Total number of requests
+    ShardedCounter total_sessions_num;  ///< Total number of sessions
+    ShardedCounter closed_sessions_num; ///< Number of closed sessions
+    ShardedCounter requests_num;        ///< Number of requests
+    ShardedCounter errors_num;          ///< Number of requests errors
+    ShardedCounter bytes_rcvd;          ///< Number of bytes received
+    ShardedCounter bytes_sent;          ///< Number of bytes sent
+    ShardedCounter recv_calls;          ///< Number of read system calls
+    ShardedCounter send_calls;          ///< Number of write system calls
+    ShardedCounter deflate_in;          ///< Number of bytes compressed
+    ShardedCounter deflate_out;         ///< Number of bytes after compression
+    ShardedCounter deflate_ns;          ///< Time spent compressing (ns)
+    ShardedCounter inflate_in;          ///< Number of bytes decompressed
+    ShardedCounter inflate_out;         ///< Number of bytes after decompression
+    ShardedCounter inflate_ns;          ///< Time spent decompressing (ns)
+
+    /// Number of currently opened sessions
+    uint64_t opened_sessions_num() const {
+        return total_sessions_num.load() - closed_sessions_num.load();
+    }
+
+    /// Statistics of the closed sessions
+    StatsSnapshot snapshot() const {
+        StatsSnapshot snap;
+        snap.requests_num = requests_num.load();
+        snap.errors_num = errors_num.load();
+        snap.bytes_rcvd = bytes_rcvd.load();
+        snap.bytes_sent = bytes_sent.load();
+        snap.recv_calls = recv_calls.load();
+        snap.send_calls = send_calls.load();
+        snap.deflate_in = deflate_in.load();
+        snap.deflate_out = deflate_out.load();
+        snap.deflate_ns = deflate_ns.load();
+        snap.inflate_in = inflate_in.load();
+        snap.inflate_out = inflate_out.load();
+        snap.inflate_ns = inflate_ns.load();
+        return snap;
+    }
+
+    /// Add the statistics of a session on closing
+    void add_session(const SessionStats& sess_stats) {
+        requests_num.add(sess_stats.requests_num.load());
+        errors_num.add(sess_stats.errors_num.load());
+        bytes_rcvd.add(sess_stats.bytes_rcvd.load());
+        bytes_sent.add(sess_stats.bytes_sent.load());
+        recv_calls.add(sess_stats.recv_calls.load());
+        send_calls.add(sess_stats.send_calls.load());
+        deflate_in.add(sess_stats.deflate_in.load());
+        deflate_out.add(sess_stats.deflate_out.load());
+        deflate_ns.add(sess_stats.deflate_ns.load());
+        inflate_in.add(sess_stats.inflate_in.load());
+        inflate_out.add(sess_stats.inflate_out.load());
+        inflate_ns.add(sess_stats.inflate_ns.load());
+    }
 };
 
 /// Implementation in listening_channel.cpp
@@ -69,6 +125,9 @@ class ListeningChannel
 
     int open_communication();
 
+    /// Statistics of the closed and running sessions
+    StatsSnapshot get_stats();
+
     /// Listening socket ID
     int listen_fd;
 
@@ -123,6 +182,14 @@ class KServer
         GET_RUNNING_SESSIONS = 4,   ///< Send the running sessions
         SUBSCRIBE_PUBSUB = 5,       ///< Subscribe to a broadcast channel
         PUBSUB_PING = 6,            ///< Emit a ping to server broadcast subscribers
+        GET_OPS_LATENCY = 7,        ///< Send the latency quantiles of the operations
+        SET_TRACING = 8,            ///< Enable/Disable the commands tracing
+        DUMP_TRACE = 9,             ///< Write the commands traces to the trace file
+        SET_BYTE_ORDER = 10,        ///< Negotiate the byte order of the session scalars
+        SET_RESPONSE_CODECS = 11,   ///< Negotiate the compression of the session responses
+        SET_REDUCTION = 12,         ///< Attach a reduction stage to an operation of the session
+        OPEN_STREAM = 13,           ///< Receive the blocks of a device stream
+        CLOSE_STREAM = 14,          ///< Stop receiving the blocks of a device stream
         kserver_op_num
     };
 
@@ -150,6 +217,9 @@ class KServer
     DeviceManager dev_manager;
     SessionManager session_manager;
 
+    /// Operations polled by the server (see polling.hpp)
+    PollingScheduler polling;
+
     // Logs
     SysLog syslog;
     std::time_t start_time;
@@ -161,6 +231,13 @@ class KServer
     int execute(Command& cmd);
     template<int op> int execute_op(Command& cmd);
 
+    /// Metrics in the Prometheus text format (see prometheus.cpp)
+    std::string get_metrics();
+
+    /// Write the commands traces to config->trace_file.
+    /// Returns the number of events written.
+    int64_t dump_trace();
+
   private:
     // Internal functions
     int start_listeners_workers();
@@ -5,8 +5,11 @@
 #include "kserver.hpp"
 
 #include <ctime>
+#include <cstring>
+#include <cinttypes>
 
 #include "syslog.tpp"
+#include "tracing.hpp"
 #include <devices_json.hpp>
 
 namespace kserver {
@@ -22,27 +25,36 @@ namespace kserver {
 /////////////////////////////////////
 // GET_VERSION
 // Send the server commit version
+// (cached, see response_cache.hpp)
 
 #define xstr(s) str(s)
 #define str(s) #s
 
 KSERVER_EXECUTE_OP(GET_VERSION)
 {
-    return GET_SESSION.send<1, KServer::GET_VERSION>(xstr(KOHERON_SERVER_VERSION));
+    return GET_SESSION.send_cached<1, KServer::GET_VERSION>(
+        dev_manager.response_cache, ResponseCache::make_key(), 0,
+        [](auto&& sender) { return sender(xstr(KOHERON_SERVER_VERSION)); });
 }
 
 /////////////////////////////////////
 // GET_CMDS
 // Send the commands numbers
+// (cached: the devices JSON is only built once per byte order)
 
 KSERVER_EXECUTE_OP(GET_CMDS)
 {
-    return GET_SESSION.send<1, KServer::GET_CMDS>(build_devices_json());
+    return GET_SESSION.send_cached<1, KServer::GET_CMDS>(
+        dev_manager.response_cache, ResponseCache::make_key(), 0,
+        [](auto&& sender) { return sender(build_devices_json()); });
 }
 
 /////////////////////////////////////
 // GET_STATS
 // Get listeners statistics
+//
+// For each listener:
+// name:opened_sessions:total_sessions:requests:errors:bytes_rcvd:bytes_sent:recv_calls:send_calls
 
 template<int sock_type>
 int send_listener_stats(Command& cmd, KServer *kserver,
@@ -51,12 +63,17 @@ int send_listener_stats(Command& cmd, KServer *kserver,
     char send_str[KS_DEV_WRITE_STR_LEN];
     unsigned int bytes_send = 0;
 
+    const auto stats = listener->get_stats();
+
     int ret = snprintf(send_str, KS_DEV_WRITE_STR_LEN,
-                    "%s:%d:%d:%d\n", 
+                    "%s:%" PRIu64 ":%" PRIu64 ":%" PRIu64 ":%" PRIu64
+                    ":%" PRIu64 ":%" PRIu64 ":%" PRIu64 ":%" PRIu64 "\n",
                     listen_channel_desc[sock_type].c_str(),
-                    listener->stats.opened_sessions_num,
-                    listener->stats.total_sessions_num,
-                    listener->stats.total_requests_num);
+                    listener->stats.opened_sessions_num(),
+                    listener->stats.total_sessions_num.load(),
+                    stats.requests_num, stats.errors_num,
+                    stats.bytes_rcvd, stats.bytes_sent,
+                    stats.recv_calls, stats.send_calls);
 
     if (ret < 0) {
         kserver->syslog.print<ERROR>(
@@ -142,6 +159,13 @@ KSERVER_EXECUTE_OP(GET_DEV_STATUS) {return 0;}
 /////////////////////////////////////
 // GET_RUNNING_SESSIONS
 // Send the running sessions
+//
+// For each session:
+// id:type:ip:port:requests:errors:uptime:bytes_rcvd:bytes_sent:recv_calls:send_calls:
+// deflate_in:deflate_out:deflate_ns:inflate_in:inflate_out:inflate_ns
+//
+// The deflate and inflate fields give the WebSocket compression
+// ratio (bytes in/out) and CPU time (ns) of the session.
 
 #define SET_SESSION_PARAMS(sock_type)                                             \
     case sock_type:                                                               \
@@ -151,6 +175,7 @@ KSERVER_EXECUTE_OP(GET_DEV_STATUS) {return 0;}
       req_num = static_cast<Session<sock_type>*>(&session)->request_num();        \
       err_num = static_cast<Session<sock_type>*>(&session)->error_num();          \
       start_time = static_cast<Session<sock_type>*>(&session)->get_start_time();  \
+      stats = &static_cast<Session<sock_type>*>(&session)->get_stats();           \
       break;
 
 KSERVER_EXECUTE_OP(GET_RUNNING_SESSIONS)
@@ -168,6 +193,7 @@ KSERVER_EXECUTE_OP(GET_RUNNING_SESSIONS)
         const char *ip;
         uint32_t port, req_num, err_num;
         std::time_t start_time;
+        const SessionStats *stats = nullptr;
 
         switch (session.kind) {
 #if KSERVER_HAS_TCP
@@ -183,10 +209,18 @@ KSERVER_EXECUTE_OP(GET_RUNNING_SESSIONS)
         }
 
         int ret = snprintf(send_str, KS_DEV_WRITE_STR_LEN,
-                           "%u:%s:%s:%u:%u:%u:%li\n",
+                           "%u:%s:%s:%u:%u:%u:%li:%" PRIu64 ":%" PRIu64
+                           ":%" PRIu64 ":%" PRIu64
+                           ":%" PRIu64 ":%" PRIu64 ":%" PRIu64
+                           ":%" PRIu64 ":%" PRIu64 ":%" PRIu64 "\n",
                            id, sock_type_name,
                            ip, port, req_num, err_num,
-                           std::time(nullptr) - start_time);
+                           std::time(nullptr) - start_time,
+                           stats->bytes_rcvd.load(), stats->bytes_sent.load(),
+                           stats->recv_calls.load(), stats->send_calls.load(),
+                           stats->deflate_in.load(), stats->deflate_out.load(),
+                           stats->deflate_ns.load(), stats->inflate_in.load(),
+                           stats->inflate_out.load(), stats->inflate_ns.load());
 
         if (ret < 0) {
             syslog.print<ERROR>(
@@ -244,19 +278,244 @@ KSERVER_EXECUTE_OP(PUBSUB_PING)
     return 0;
 }
 
-////////////////////////////////////////////////
+/////////////////////////////////////
+// GET_OPS_LATENCY
+// Send the latency quantiles of the executed operations
+//
+// The names of the operations ("Device.operation", one per line)
+// are followed by a table with one row of uint64_t per operation:
+// | (dev_id << 16) + op_id | count | p50 | p90 | p99 | p999 |
+// Latencies are in nanoseconds.
+
+KSERVER_EXECUTE_OP(GET_OPS_LATENCY)
+{
+    static_assert(operations_num[1] == KServer::kserver_op_num,
+                  "KServer operations do not match devgen KSERVER_OPERATIONS");
+
+    std::string names;
+    std::vector<uint64_t> table;
+    LogHistogram hist;
+
+    for (device_id dev = 1; dev < device_num; dev++) {
+        for (int32_t op = 0; op < static_cast<int32_t>(operations_num[dev]); op++) {
+            dev_manager.ops_latency.merge(dev, op, hist);
+
+            if (hist.count == 0)
+                continue;
+
+            names += devices_names[dev].data();
+            names += '.';
+            names += operations_names[operations_offsets[dev] + op].data();
+            names += '\n';
+
+            table.insert(table.end(), {
+                (static_cast<uint64_t>(dev) << 16) + op, hist.count,
+                hist.quantile(0.5), hist.quantile(0.9),
+                hist.quantile(0.99), hist.quantile(0.999)
+            });
+        }
+    }
 
-int KServer::execute(Command& cmd)
+    return GET_SESSION.send<1, KServer::GET_OPS_LATENCY>(names, table);
+}
+
+/////////////////////////////////////
+// SET_TRACING
+// Enable/Disable the commands tracing
+
+KSERVER_EXECUTE_OP(SET_TRACING)
 {
-#if KSERVER_HAS_THREADS
-    std::lock_guard<std::mutex> lock(static_cast<KServer*>(this)->ks_mutex);
+    const auto tup = cmd.sess->deserialize<bool>(cmd);
+
+    if (std::get<0>(tup) < 0) {
+        syslog.print<ERROR>("Set tracing: cannot read argument\n");
+        return -1;
+    }
+
+#if KSERVER_HAS_TRACING
+    trace::enabled.store(std::get<1>(tup));
+    syslog.print<INFO>("Tracing %s\n", std::get<1>(tup) ? "enabled" : "disabled");
+    return 0;
+#else
+    syslog.print<ERROR>("Tracing not supported\n");
+    return -1;
 #endif
+}
+
+/////////////////////////////////////
+// DUMP_TRACE
+// Write the commands traces to the trace file
+// and send the number of events written
+
+KSERVER_EXECUTE_OP(DUMP_TRACE)
+{
+    const auto events_num = dump_trace();
 
+    if (events_num < 0)
+        return -1;
+
+    return GET_SESSION.send<1, KServer::DUMP_TRACE>(static_cast<uint64_t>(events_num));
+}
+
+/////////////////////////////////////
+// SET_BYTE_ORDER
+// Negotiate the byte order of the scalars of the session
+//
+// The client sends the 32 bits integer 0x01020304 as raw bytes in its
+// own byte order. If it matches the server byte order, the scalars
+// (including the length prefixes of vectors and strings) are then
+// exchanged in host byte order, otherwise in network byte order.
+// Send true if the session uses the host byte order.
+
+KSERVER_EXECUTE_OP(SET_BYTE_ORDER)
+{
+    std::array<uint8_t, 4> byte_order_mark;
+
+    if (cmd.sess->recv(byte_order_mark, cmd) < 0) {
+        syslog.print<ERROR>("Set byte order: cannot read byte order mark\n");
+        return -1;
+    }
+
+    uint32_t mark;
+    std::memcpy(&mark, byte_order_mark.data(), sizeof(mark));
+    cmd.sess->byte_order = (mark == 0x01020304) ? ByteOrder::NATIVE : ByteOrder::NETWORK;
+
+    syslog.print<INFO>("Session id #%u uses %s byte order\n", cmd.sess_id,
+                       cmd.sess->byte_order == ByteOrder::NATIVE ? "host" : "network");
+    return GET_SESSION.send<1, KServer::SET_BYTE_ORDER>(cmd.sess->byte_order == ByteOrder::NATIVE);
+}
+
+/////////////////////////////////////
+// SET_RESPONSE_CODECS
+// Negotiate the compression of the responses of the session
+//
+// The client sends the mask of the codecs it can decode
+// (bit n for codecs::Codec n, see codecs.hpp) and the minimum
+// size in bytes of the containers to encode.
+// Send the mask of the codecs enabled (0 if none).
+
+KSERVER_EXECUTE_OP(SET_RESPONSE_CODECS)
+{
+    const auto tup = cmd.sess->deserialize<uint32_t, uint32_t>(cmd);
+
+    if (std::get<0>(tup) < 0) {
+        syslog.print<ERROR>("Set response codecs: cannot read arguments\n");
+        return -1;
+    }
+
+    const uint32_t codecs_mask = std::get<1>(tup) & codecs::supported_mask;
+    cmd.sess->set_response_codecs(codecs_mask, std::get<2>(tup));
+
+    syslog.print<INFO>("Session id #%u response codecs mask 0x%x\n", cmd.sess_id, codecs_mask);
+    return GET_SESSION.send<1, KServer::SET_RESPONSE_CODECS>(codecs_mask);
+}
+
+/////////////////////////////////////
+// SET_REDUCTION
+// Attach a reduction stage to an operation of the session
+//
+// The responses of the operation dev_id/op_id, if it returns a numeric
+// vector or array, are then reduced to the given number of points
+// (see reductions.hpp). The reduction NONE detaches the stage.
+// Send true if the stage is set.
+
+KSERVER_EXECUTE_OP(SET_REDUCTION)
+{
+    const auto tup = cmd.sess->deserialize<uint16_t, uint16_t, uint32_t, uint32_t>(cmd);
+
+    if (std::get<0>(tup) < 0) {
+        syslog.print<ERROR>("Set reduction: cannot read arguments\n");
+        return -1;
+    }
+
+    const uint32_t op_key = (std::get<1>(tup) << 16) | std::get<2>(tup);
+    const uint32_t reduction = std::get<3>(tup);
+    const uint32_t points = std::get<4>(tup);
+    bool is_set = true;
+
+    if (reduction == reductions::NONE) {
+        cmd.sess->reduction_stages.erase(op_key);
+    } else if (reduction < reductions::reductions_num
+               && points > 0 && points <= KSERVER_REDUCTION_MAX_POINTS) {
+        cmd.sess->reduction_stages[op_key] = {static_cast<reductions::Reduction>(reduction), points};
+    } else {
+        syslog.print<WARNING>("Set reduction: invalid reduction %u with %u points\n",
+                              reduction, points);
+        is_set = false;
+    }
+
+    return GET_SESSION.send<1, KServer::SET_REDUCTION>(is_set);
+}
+
+/////////////////////////////////////
+// OPEN_STREAM
+// Receive the blocks of the stream index of the device dev_id
+// (see streams.hpp). The device is started if needed.
+// Send the id of the stream in the messages, or -1 if not found.
+
+KSERVER_EXECUTE_OP(OPEN_STREAM)
+{
+    const auto tup = cmd.sess->deserialize<uint16_t, uint16_t>(cmd);
+
+    if (std::get<0>(tup) < 0) {
+        syslog.print<ERROR>("Open stream: cannot read arguments\n");
+        return -1;
+    }
+
+    const uint16_t dev = std::get<1>(tup);
+    const uint16_t index = std::get<2>(tup);
+    int32_t stream_id = -1;
+
+    if (dev_manager.start_device(dev) == 0) {
+        if (const auto stream = dev_manager.streams.find(dev, index))
+            if (dev_manager.streams.open(stream->id, cmd.sess_id) == 0)
+                stream_id = stream->id;
+    }
+
+    if (stream_id < 0)
+        syslog.print<WARNING>("Open stream: no stream %u on device %u\n", index, dev);
+
+    return GET_SESSION.send<1, KServer::OPEN_STREAM>(stream_id);
+}
+
+/////////////////////////////////////
+// CLOSE_STREAM
+// Stop receiving the blocks of a stream
+
+KSERVER_EXECUTE_OP(CLOSE_STREAM)
+{
+    const auto tup = cmd.sess->deserialize<uint16_t>(cmd);
+
+    if (std::get<0>(tup) < 0) {
+        syslog.print<ERROR>("Close stream: cannot read stream id\n");
+        return -1;
+    }
+
+    dev_manager.streams.close(std::get<1>(tup), cmd.sess_id);
+    return 0;
+}
+
+////////////////////////////////////////////////
+
+int KServer::execute(Command& cmd)
+{
+    // Cached operations do not take the lock
     switch (cmd.operation) {
       case KServer::GET_VERSION:
         return execute_op<KServer::GET_VERSION>(cmd);
       case KServer::GET_CMDS:
         return execute_op<KServer::GET_CMDS>(cmd);
+      default:
+        break;
+    }
+
+#if KSERVER_HAS_THREADS
+    KSERVER_TRACE_BEGIN(lock);
+    std::lock_guard<std::mutex> lock(static_cast<KServer*>(this)->ks_mutex);
+    KSERVER_TRACE_END(lock, LOCK_WAIT, cmd);
+#endif
+
+    switch (cmd.operation) {
       case KServer::GET_STATS:
         return execute_op<KServer::GET_STATS>(cmd);
       case KServer::GET_DEV_STATUS:
@@ -267,6 +526,22 @@ int KServer::execute(Command& cmd)
         return execute_op<KServer::SUBSCRIBE_PUBSUB>(cmd);
       case KServer::PUBSUB_PING:
         return execute_op<KServer::PUBSUB_PING>(cmd);
+      case KServer::GET_OPS_LATENCY:
+        return execute_op<KServer::GET_OPS_LATENCY>(cmd);
+      case KServer::SET_TRACING:
+        return execute_op<KServer::SET_TRACING>(cmd);
+      case KServer::DUMP_TRACE:
+        return execute_op<KServer::DUMP_TRACE>(cmd);
+      case KServer::SET_BYTE_ORDER:
+        return execute_op<KServer::SET_BYTE_ORDER>(cmd);
+      case KServer::SET_RESPONSE_CODECS:
+        return execute_op<KServer::SET_RESPONSE_CODECS>(cmd);
+      case KServer::SET_REDUCTION:
+        return execute_op<KServer::SET_REDUCTION>(cmd);
+      case KServer::OPEN_STREAM:
+        return execute_op<KServer::OPEN_STREAM>(cmd);
+      case KServer::CLOSE_STREAM:
+        return execute_op<KServer::CLOSE_STREAM>(cmd);
       case KServer::kserver_op_num:
       default:
         syslog.print<ERROR>("KServer::execute unknown operation\n");
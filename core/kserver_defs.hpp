@@ -22,6 +22,9 @@ namespace kserver {
 /// Enable Websocket connections
 #define KSERVER_HAS_WEBSOCKET 1
 
+/// Enable the permessage-deflate Websocket extension (requires zlib)
+#define KSERVER_HAS_WEBSOCKET_DEFLATE 1
+
 /// Enable Unix sockets
 #define KSERVER_HAS_UNIX_SOCKET 1
 
@@ -37,6 +40,15 @@ namespace kserver {
 /// Default webSocket port
 #define WEBSOCKET_DFLT_PORT 8080
 
+/// Default maximum size of a message received by a webSocket session (bytes)
+#define WEBSOCKET_DFLT_MAX_MESSAGE_SIZE 64 * 1024 * 1024
+
+/// Default size under which webSocket messages are not compressed (bytes)
+#define WEBSOCKET_DFLT_DEFLATE_THRESHOLD 1024
+
+/// zlib compression level of the webSocket messages
+#define WEBSOCKET_DEFLATE_LEVEL 1
+
 /// Pending connections queue size
 #define KSERVER_BACKLOG 10
 
@@ -58,6 +70,38 @@ namespace kserver {
 /// and Websockets connections are required.
 #define KSERVER_HAS_THREADS 1
 
+// ------------------------------------------
+// Metrics
+// ------------------------------------------
+
+/// Number of per-thread shards of the metrics counters
+#define KSERVER_METRICS_SHARDS 4
+
+/// Cache line size used to pad the shards
+#define KSERVER_CACHE_LINE_SIZE 64
+
+// ------------------------------------------
+// Tracing
+// ------------------------------------------
+
+/// Enable command tracing (see tracing.hpp)
+///
+/// Tracing is then switched on at runtime from the
+/// configuration file or with KServer::SET_TRACING.
+#define KSERVER_HAS_TRACING 1
+
+/// Number of trace events stored per thread
+#define KSERVER_TRACE_EVENTS_NUM 4096
+
+/// Maximum number of threads traced simultaneously
+#define KSERVER_TRACE_MAX_THREADS 64
+
+/// Default trace file
+#define DFLT_TRACE_FILE "/tmp/kserver_trace.json"
+
+/// Maximum length of the trace file path
+#define TRACE_FILE_PATH_LEN 256
+
 // ------------------------------------------
 // Logs
 // ------------------------------------------
@@ -95,8 +139,36 @@ constexpr int64_t CMD_PAYLOAD_BUFFER_LEN = 16384 * 8;
 /// Websocket receive buffer size
 #define WEBSOCK_READ_STR_LEN KSERVER_RECV_DATA_BUFF_LEN
 
-/// Websocket send buffer size (bytes)
-#define WEBSOCK_SEND_BUF_LEN 16384 * 2 * 4
+/// Buffer length for the Websocket handshake response
+#define WEBSOCK_HANDSHAKE_RESPONSE_LEN 512
+
+/// Containers of at least this size (bytes) are sent from
+/// their own memory instead of being copied to the send buffer
+#define KSERVER_STREAM_THRESHOLD 65536
+
+/// Minimum size (bytes) of the containers encoded
+/// by the response codecs (KServer::SET_RESPONSE_CODECS)
+#define KSERVER_CODEC_MIN_THRESHOLD 256
+
+/// Maximum number of points of the reduction stages (KServer::SET_REDUCTION)
+#define KSERVER_REDUCTION_MAX_POINTS 1048576
+
+/// Maximum number of cached responses per operation (see response_cache.hpp)
+#define KSERVER_RESPONSE_CACHE_MAX_ENTRIES 16
+
+/// Responses larger than this size (bytes) are not cached
+#define KSERVER_RESPONSE_CACHE_MAX_FRAME_LEN 1048576
+
+/// Maximum number of streams of the devices (see streams.hpp)
+#define KSERVER_MAX_STREAMS 16
+
+/// Maximum wait (ms) of a message pushed to a session (snapshot, stream block)
+/// for the session to finish writing a response. The message is then dropped.
+#define KSERVER_PUSH_LOCK_TIMEOUT_MS 5
+
+/// Maximum time (ms) to complete a pushed message partially written
+/// to a slow client. The client is then disconnected.
+#define KSERVER_PUSH_TIMEOUT_MS 1000
 
 /// Maximum length of the Unix socket file path 
 ///
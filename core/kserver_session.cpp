@@ -55,6 +55,7 @@ int Session<TCP>::rcv_n_bytes(char *buffer, uint64_t n_bytes)
 
     while (bytes_read < n_bytes) {
         bytes_rcv = read(comm_fd, buffer + bytes_read, n_bytes - bytes_read);
+        stats.recv_calls.add();
 
         if (bytes_rcv == 0) {
             session_manager.kserver.syslog.print<INFO>(
@@ -71,6 +72,8 @@ int Session<TCP>::rcv_n_bytes(char *buffer, uint64_t n_bytes)
         bytes_read += bytes_rcv;
     }
 
+    stats.bytes_rcvd.add(bytes_read);
+
     assert(bytes_read == n_bytes);
     session_manager.kserver.syslog.print<DEBUG>("[R@%u] [%u bytes]\n",
                                                         id, bytes_read);
@@ -96,6 +99,16 @@ int Session<WEBSOCK>::init_socket()
         return -1;
     }
 
+    if (websock.is_metrics_request()) {
+        if (websock.send_metrics(session_manager.kserver.get_metrics()) < 0) {
+            session_manager.kserver.syslog.print<ERROR>(
+                                  "WebSocket: Cannot send metrics\n");
+            return -1;
+        }
+
+        return 1;
+    }
+
     return 0;
 }
 
@@ -116,12 +129,6 @@ int Session<WEBSOCK>::read_command(Command& cmd)
     if (websock.is_closed())
         return 0;
 
-    if (websock.payload_size() < Command::HEADER_SIZE) {
-        session_manager.kserver.syslog.print<ERROR>(
-            "WebSocket: Command too small\n");
-        return -1;
-    }
-
     const auto header_tuple = cmd.header.deserialize<HEADER_TYPE_LIST>();
     cmd.sess_id = id;
     cmd.sess = this;
@@ -135,6 +142,18 @@ int Session<WEBSOCK>::read_command(Command& cmd)
     return Command::HEADER_SIZE;
 }
 
+template<>
+int Session<WEBSOCK>::rcv_n_bytes(char *buffer, uint64_t n_bytes)
+{
+    const int bytes_read = websock.read_payload(buffer, n_bytes);
+
+    if (bytes_read > 0)
+        session_manager.kserver.syslog.print<DEBUG>("[R@%u] [%u bytes]\n",
+                                                    id, bytes_read);
+
+    return bytes_read;
+}
+
 #endif
 
 } // namespace kserver
@@ -10,11 +10,28 @@
 #include <memory>
 #include <unistd.h>
 #include <type_traits>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <unordered_map>
+#include <atomic>
+#if KSERVER_HAS_THREADS
+#include <mutex>
+#include <chrono>
+#endif
 
 #include "commands.hpp"
 #include "peer_info.hpp"
 #include "serializer_deserializer.hpp"
 #include "socket_interface_defs.hpp"
+#include "counters.hpp"
+#include "tracing.hpp"
+#include "writev.hpp"
+#include "codecs.hpp"
+#include "reductions.hpp"
+#include "response_cache.hpp"
+#include "single_flight.hpp"
+#include "polling.hpp"
 #include "kserver.hpp"
 
 #if KSERVER_HAS_WEBSOCKET
@@ -29,13 +46,61 @@ class SessionAbstract
 {
   public:
     SessionAbstract(int sock_type_)
-    : kind(sock_type_) {}
+    : kind(sock_type_)
+    , byte_order(ByteOrder::NETWORK)
+    , response_codecs(0)
+    {
+        refs_num.store(0);
+    }
 
     template<typename... Tp> std::tuple<int, Tp...> deserialize(Command& cmd);
     template<typename Tp> int recv(Tp& container, Command& cmd);
     template<uint16_t class_id, uint16_t func_id, typename... Args> int send(Args&&... args);
+    template<uint16_t class_id, uint16_t func_id, typename Call>
+    int send_cached(ResponseCache& cache, std::string&& key, uint64_t ttl_ns, Call&& call);
+    template<uint16_t class_id, uint16_t func_id, typename Call>
+    int send_shared(SingleFlight& flights, std::string&& key, Call&& call);
+    template<uint16_t class_id, uint16_t func_id, typename Call>
+    int send_polled(SnapshotBuffer& snapshots, Call&& call);
+
+    /// Push a snapshot (PubSub::POLLING_CHANNEL).
+    /// Not encoded with the response codecs, nor reduced.
+    /// Returns -1 if the snapshot is dropped (see push_iovecs).
+    int send_snapshot(const Snapshot& snapshot);
+
+    /// Push a block of a stream (PubSub::STREAMS_CHANNEL, see streams.hpp)
+    int send_stream_block(uint16_t stream_id, uint64_t sequence, uint64_t dropped,
+                          const unsigned char *data, uint32_t len);
+
+    /// Encode the containers of at least threshold bytes
+    /// of the responses with the codecs of the mask
+    void set_response_codecs(uint32_t codecs_mask, uint32_t threshold);
+
+    /// Call func with the session cast to its type (Session<TCP>& or Session<WEBSOCK>&).
+    /// The session kind is switched once: the calls of func on the session are
+    /// resolved at compile time (see the execute of the generated devices).
+    template<typename Func> int dispatch(Func&& func);
 
     int kind;
+
+    /// Byte order of the scalars (KServer::SET_BYTE_ORDER).
+    /// Atomic: also read by the threads pushing messages.
+    std::atomic<ByteOrder> byte_order;
+
+    uint32_t response_codecs; ///< Mask of the response codecs (KServer::SET_RESPONSE_CODECS)
+
+    /// Reduction stages per operation (KServer::SET_REDUCTION)
+    std::unordered_map<uint32_t, reductions::Stage> reduction_stages;
+
+    /// Number of threads referencing the session to push messages
+    /// (see SessionRefs in session_manager.hpp)
+    std::atomic<uint32_t> refs_num;
+
+#if KSERVER_HAS_THREADS
+    /// The snapshots are pushed from the polling thread:
+    /// the frames are written one at a time.
+    std::timed_mutex write_mutex;
+#endif
 };
 
 /// Session
@@ -55,8 +120,9 @@ class Session : public SessionAbstract
 
     int run();
 
-    unsigned int request_num() const {return requests_num;}
-    unsigned int error_num() const {return errors_num;}
+    unsigned int request_num() const {return stats.requests_num.load();}
+    unsigned int error_num() const {return stats.errors_num.load();}
+    const SessionStats& get_stats() const {return stats;}
     SessID get_id() const {return id;}
     const char* get_client_ip() const {return peer_info.ip_str;}
     int get_client_port() const {return peer_info.port;}
@@ -64,23 +130,27 @@ class Session : public SessionAbstract
 
     // Receive - Send
 
-    // TODO Move in Session<TCP> specialization
+    /// Read n_bytes of the command arguments.
+    /// For the WebSocket, they are read across the frames of the message.
     int rcv_n_bytes(char *buffer, uint64_t n_bytes);
 
+    /// Maximum length of a vector or string argument: for the WebSocket,
+    /// the bytes the message can still deliver within the session quota.
+    uint64_t max_pack_length() const;
+
     template<typename... Tp> std::tuple<int, Tp...> deserialize(Command& cmd, std::false_type);
     template<typename... Tp> std::tuple<int, Tp...> deserialize(Command& cmd, std::true_type);
 
+    template<typename... Tp>
+    std::tuple<int, Tp...> deserialize(Command& cmd) {
+        return deserialize<Tp...>(cmd, std::integral_constant<bool, 0 < sizeof...(Tp)>());
+    }
+
     // XXX Error when removing this !
     template<typename T, size_t N>
     std::tuple<int, const std::array<T, N>&> extract_array(Command& cmd);
 
-    // The command is passed in argument since for the WebSocket the vector data
-    // are stored into it. This implies that the whole vector is already stored on
-    // the stack which might not be a good thing.
-    //
-    // TCP sockets won't use it as it reads directly the TCP buffer.
-    template<typename Tp>
-    int recv(Tp& container, Command& cmd);
+    // The data are read directly into the container
 
     template<typename T, size_t N>
     int recv(std::array<T, N>& arr, Command& cmd);
@@ -88,10 +158,160 @@ class Session : public SessionAbstract
     template<typename T>
     int recv(std::vector<T>& vec, Command& cmd);
 
+    int recv(std::string& str, Command& cmd);
+
     template<uint16_t class_id, uint16_t func_id, typename... Args>
     int send(Args&&... args) {
+        if (unlikely(!reduction_stages.empty())) {
+            const auto it = reduction_stages.find((class_id << 16) | func_id);
+
+            if (it != reduction_stages.end())
+                return send_reduced<class_id, func_id>(it->second, std::forward<Args>(args)...);
+        }
+
+        return send_response<class_id, func_id>(std::forward<Args>(args)...);
+    }
+
+    /// Response of an operation annotated @cache (see response_cache.hpp).
+    /// key holds the arguments of the call. On a miss, call(sender) calls
+    /// the device and passes the result to sender, which sends the response
+    /// and stores its frame in the cache.
+    template<uint16_t class_id, uint16_t func_id, typename Call>
+    int send_cached(ResponseCache& cache, std::string&& key, uint64_t ttl_ns, Call&& call) {
+        constexpr uint32_t op_key = (class_id << 16) | func_id;
+
+        if (!shares_frames(op_key))
+            return call_and_send<class_id, func_id>(std::forward<Call>(call));
+
+        key.push_back(static_cast<char>(byte_order.load()));
+
+        if (const auto frame = cache.find(op_key, key))
+            return write_frame(*frame);
+
+        const uint64_t generation = cache.generation();
+
+        return call([&](auto&&... args) {
+            const auto& refs = build_response<class_id, func_id>(std::forward<decltype(args)>(args)...);
+
+            if (response_len(refs) > KSERVER_RESPONSE_CACHE_MAX_FRAME_LEN)
+                return write_response(refs, op_key);
+
+            auto frame = std::make_shared<std::vector<unsigned char>>();
+            flatten_response(refs, *frame);
+            const int bytes_send = write_frame(*frame);
+            cache.store(op_key, std::move(key), std::move(frame), ttl_ns, generation);
+            return bytes_send;
+        });
+    }
+
+    /// Response of an operation annotated @shared (see single_flight.hpp).
+    /// key holds the arguments of the call. The session leading the flight
+    /// calls call(sender), the others send the frame of the leader.
+    template<uint16_t class_id, uint16_t func_id, typename Call>
+    int send_shared(SingleFlight& flights, std::string&& key, Call&& call) {
+        constexpr uint32_t op_key = (class_id << 16) | func_id;
+
+        if (!shares_frames(op_key))
+            return call_and_send<class_id, func_id>(std::forward<Call>(call));
+
+        key.push_back(static_cast<char>(byte_order.load()));
+
+        if (const auto flight = flights.join(op_key, key))
+            return write_frame(*flights.wait(flight));
+
+        return call([&](auto&&... args) {
+            const auto& refs = build_response<class_id, func_id>(std::forward<decltype(args)>(args)...);
+            const auto flight = flights.land(op_key, key);
+
+            if (flight == nullptr)
+                return write_response(refs, op_key);
+
+            auto frame = std::make_shared<std::vector<unsigned char>>();
+            flatten_response(refs, *frame);
+            flights.publish(flight, frame);
+            return write_frame(*frame);
+        });
+    }
+
+    /// Response of a polled operation (see polling.hpp): the last snapshot.
+    /// call(sender) calls the device before the first snapshot.
+    template<uint16_t class_id, uint16_t func_id, typename Call>
+    int send_polled(SnapshotBuffer& snapshots, Call&& call) {
+        std::shared_ptr<const Snapshot> snapshot;
+
+        if (shares_frames((class_id << 16) | func_id))
+            snapshot = snapshots.get();
+
+        if (snapshot == nullptr)
+            return call_and_send<class_id, func_id>(std::forward<Call>(call));
+
+        // The snapshot is kept alive during the write, not the polling updates
+        return write_frame(snapshot->frame(byte_order.load()));
+    }
+
+    int send_snapshot(const Snapshot& snapshot) {
+        const auto& frame = snapshot.frame(byte_order.load());
+
+        // The first iovec is left for the WebSocket frame header
+        std::array<struct iovec, 2> iov = {{
+            {nullptr, 0},
+            {const_cast<unsigned char*>(frame.data()), frame.size()}
+        }};
+
+        return push_iovecs(iov.data(), iov.size());
+    }
+
+    // The block is written from the stream ring
+    int send_stream_block(uint16_t stream_id, uint64_t sequence, uint64_t dropped,
+                          const unsigned char *data, uint32_t len) {
+        constexpr auto header_len = required_buffer_size<uint32_t, uint16_t, uint16_t>();
+        std::array<unsigned char, header_len + required_buffer_size<uint64_t, uint64_t, uint32_t>()> header;
+        const auto& prefix = serialize(0U, static_cast<uint16_t>(PubSub::STREAMS_CHANNEL), stream_id);
+        std::copy(prefix.begin(), prefix.end(), header.begin());
+
+        // Read from the streams thread
+        if (byte_order.load() == ByteOrder::NATIVE)
+            detail::serialize<ByteOrder::NATIVE>(std::make_tuple(sequence, dropped, len), header.data() + header_len);
+        else
+            detail::serialize<ByteOrder::NETWORK>(std::make_tuple(sequence, dropped, len), header.data() + header_len);
+
+        // The first iovec is left for the WebSocket frame header
+        std::array<struct iovec, 3> iov = {{
+            {nullptr, 0},
+            {header.data(), header.size()},
+            {const_cast<unsigned char*>(data), len}
+        }};
+
+        return push_iovecs(iov.data(), iov.size());
+    }
+
+  private:
+    template<uint16_t class_id, uint16_t func_id, typename... Args>
+    const std::vector<DataReference>& build_response(Args&&... args) {
+        if (byte_order == ByteOrder::NATIVE) {
+            dyn_ser_native.build_command<class_id, func_id>(send_buffer, std::forward<Args>(args)...);
+            return dyn_ser_native.references();
+        }
+
         dyn_ser.build_command<class_id, func_id>(send_buffer, std::forward<Args>(args)...);
-        const auto bytes_send = write(send_buffer.data(), send_buffer.size());
+        return dyn_ser.references();
+    }
+
+    template<uint16_t class_id, uint16_t func_id, typename... Args>
+    int send_response(Args&&... args) {
+        return write_response(build_response<class_id, func_id>(std::forward<Args>(args)...),
+                              (class_id << 16) | func_id);
+    }
+
+    int write_response(const std::vector<DataReference>& refs, uint32_t op_key) {
+        int bytes_send;
+
+        if (likely(refs.empty()))
+            bytes_send = write(send_buffer.data(), send_buffer.size());
+        else if (response_codecs != 0)
+            bytes_send = write_encoded(refs, op_key);
+        else
+            bytes_send = write_references(refs);
 
         if (bytes_send == 0)
             status = CLOSED;
@@ -99,7 +319,50 @@ class Session : public SessionAbstract
         return bytes_send;
     }
 
-  private:
+    // Responses of the operations with a reduction stage (see reductions.hpp)
+
+    template<uint16_t class_id, uint16_t func_id, typename Container>
+    std::enable_if_t<reductions::is_numeric_container_v<std::decay_t<Container>>, int>
+    send_reduced(const reductions::Stage& stage, Container&& container) {
+        using T = typename std::decay_t<Container>::value_type;
+        const T *data = container.data();
+        const size_t n = container.size();
+
+        switch (stage.reduction) {
+          case reductions::DECIMATE: {
+            auto& out = reductions::buffer<T>();
+            reductions::decimate(data, n, stage.points, out);
+            return send_response<class_id, func_id>(out);
+          }
+          case reductions::ENVELOPE: {
+            auto& out = reductions::buffer<T>();
+            reductions::envelope(data, n, stage.points, out);
+            return send_response<class_id, func_id>(out);
+          }
+          case reductions::MEAN: {
+            auto& out = reductions::buffer<double>();
+            reductions::mean(data, n, stage.points, out);
+            return send_response<class_id, func_id>(out);
+          }
+          case reductions::HISTOGRAM: {
+            double min, max;
+            auto& out = reductions::buffer<uint32_t>();
+            reductions::histogram(data, n, stage.points, min, max, out);
+            return send_response<class_id, func_id>(min, max, out);
+          }
+          case reductions::NONE:
+          case reductions::reductions_num:
+          default:
+            return send_response<class_id, func_id>(std::forward<Container>(container));
+        }
+    }
+
+    // Responses that cannot be reduced are sent unchanged
+    template<uint16_t class_id, uint16_t func_id, typename... Args>
+    int send_reduced(const reductions::Stage&, Args&&... args) {
+        return send_response<class_id, func_id>(std::forward<Args>(args)...);
+    }
+
     std::shared_ptr<KServerConfig> config;
     int comm_fd;  ///< Socket file descriptor
     SessID id;
@@ -113,19 +376,21 @@ class Session : public SessionAbstract
 
 #if KSERVER_HAS_WEBSOCKET
     struct EmptyWebsock {
-        EmptyWebsock(std::shared_ptr<KServerConfig> config_, SysLog& syslog_) {}
+        EmptyWebsock(std::shared_ptr<KServerConfig> config_, SysLog& syslog_,
+                     SessionStats& stats_) {}
     };
 
     std::conditional_t<sock_type == WEBSOCK, WebSocket, EmptyWebsock> websock;
 #endif
 
     // Monitoring
-    unsigned int requests_num; ///< Number of requests received during the current session
-    unsigned int errors_num;   ///< Number of requests errors during the current session
+    SessionStats stats;        ///< Statistics of the current session
     std::time_t start_time;    ///< Starting time of the session
 
     std::vector<unsigned char> send_buffer;
+    std::vector<struct iovec> send_iovecs;
     DynamicSerializer<1024> dyn_ser;
+    DynamicSerializer<1024, ByteOrder::NATIVE> dyn_ser_native;
 
     enum {CLOSED, OPENED};
     int status;
@@ -135,8 +400,6 @@ class Session : public SessionAbstract
     int exit_socket();
 
     int init_session() {
-        errors_num = 0;
-        requests_num = 0;
         start_time = std::time(nullptr);
         return init_socket();
     }
@@ -149,6 +412,15 @@ class Session : public SessionAbstract
 
     int read_command(Command& cmd);
 
+    // The byte order is resolved once per pack of scalars
+    template<typename... Tp, size_t len>
+    std::tuple<Tp...> deserialize_pack(Buffer<len>& buff) {
+        if (byte_order == ByteOrder::NATIVE)
+            return buff.template deserialize<ByteOrder::NATIVE, Tp...>();
+
+        return buff.template deserialize<Tp...>();
+    }
+
     int64_t get_pack_length() {
         Buffer<sizeof(uint64_t)> buff;
         const auto err = rcv_n_bytes(buff.data(), sizeof(uint32_t));
@@ -159,11 +431,89 @@ class Session : public SessionAbstract
             return -1;
         }
 
-        return std::get<0>(buff.deserialize<uint32_t>());
+        const uint64_t length = std::get<0>(deserialize_pack<uint32_t>(buff));
+
+        // Checked before the container is allocated
+        if (unlikely(length > max_pack_length())) {
+            session_manager.kserver.syslog.print<ERROR>(
+            "Pack length of %lu bytes larger than the message\n", length);
+            return -1;
+        }
+
+        return length;
     }
 
     template<class T> int write(const T *data, unsigned int len);
 
+    /// Write a message pushed from another thread without stalling on a
+    /// slow client. Returns -1 if the message is dropped: the session is
+    /// writing a response, or its socket is full (see writev_push).
+    int push_iovecs(struct iovec *iov, int iovcnt);
+
+    // Responses referencing containers are written with a single writev:
+    // the send buffer interleaved with the referenced containers.
+    int write_references(const std::vector<DataReference>& refs);
+    int write_iovecs(struct iovec *iov, int iovcnt);
+
+    // Cached and shared responses are copied in a flat frame
+
+    /// The responses of op are not encoded for this session only
+    /// (response codecs or reduction stage)
+    bool shares_frames(uint32_t op_key) const {
+        return response_codecs == 0
+               && (likely(reduction_stages.empty()) || reduction_stages.count(op_key) == 0);
+    }
+
+    template<uint16_t class_id, uint16_t func_id, typename Call>
+    int call_and_send(Call&& call) {
+        return call([&](auto&&... args) {
+            return send<class_id, func_id>(std::forward<decltype(args)>(args)...);
+        });
+    }
+
+    size_t response_len(const std::vector<DataReference>& refs) const {
+        size_t len = send_buffer.size();
+
+        for (const auto& ref : refs)
+            len += ref.len;
+
+        return len;
+    }
+
+    void flatten_response(const std::vector<DataReference>& refs,
+                          std::vector<unsigned char>& frame);
+
+    int write_frame(const std::vector<unsigned char>& frame) {
+        const int bytes_send = write(frame.data(), frame.size());
+
+        if (bytes_send == 0)
+            status = CLOSED;
+
+        return bytes_send;
+    }
+
+    // Responses with containers above the codec threshold
+    // are sent as a sequence of encoded segments (see codecs.hpp).
+    std::vector<unsigned char> encode_buffer;
+    std::vector<unsigned char> codec_scratch;
+    int write_encoded(const std::vector<DataReference>& refs, uint32_t op_key);
+
+    // Last containers sent per operation (codecs::DIFF)
+    std::unordered_map<uint32_t, std::vector<std::vector<unsigned char>>> diff_history;
+    void append_reference(const DataReference& ref, std::vector<unsigned char>& prev);
+
+  public:
+    void set_response_codecs(uint32_t codecs_mask, uint32_t threshold) {
+        response_codecs = codecs_mask;
+        const size_t reference_threshold = (codecs_mask == 0)
+                ? KSERVER_STREAM_THRESHOLD
+                : std::min<size_t>(KSERVER_STREAM_THRESHOLD,
+                                   std::max<size_t>(threshold, KSERVER_CODEC_MIN_THRESHOLD));
+        dyn_ser.set_reference_threshold(reference_threshold);
+        dyn_ser_native.set_reference_threshold(reference_threshold);
+        diff_history.clear();
+    }
+
 friend class SessionManager;
 };
 
@@ -179,23 +529,32 @@ Session<sock_type>::Session(const std::shared_ptr<KServerConfig>& config_,
 , peer_info(PeerInfo<sock_type>(comm_fd_))
 , session_manager(session_manager_)
 #if KSERVER_HAS_WEBSOCKET
-, websock(config_, session_manager_.kserver.syslog)
+, websock(config_, session_manager_.kserver.syslog, stats)
 #endif
-, requests_num(0)
-, errors_num(0)
+, stats()
 , start_time(0)
 , send_buffer(0)
+, dyn_ser(KSERVER_STREAM_THRESHOLD)
+, dyn_ser_native(KSERVER_STREAM_THRESHOLD)
 , status(OPENED)
 {}
 
 template<int sock_type>
 int Session<sock_type>::run()
 {
-    if (init_session() < 0)
+    const int init_status = init_session();
+
+    if (init_status < 0)
         return -1;
 
+    // Request served during initialization
+    // (HTTP GET /metrics on the WebSocket port)
+    if (init_status > 0)
+        return 0;
+
     while (!session_manager.kserver.exit_comm.load()) {
         Command cmd;
+        KSERVER_TRACE_BEGIN(read);
         const int nb_bytes_rcvd = read_command(cmd);
 
         if (session_manager.kserver.exit_comm.load())
@@ -209,13 +568,16 @@ int Session<sock_type>::run()
             return nb_bytes_rcvd;
         }
 
-        requests_num++;
+        // Includes the time waiting for the client
+        KSERVER_TRACE_END(read, READ_COMMAND, cmd);
+
+        stats.requests_num.add();
 
         if (unlikely(session_manager.dev_manager.execute(cmd) < 0)) {
             session_manager.kserver.syslog.print<ERROR>(
                 "Failed to execute command [device = %i, operation = %i]\n",
                 cmd.device, cmd.operation);
-            errors_num++;
+            stats.errors_num.add();
         }
 
         if (status == CLOSED)
@@ -226,6 +588,12 @@ int Session<sock_type>::run()
     return 0;
 }
 
+template<int sock_type>
+inline uint64_t Session<sock_type>::max_pack_length() const
+{
+    return std::numeric_limits<uint32_t>::max();
+}
+
 // -----------------------------------------------
 // TCP
 // -----------------------------------------------
@@ -235,74 +603,16 @@ int Session<sock_type>::run()
 template<>
 int Session<TCP>::rcv_n_bytes(char *buffer, uint64_t n_bytes);
 
-template<>
-template<typename T, size_t N>
-inline int Session<TCP>::recv(std::array<T, N>& arr, Command& cmd)
-{
-    return rcv_n_bytes(reinterpret_cast<char*>(arr.data()), size_of<T, N>);
-}
-
-template<>
-template<typename T>
-inline int Session<TCP>::recv(std::vector<T>& vec, Command& cmd)
-{
-    const auto length = get_pack_length() / sizeof(T);
-
-    if (length < 0)
-        return -1;
-
-    vec.resize(length);
-    const auto err = rcv_n_bytes(reinterpret_cast<char *>(vec.data()), length * sizeof(T));
-
-    if (err >= 0)
-        session_manager.kserver.syslog.print<DEBUG>(
-            "TCPSocket: Received a vector of %lu bytes\n", length);
-
-    return err;
-}
-
-template<>
-template<>
-inline int Session<TCP>::recv(std::string& str, Command& cmd)
-{
-    const auto length = get_pack_length();
-
-    if (length < 0)
-        return -1;
-
-    str.resize(length);
-    const auto err = rcv_n_bytes(const_cast<char*>(str.data()), length);
-
-    if (err >= 0)
-        session_manager.kserver.syslog.print<DEBUG>(
-            "TCPSocket: Received a string of %lu bytes\n", length);
-
-    return err;
-}
-
-template<>
-template<typename... Tp>
-inline std::tuple<int, Tp...> Session<TCP>::deserialize(Command& cmd, std::false_type)
-{
-    return std::make_tuple(0);
-}
-
-template<>
-template<typename... Tp>
-inline std::tuple<int, Tp...> Session<TCP>::deserialize(Command& cmd, std::true_type)
-{
-    constexpr auto pack_len = required_buffer_size<Tp...>();
-    Buffer<pack_len> buff;
-    const int err = rcv_n_bytes(buff.data(), pack_len);
-    return std::tuple_cat(std::make_tuple(err), buff.deserialize<Tp...>());
-}
-
 template<>
 template<class T>
 inline int Session<TCP>::write(const T *data, unsigned int len)
 {
+#if KSERVER_HAS_THREADS
+    std::lock_guard<std::timed_mutex> lock(write_mutex);
+#endif
     const int bytes_send = sizeof(T) * len;
     const int n_bytes_send = ::write(comm_fd, (void*)data, bytes_send);
+    stats.send_calls.add();
 
     if (n_bytes_send == 0) {
        session_manager.kserver.syslog.print<ERROR>(
@@ -316,6 +626,8 @@ inline int Session<TCP>::write(const T *data, unsigned int len)
        return -1;
     }
 
+    stats.bytes_sent.add(n_bytes_send);
+
     if (unlikely(n_bytes_send != bytes_send)) {
         session_manager.kserver.syslog.print<ERROR>(
             "TCPSocket::write: Some bytes have not been sent\n");
@@ -326,6 +638,52 @@ inline int Session<TCP>::write(const T *data, unsigned int len)
     return bytes_send;
 }
 
+template<>
+inline int Session<TCP>::write_iovecs(struct iovec *iov, int iovcnt)
+{
+#if KSERVER_HAS_THREADS
+    std::lock_guard<std::timed_mutex> lock(write_mutex);
+#endif
+    const auto bytes_send = writev_all(comm_fd, iov, iovcnt, stats);
+
+    if (bytes_send == 0) {
+       session_manager.kserver.syslog.print<ERROR>(
+          "TCPSocket::write: Connection closed by client\n");
+       return 0;
+    }
+
+    if (unlikely(bytes_send < 0)) {
+       session_manager.kserver.syslog.print<ERROR>(
+          "TCPSocket::write: Can't write to client\n");
+       return -1;
+    }
+
+    session_manager.kserver.syslog.print<DEBUG>("[S] [%lu bytes]\n", bytes_send);
+    return std::min<int64_t>(bytes_send, std::numeric_limits<int>::max());
+}
+
+template<>
+inline int Session<TCP>::push_iovecs(struct iovec *iov, int iovcnt)
+{
+#if KSERVER_HAS_THREADS
+    std::unique_lock<std::timed_mutex> lock(write_mutex, std::chrono::milliseconds(KSERVER_PUSH_LOCK_TIMEOUT_MS));
+
+    if (!lock.owns_lock())
+        return -1;
+#endif
+    const auto bytes_send = writev_push(comm_fd, iov, iovcnt, stats, true);
+
+    if (unlikely(bytes_send < 0 && errno != EAGAIN)) {
+       // Reported once: the next pushes to a disconnected client fail with EPIPE
+       if (errno != EPIPE)
+           session_manager.kserver.syslog.print<ERROR>(
+              "TCPSocket::push: Can't write to client\n");
+       return -1;
+    }
+
+    return std::min<int64_t>(bytes_send, std::numeric_limits<int>::max());
+}
+
 #endif // KSERVER_HAS_TCP
 
 // -----------------------------------------------
@@ -341,7 +699,10 @@ class Session<UNIX> : public Session<TCP>
     Session<UNIX>(const std::shared_ptr<KServerConfig>& config_,
                   int comm_fd_, SessID id_,
                   SessionManager& session_manager_)
-    : Session<TCP>(config_, comm_fd_, id_, session_manager_) {}
+    : Session<TCP>(config_, comm_fd_, id_, session_manager_)
+    {
+        kind = UNIX;
+    }
 };
 #endif // KSERVER_HAS_UNIX_SOCKET
 
@@ -352,68 +713,112 @@ class Session<UNIX> : public Session<TCP>
 #if KSERVER_HAS_WEBSOCKET
 
 template<>
-template<typename T, size_t N>
-inline int Session<WEBSOCK>::recv(std::array<T, N>& arr, Command& cmd)
+int Session<WEBSOCK>::rcv_n_bytes(char *buffer, uint64_t n_bytes);
+
+template<>
+inline uint64_t Session<WEBSOCK>::max_pack_length() const
 {
-    arr = cmd.payload.extract_array<T, N>();
-    return 0;
+    return websock.remaining_quota();
 }
 
 template<>
-template<typename T>
-inline int Session<WEBSOCK>::recv(std::vector<T>& vec, Command& cmd)
+template<class T>
+inline int Session<WEBSOCK>::write(const T *data, unsigned int len)
 {
-    const auto length = std::get<0>(cmd.payload.deserialize<uint32_t>());
+#if KSERVER_HAS_THREADS
+    std::lock_guard<std::timed_mutex> lock(write_mutex);
+#endif
+    return websock.send(data, len);
+}
 
-    if (length > CMD_PAYLOAD_BUFFER_LEN) {
-        session_manager.kserver.syslog.print<ERROR>(
-            "WebSocket: Payload size overflow during buffer reception\n");
+template<>
+inline int Session<WEBSOCK>::write_iovecs(struct iovec *iov, int iovcnt)
+{
+#if KSERVER_HAS_THREADS
+    std::lock_guard<std::timed_mutex> lock(write_mutex);
+#endif
+    return websock.send_binary(iov, iovcnt);
+}
+
+template<>
+inline int Session<WEBSOCK>::push_iovecs(struct iovec *iov, int iovcnt)
+{
+#if KSERVER_HAS_THREADS
+    std::unique_lock<std::timed_mutex> lock(write_mutex, std::chrono::milliseconds(KSERVER_PUSH_LOCK_TIMEOUT_MS));
+
+    if (!lock.owns_lock())
         return -1;
-    }
+#endif
+    return websock.send_binary(iov, iovcnt, true);
+}
 
-    cmd.payload.to_vector(vec, length / sizeof(T));
-    return 0;
+#endif // KSERVER_HAS_WEBSOCKET
+
+// -----------------------------------------------
+// Arguments reception
+// -----------------------------------------------
+
+template<int sock_type>
+template<typename T, size_t N>
+inline int Session<sock_type>::recv(std::array<T, N>& arr, Command& cmd)
+{
+    return rcv_n_bytes(reinterpret_cast<char*>(arr.data()), size_of<T, N>);
 }
 
-template<>
-template<>
-inline int Session<WEBSOCK>::recv(std::string& str, Command& cmd)
+template<int sock_type>
+template<typename T>
+inline int Session<sock_type>::recv(std::vector<T>& vec, Command& cmd)
 {
-    const auto length = std::get<0>(cmd.payload.deserialize<uint32_t>());
+    const auto length = get_pack_length();
 
-    if (length > CMD_PAYLOAD_BUFFER_LEN) {
-        session_manager.kserver.syslog.print<ERROR>(
-            "WebSocket::rcv_vector: Payload size overflow\n");
+    if (length < 0)
         return -1;
-    }
 
-    cmd.payload.to_string(str, length);
-    return 0;
+    vec.resize(length / sizeof(T));
+    const auto err = rcv_n_bytes(reinterpret_cast<char *>(vec.data()), vec.size() * sizeof(T));
+
+    if (err >= 0)
+        session_manager.kserver.syslog.print<DEBUG>(
+            "Received a vector of %lu bytes\n", vec.size() * sizeof(T));
+
+    return err;
 }
 
-template<>
-template<typename... Tp>
-inline std::tuple<int, Tp...> Session<WEBSOCK>::deserialize(Command& cmd, std::false_type)
+template<int sock_type>
+inline int Session<sock_type>::recv(std::string& str, Command& cmd)
 {
-    return std::make_tuple(0);
+    const auto length = get_pack_length();
+
+    if (length < 0)
+        return -1;
+
+    str.resize(length);
+    const auto err = rcv_n_bytes(const_cast<char*>(str.data()), length);
+
+    if (err >= 0)
+        session_manager.kserver.syslog.print<DEBUG>(
+            "Received a string of %lu bytes\n", length);
+
+    return err;
 }
 
-template<>
+template<int sock_type>
 template<typename... Tp>
-inline std::tuple<int, Tp...> Session<WEBSOCK>::deserialize(Command& cmd, std::true_type)
+inline std::tuple<int, Tp...> Session<sock_type>::deserialize(Command& cmd, std::false_type)
 {
-    return std::tuple_cat(std::make_tuple(0), cmd.payload.deserialize<Tp...>());
+    return std::make_tuple(0);
 }
 
-template<>
-template<class T>
-inline int Session<WEBSOCK>::write(const T *data, unsigned int len)
+template<int sock_type>
+template<typename... Tp>
+inline std::tuple<int, Tp...> Session<sock_type>::deserialize(Command& cmd, std::true_type)
 {
-    return websock.send(data, len);
+    constexpr auto pack_len = required_buffer_size<Tp...>();
+    Buffer<pack_len> buff;
+    const int err = rcv_n_bytes(buff.data(), pack_len);
+    return std::tuple_cat(std::make_tuple(err), deserialize_pack<Tp...>(buff));
 }
 
-#endif // KSERVER_HAS_WEBSOCKET
-
 // -----------------------------------------------
 // Select session kind
 // -----------------------------------------------
@@ -471,6 +876,153 @@ inline int SessionAbstract::send(Args&&... args) {
     return -1;
 }
 
+template<uint16_t class_id, uint16_t func_id, typename Call>
+inline int SessionAbstract::send_cached(ResponseCache& cache, std::string&& key,
+                                        uint64_t ttl_ns, Call&& call) {
+    SWITCH_SOCK_TYPE(send_cached<class_id, func_id>(cache, std::move(key), ttl_ns,
+                                                     std::forward<Call>(call)))
+    return -1;
+}
+
+template<uint16_t class_id, uint16_t func_id, typename Call>
+inline int SessionAbstract::send_shared(SingleFlight& flights, std::string&& key, Call&& call) {
+    SWITCH_SOCK_TYPE(send_shared<class_id, func_id>(flights, std::move(key),
+                                                     std::forward<Call>(call)))
+    return -1;
+}
+
+template<uint16_t class_id, uint16_t func_id, typename Call>
+inline int SessionAbstract::send_polled(SnapshotBuffer& snapshots, Call&& call) {
+    SWITCH_SOCK_TYPE(send_polled<class_id, func_id>(snapshots, std::forward<Call>(call)))
+    return -1;
+}
+
+inline int SessionAbstract::send_snapshot(const Snapshot& snapshot) {
+    SWITCH_SOCK_TYPE(send_snapshot(snapshot))
+    return -1;
+}
+
+inline int SessionAbstract::send_stream_block(uint16_t stream_id, uint64_t sequence, uint64_t dropped,
+                                              const unsigned char *data, uint32_t len) {
+    SWITCH_SOCK_TYPE(send_stream_block(stream_id, sequence, dropped, data, len))
+    return -1;
+}
+
+inline void SessionAbstract::set_response_codecs(uint32_t codecs_mask, uint32_t threshold) {
+    SWITCH_SOCK_TYPE(set_response_codecs(codecs_mask, threshold))
+}
+
+template<typename Func>
+inline int SessionAbstract::dispatch(Func&& func) {
+    switch (this->kind) {
+#if KSERVER_HAS_TCP || KSERVER_HAS_UNIX_SOCKET
+      // Session<UNIX> only differs from Session<TCP> by its kind
+      case TCP:
+      case UNIX:
+        return func(*static_cast<Session<TCP>*>(this));
+#endif
+#if KSERVER_HAS_WEBSOCKET
+      case WEBSOCK:
+        return func(*static_cast<Session<WEBSOCK>*>(this));
+#endif
+      default:
+        assert(false);
+    }
+
+    return -1;
+}
+
+template<int sock_type>
+int Session<sock_type>::write_references(const std::vector<DataReference>& refs)
+{
+    // The first iovec is left for the WebSocket frame header
+    send_iovecs.assign(1, {nullptr, 0});
+    size_t offset = 0;
+
+    for (const auto& ref : refs) {
+        send_iovecs.push_back({send_buffer.data() + offset, ref.offset - offset});
+        send_iovecs.push_back({const_cast<unsigned char*>(ref.data), ref.len});
+        offset = ref.offset;
+    }
+
+    send_iovecs.push_back({send_buffer.data() + offset, send_buffer.size() - offset});
+    return write_iovecs(send_iovecs.data(), send_iovecs.size());
+}
+
+template<int sock_type>
+void Session<sock_type>::flatten_response(const std::vector<DataReference>& refs,
+                                          std::vector<unsigned char>& frame)
+{
+    frame.reserve(response_len(refs));
+    size_t offset = 0;
+
+    for (const auto& ref : refs) {
+        frame.insert(frame.end(), send_buffer.data() + offset, send_buffer.data() + ref.offset);
+        frame.insert(frame.end(), ref.data, ref.data + ref.len);
+        offset = ref.offset;
+    }
+
+    frame.insert(frame.end(), send_buffer.data() + offset, send_buffer.data() + send_buffer.size());
+}
+
+template<int sock_type>
+void Session<sock_type>::append_reference(const DataReference& ref,
+                                         std::vector<unsigned char>& prev)
+{
+    if (response_codecs & (1U << codecs::DIFF)) {
+        if (prev.size() == ref.len
+            && codecs::append_diff_segment(encode_buffer, ref.elem_size,
+                                           prev.data(), ref.data, ref.len) == 0) {
+            std::memcpy(prev.data(), ref.data, ref.len);
+            return;
+        }
+
+        prev.assign(ref.data, ref.data + ref.len);
+    }
+
+    codecs::append_segment(encode_buffer, codecs::select(response_codecs, ref.elem_size),
+                           ref.elem_size, ref.data, ref.len, codec_scratch);
+}
+
+template<int sock_type>
+int Session<sock_type>::write_encoded(const std::vector<DataReference>& refs, uint32_t op_key)
+{
+    constexpr size_t header_len = required_buffer_size<uint32_t, uint16_t, uint16_t>();
+    encode_buffer.assign(send_buffer.begin(), send_buffer.begin() + header_len);
+    encode_buffer[0] |= codecs::RESPONSE_ENCODED;
+    size_t offset = header_len;
+
+    // Containers of the previous response of the operation,
+    // indexed by segment position (empty for the other segments)
+    auto& history = diff_history[op_key];
+    history.resize(2 * refs.size() + 1);
+    size_t segment = 0;
+
+    for (const auto& ref : refs) {
+        if (ref.offset > offset) {
+            codecs::append_segment(encode_buffer, codecs::RAW, 1, send_buffer.data() + offset,
+                                   ref.offset - offset, codec_scratch);
+            history[segment++].clear();
+        }
+
+        append_reference(ref, history[segment++]);
+        offset = ref.offset;
+    }
+
+    if (send_buffer.size() > offset) {
+        codecs::append_segment(encode_buffer, codecs::RAW, 1, send_buffer.data() + offset,
+                               send_buffer.size() - offset, codec_scratch);
+        history[segment++].clear();
+    }
+
+    history.resize(segment);
+
+    // The first iovec is left for the WebSocket frame header
+    send_iovecs.assign(1, {nullptr, 0});
+    send_iovecs.push_back({encode_buffer.data(), encode_buffer.size()});
+    return write_iovecs(send_iovecs.data(), send_iovecs.size());
+}
+
 // Cast abstract session unique_ptr
 template<int sock_type>
 Session<sock_type>*
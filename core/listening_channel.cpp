@@ -129,8 +129,7 @@ template<int sock_type>
 void session_thread_call(int comm_fd, ListeningChannel<sock_type> *listener)
 {
     listener->inc_thread_num();
-    listener->stats.opened_sessions_num++;
-    listener->stats.total_sessions_num++;
+    listener->stats.total_sessions_num.add();
 
     SessID sid = listener->kserver->session_manager. template create_session<sock_type>(
                             listener->kserver->config, comm_fd);
@@ -152,11 +151,11 @@ void session_thread_call(int comm_fd, ListeningChannel<sock_type> *listener)
                 "Close session id = %u with #req = %u. #err = %u\n",
                 sid, session->request_num(), session->error_num());
 
-    listener->stats.total_requests_num += session->request_num();
+    // The statistics of the session are merged into the listener
     listener->kserver->session_manager.delete_session(sid);
 
     listener->dec_thread_num();
-    listener->stats.opened_sessions_num--;
+    listener->stats.closed_sessions_num.add();
 }
 
 template<int sock_type>
@@ -194,6 +193,24 @@ void comm_thread_call(ListeningChannel<sock_type> *listener)
                 "%s listener closed.\n", listen_channel_desc[sock_type].c_str());
 }
 
+template<int sock_type>
+StatsSnapshot ListeningChannel<sock_type>::get_stats()
+{
+    // Closed sessions are accumulated in the listener stats,
+    // running sessions are added here. Both are read under the session
+    // manager lock, which delete_session holds to merge a closing session.
+    StatsSnapshot snap;
+
+    kserver->session_manager.for_each_session([&]() {
+        snap = stats.snapshot();
+    }, [&](SessID id, SessionAbstract& session) {
+        if (session.kind == sock_type)
+            snap += static_cast<Session<sock_type>*>(&session)->get_stats();
+    });
+
+    return snap;
+}
+
 template<int sock_type>
 int ListeningChannel<sock_type>::__start_worker()
 {
@@ -266,6 +283,8 @@ int ListeningChannel<TCP>::start_worker()
     return __start_worker();
 }
 
+template StatsSnapshot ListeningChannel<TCP>::get_stats();
+
 #endif // KSERVER_HAS_TCP
 
 // ---- WEBSOCK ----
@@ -320,6 +339,8 @@ int ListeningChannel<WEBSOCK>::start_worker()
     return __start_worker();
 }
 
+template StatsSnapshot ListeningChannel<WEBSOCK>::get_stats();
+
 #endif // KSERVER_HAS_WEBSOCKET
 
 // ---- UNIX ----
@@ -401,6 +422,8 @@ int ListeningChannel<UNIX>::start_worker()
     return __start_worker();
 }
 
+template StatsSnapshot ListeningChannel<UNIX>::get_stats();
+
 #endif // KSERVER_HAS_UNIX_SOCKET
 
 } // namespace kserver
@@ -0,0 +1,121 @@
+/// Server metrics
+///
+/// Counters and histograms are sharded per thread so that the
+/// session threads never write to a shared cache line.
+/// Shards are only merged when the metrics are read.
+///
+/// (c) Koheron
+
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#include <cstdint>
+#include <array>
+#include <memory>
+#include <utility>
+
+#include "kserver_defs.hpp"
+#include "counters.hpp"
+#include "histogram.hpp"
+#include <devices_table.hpp>
+
+namespace kserver {
+
+// ------------------------------------------
+// Operations latencies
+// ------------------------------------------
+
+/// Index of the first operation of a device in operations_names
+constexpr size_t operations_offset(device_id dev)
+{
+    size_t offset = 0;
+
+    for (device_id i = 0; i < dev; i++)
+        offset += operations_num[i];
+
+    return offset;
+}
+
+namespace detail {
+    template<size_t... devs>
+    constexpr std::array<size_t, device_num>
+    make_operations_offsets(std::index_sequence<devs...>) {
+        return {{operations_offset(devs)...}};
+    }
+}
+
+constexpr auto operations_offsets
+    = detail::make_operations_offsets(std::make_index_sequence<device_num>());
+
+constexpr size_t operations_total = operations_offset(device_num);
+
+static_assert(std::tuple_size<decltype(operations_names)>::value == operations_total, "");
+
+/// Latency histograms of each (device, operation)
+class OperationsLatency
+{
+  public:
+    OperationsLatency()
+    : shards(std::make_unique<Shard[]>(KSERVER_METRICS_SHARDS))
+    {}
+
+    static bool is_valid(device_id dev, int32_t op) {
+        return dev < device_num && op >= 0
+               && static_cast<size_t>(op) < operations_num[dev];
+    }
+
+    void record(device_id dev, int32_t op, uint64_t duration_ns) {
+        if (unlikely(!is_valid(dev, op)))
+            return;
+
+        shards[thread_shard()][operations_offsets[dev] + op].record(duration_ns);
+    }
+
+    /// Merge the shards of an operation into hist
+    void merge(device_id dev, int32_t op, LogHistogram& hist) const {
+        hist.reset();
+
+        if (!is_valid(dev, op))
+            return;
+
+        for (size_t i = 0; i < KSERVER_METRICS_SHARDS; i++)
+            hist.merge(shards[i][operations_offsets[dev] + op]);
+    }
+
+  private:
+    using Shard = std::array<AtomicLogHistogram, operations_total>;
+    std::unique_ptr<Shard[]> shards;
+};
+
+// ------------------------------------------
+// Devices queues
+// ------------------------------------------
+
+/// Number of commands waiting for, or being executed by, each device
+class DevicesQueueDepth
+{
+  public:
+    void enter(device_id dev) {
+        entered[dev].add();
+    }
+
+    void leave(device_id dev) {
+        left[dev].add();
+    }
+
+    uint64_t depth(device_id dev) const {
+        // Shards are not read atomically:
+        // clamp when a concurrent leave is seen before its enter.
+        const auto left_num = left[dev].load();
+        const auto entered_num = entered[dev].load();
+        return entered_num > left_num ? entered_num - left_num : 0;
+    }
+
+  private:
+    std::array<ShardedCounter, device_num> entered;
+    std::array<ShardedCounter, device_num> left;
+};
+
+} // namespace kserver
+
+#endif // __METRICS_HPP__
@@ -0,0 +1,162 @@
+/// Implementation of polling.hpp
+///
+/// (c) Koheron
+
+#include "polling.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#if KSERVER_HAS_THREADS
+extern "C" {
+  #include <poll.h>
+  #include <unistd.h>
+  #include <sys/timerfd.h>
+  #include <sys/eventfd.h>
+}
+#endif
+
+#include "kserver.hpp"
+#include "metrics.hpp"
+#include "syslog.tpp"
+#include "pubsub.tpp"
+
+namespace kserver {
+
+int PollingScheduler::update(size_t entry)
+{
+    if (entry >= polled_operations.size())
+        return -1;
+
+    const auto& polled = polled_operations[entry];
+    auto& buffer = buffers[entry];
+    Snapshot *snapshot;
+
+    if (buffer.back(snapshot))
+        allocated++;
+
+    if (kserver->dev_manager.poll(polled.dev, polled.op, builder, *snapshot) < 0) {
+        kserver->syslog.print<ERROR>("Polling: Cannot call %s.%s\n",
+            devices_names[polled.dev].data(),
+            operations_names[operations_offsets[polled.dev] + polled.op].data());
+        return -1;
+    }
+
+    buffer.publish();
+
+    // Only the polling thread writes the snapshot
+    if (polled.publish)
+        kserver->syslog.pubsub.emit_snapshot<PubSub::POLLING_CHANNEL>(*snapshot);
+
+    return 0;
+}
+
+int PollingScheduler::start()
+{
+    // The first snapshots are available to the first sessions
+    for (size_t i = 0; i < polled_operations.size(); i++)
+        if (update(i) < 0)
+            return -1;
+
+    if (polled_operations.empty())
+        return 0;
+
+#if KSERVER_HAS_THREADS
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+
+    if (stop_fd < 0) {
+        kserver->syslog.print<CRITICAL>("Polling: Cannot create eventfd\n");
+        return -1;
+    }
+
+    for (size_t i = 0; i < polled_operations.size(); i++) {
+        const uint32_t period_ms = polled_operations[i].period_ms;
+        struct itimerspec spec;
+        spec.it_interval.tv_sec = period_ms / 1000;
+        spec.it_interval.tv_nsec = (period_ms % 1000) * 1000000L;
+        spec.it_value = spec.it_interval;
+
+        timer_fds[i] = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+
+        if (timer_fds[i] < 0 || timerfd_settime(timer_fds[i], 0, &spec, nullptr) < 0) {
+            kserver->syslog.print<CRITICAL>("Polling: Cannot start timer: %s\n",
+                                            strerror(errno));
+            return -1;
+        }
+    }
+
+    poll_thread = std::thread(&PollingScheduler::run, this);
+    return 0;
+#else
+    kserver->syslog.print<WARNING>("Polling: Snapshots are not updated without threads\n");
+    return 0;
+#endif
+}
+
+#if KSERVER_HAS_THREADS
+
+void PollingScheduler::run()
+{
+    std::array<struct pollfd, polled_operations.size() + 1> fds;
+
+    for (size_t i = 0; i < polled_operations.size(); i++)
+        fds[i] = {timer_fds[i], POLLIN, 0};
+
+    fds.back() = {stop_fd, POLLIN, 0};
+
+    while (true) {
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            kserver->syslog.print<CRITICAL>("Polling: poll failed: %s\n", strerror(errno));
+            return;
+        }
+
+        if (fds.back().revents & POLLIN)
+            return;
+
+        for (size_t i = 0; i < polled_operations.size(); i++) {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+
+            // Missed periods are not caught up
+            uint64_t expirations;
+
+            if (read(timer_fds[i], &expirations, sizeof(expirations)) == sizeof(expirations))
+                update(i);
+        }
+    }
+}
+
+void PollingScheduler::stop()
+{
+    if (poll_thread.joinable()) {
+        const uint64_t one = 1;
+
+        if (write(stop_fd, &one, sizeof(one)) == sizeof(one))
+            poll_thread.join();
+        else
+            poll_thread.detach();
+    }
+
+    for (auto& fd : timer_fds) {
+        if (fd >= 0)
+            close(fd);
+
+        fd = -1;
+    }
+
+    if (stop_fd >= 0)
+        close(stop_fd);
+
+    stop_fd = -1;
+}
+
+#else
+
+void PollingScheduler::stop() {}
+
+#endif // KSERVER_HAS_THREADS
+
+} // namespace kserver
@@ -0,0 +1,157 @@
+/// Server-side polling of the device operations
+///
+/// The operations listed in the polling section of the build
+/// configuration are called by the server at a fixed period:
+///
+///     polling:
+///       - operation: Adc.get_temperatures
+///         period_ms: 100
+///         publish: yes
+///
+/// Only operations without arguments can be polled. The latest response
+/// is kept as a snapshot, serialized in both byte orders. The clients
+/// reading a polled operation receive the snapshot: the device is not
+/// called, nor its lock taken, whatever the number of clients. With
+/// publish, the snapshot is also pushed on the POLLING_CHANNEL to the
+/// subscribed sessions, as a response of the operation.
+///
+/// The sessions with response codecs (KServer::SET_RESPONSE_CODECS)
+/// or a reduction stage on the operation (KServer::SET_REDUCTION)
+/// call the device.
+///
+/// (c) Koheron
+
+#ifndef __POLLING_HPP__
+#define __POLLING_HPP__
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include "kserver_defs.hpp"
+#if KSERVER_HAS_THREADS
+#include <thread>
+#endif
+
+#include "serializer_deserializer.hpp"
+#include <polling_table.hpp>
+
+namespace kserver {
+
+class KServer;
+
+/// Response of a polled operation in both byte orders
+struct Snapshot
+{
+    std::array<std::vector<unsigned char>, 2> frames;
+
+    const std::vector<unsigned char>& frame(ByteOrder order) const {
+        return frames[static_cast<size_t>(order)];
+    }
+};
+
+/// Serialization of the snapshots (polling thread)
+class SnapshotBuilder
+{
+  public:
+    template<uint16_t class_id, uint16_t func_id, typename... Args>
+    void build(Snapshot& snapshot, const Args&... args) {
+        // The containers are copied in the frames (no reference)
+        dyn_ser.build_command<class_id, func_id>(
+            snapshot.frames[static_cast<size_t>(ByteOrder::NETWORK)], args...);
+        dyn_ser_native.build_command<class_id, func_id>(
+            snapshot.frames[static_cast<size_t>(ByteOrder::NATIVE)], args...);
+    }
+
+  private:
+    DynamicSerializer<1024> dyn_ser;
+    DynamicSerializer<1024, ByteOrder::NATIVE> dyn_ser_native;
+};
+
+/// Latest snapshot of a polled operation
+///
+/// The snapshot is swapped atomically by the polling thread. A session
+/// keeps a reference to the snapshot it sends, so the updates never wait
+/// for the sessions. The previous snapshot is rewritten by the next update
+/// if no session still sends it, otherwise a new one is allocated.
+class SnapshotBuffer
+{
+  public:
+    /// Latest snapshot, or nullptr if no snapshot has been published yet
+    std::shared_ptr<const Snapshot> get() const {
+        return std::atomic_load(&latest);
+    }
+
+    /// Snapshot to be written by the polling thread.
+    /// Returns true if a session still sends the previous snapshot.
+    bool back(Snapshot*& snapshot) {
+        const bool busy = spare != nullptr && spare.use_count() > 1;
+
+        if (spare == nullptr || busy)
+            spare = std::make_shared<Snapshot>();
+        else // The last session sending it has released it
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+        snapshot = spare.get();
+        return busy;
+    }
+
+    /// Swap the back snapshot to the front
+    void publish() {
+        spare = std::const_pointer_cast<Snapshot>(
+            std::atomic_exchange(&latest, std::shared_ptr<const Snapshot>(std::move(spare))));
+    }
+
+  private:
+    std::shared_ptr<const Snapshot> latest;
+    std::shared_ptr<Snapshot> spare; ///< Previous snapshot (polling thread)
+};
+
+class PollingScheduler
+{
+  public:
+    PollingScheduler(KServer *kserver_)
+    : kserver(kserver_)
+    {
+        allocated.store(0);
+#if KSERVER_HAS_THREADS
+        timer_fds.fill(-1);
+#endif
+    }
+
+    /// Poll all the operations once, then start the polling thread
+    int start();
+
+    /// Stop the polling thread (the snapshots remain available)
+    void stop();
+
+    /// Snapshots of the entry of polled_operations
+    SnapshotBuffer& snapshots(size_t entry) {
+        return buffers[entry];
+    }
+
+    /// Number of snapshots allocated because a session still sent the previous one
+    uint64_t allocated_num() const {return allocated.load();}
+
+  private:
+    KServer *kserver;
+    SnapshotBuilder builder;
+    std::array<SnapshotBuffer, polled_operations.size()> buffers;
+    std::atomic<uint64_t> allocated;
+
+#if KSERVER_HAS_THREADS
+    std::array<int, polled_operations.size()> timer_fds;
+    int stop_fd = -1;
+    std::thread poll_thread;
+
+    void run();
+#endif
+
+    int update(size_t entry);
+};
+
+} // namespace kserver
+
+#endif // __POLLING_HPP__
@@ -0,0 +1,282 @@
+/// Implementation of KServer::get_metrics
+///
+/// Metrics in the Prometheus text exposition format (version 0.0.4),
+/// served by the WebSocket listener on HTTP GET /metrics.
+/// See https://prometheus.io/docs/instrumenting/exposition_formats/
+///
+/// Only counters are read: neither the KServer mutex
+/// nor the devices mutexes are taken.
+///
+/// (c) Koheron
+
+#include "kserver.hpp"
+
+#include <ctime>
+#include <cinttypes>
+#include <algorithm>
+#include <malloc.h>
+
+#include "histogram.hpp"
+#include "metrics.hpp"
+
+namespace kserver {
+
+namespace {
+
+class MetricsWriter
+{
+  public:
+    MetricsWriter(std::string& out_)
+    : out(out_)
+    {}
+
+    void family(const char *name, const char *type, const char *help) {
+        sample("# HELP %s %s\n", name, help);
+        sample("# TYPE %s %s\n", name, type);
+    }
+
+    template<typename... Args>
+    void sample(const char *fmt, Args&&... args) {
+        char line[LINE_LEN];
+        const int ret = snprintf(line, LINE_LEN, fmt, std::forward<Args>(args)...);
+
+        if (ret > 0)
+            out.append(line, std::min(ret, LINE_LEN - 1));
+    }
+
+  private:
+    static constexpr int LINE_LEN = 256;
+    std::string& out;
+};
+
+struct ListenerMetrics
+{
+    const char *name;
+    uint64_t opened_sessions_num;
+    uint64_t total_sessions_num;
+    StatsSnapshot stats;
+};
+
+template<int sock_type>
+ListenerMetrics get_listener_metrics(const char *name,
+                                     ListeningChannel<sock_type>& listener)
+{
+    return {name,
+            listener.stats.opened_sessions_num(),
+            listener.stats.total_sessions_num.load(),
+            listener.get_stats()};
+}
+
+constexpr double to_seconds(uint64_t ns) {
+    return static_cast<double>(ns) * 1E-9;
+}
+
+constexpr std::array<const char*, PubSub::channels_count> pubsub_channels_names
+    = {{"server", "syslog", "devices", "polling", "streams"}};
+
+constexpr std::array<double, 4> latency_quantiles = {{0.5, 0.9, 0.99, 0.999}};
+
+} // namespace
+
+std::string KServer::get_metrics()
+{
+    std::string out;
+    MetricsWriter writer(out);
+
+    // Uptime
+
+    writer.family("kserver_uptime_seconds", "gauge",
+                  "Time since the server started");
+    writer.sample("kserver_uptime_seconds %li\n",
+                  static_cast<long>(std::time(nullptr) - start_time));
+
+    // Listeners
+
+    std::vector<ListenerMetrics> listeners;
+
+#if KSERVER_HAS_TCP
+    listeners.push_back(get_listener_metrics("tcp", tcp_listener));
+#endif
+#if KSERVER_HAS_WEBSOCKET
+    listeners.push_back(get_listener_metrics("websocket", websock_listener));
+#endif
+#if KSERVER_HAS_UNIX_SOCKET
+    listeners.push_back(get_listener_metrics("unix", unix_listener));
+#endif
+
+    const auto listeners_family = [&](const char *name, const char *type,
+                                      const char *help, auto value) {
+        writer.family(name, type, help);
+
+        for (auto& listener : listeners)
+            writer.sample("%s{listener=\"%s\"} %" PRIu64 "\n",
+                          name, listener.name, value(listener));
+    };
+
+    listeners_family("kserver_sessions_opened", "gauge",
+                     "Number of currently opened sessions",
+                     [](auto& l) { return l.opened_sessions_num; });
+    listeners_family("kserver_sessions_total", "counter",
+                     "Total number of sessions",
+                     [](auto& l) { return l.total_sessions_num; });
+    listeners_family("kserver_requests_total", "counter",
+                     "Number of requests received",
+                     [](auto& l) { return l.stats.requests_num; });
+    listeners_family("kserver_request_errors_total", "counter",
+                     "Number of requests that failed to execute",
+                     [](auto& l) { return l.stats.errors_num; });
+    listeners_family("kserver_received_bytes_total", "counter",
+                     "Number of bytes received",
+                     [](auto& l) { return l.stats.bytes_rcvd; });
+    listeners_family("kserver_sent_bytes_total", "counter",
+                     "Number of bytes sent",
+                     [](auto& l) { return l.stats.bytes_sent; });
+    listeners_family("kserver_recv_syscalls_total", "counter",
+                     "Number of read system calls",
+                     [](auto& l) { return l.stats.recv_calls; });
+    listeners_family("kserver_send_syscalls_total", "counter",
+                     "Number of write system calls",
+                     [](auto& l) { return l.stats.send_calls; });
+
+    // WebSocket permessage-deflate
+
+    listeners_family("kserver_deflate_input_bytes_total", "counter",
+                     "Number of bytes compressed",
+                     [](auto& l) { return l.stats.deflate_in; });
+    listeners_family("kserver_deflate_output_bytes_total", "counter",
+                     "Number of bytes after compression",
+                     [](auto& l) { return l.stats.deflate_out; });
+    listeners_family("kserver_inflate_input_bytes_total", "counter",
+                     "Number of bytes decompressed",
+                     [](auto& l) { return l.stats.inflate_in; });
+    listeners_family("kserver_inflate_output_bytes_total", "counter",
+                     "Number of bytes after decompression",
+                     [](auto& l) { return l.stats.inflate_out; });
+
+    const auto seconds_family = [&](const char *name, const char *help, auto value) {
+        writer.family(name, "counter", help);
+
+        for (auto& listener : listeners)
+            writer.sample("%s{listener=\"%s\"} %.9g\n",
+                          name, listener.name, 1E-9 * value(listener));
+    };
+
+    seconds_family("kserver_deflate_seconds_total", "Time spent compressing",
+                   [](auto& l) { return l.stats.deflate_ns; });
+    seconds_family("kserver_inflate_seconds_total", "Time spent decompressing",
+                   [](auto& l) { return l.stats.inflate_ns; });
+
+    // Operations latency
+
+    writer.family("kserver_operation_latency_seconds", "summary",
+                  "Execution time of the operations");
+
+    LogHistogram hist;
+
+    for (device_id dev = 1; dev < device_num; dev++) {
+        for (int32_t op = 0; op < static_cast<int32_t>(operations_num[dev]); op++) {
+            dev_manager.ops_latency.merge(dev, op, hist);
+
+            if (hist.count == 0)
+                continue;
+
+            const char *dev_name = devices_names[dev].data();
+            const char *op_name = operations_names[operations_offsets[dev] + op].data();
+
+            for (auto q : latency_quantiles)
+                writer.sample("kserver_operation_latency_seconds"
+                              "{device=\"%s\",operation=\"%s\",quantile=\"%g\"} %.9g\n",
+                              dev_name, op_name, q, to_seconds(hist.quantile(q)));
+
+            writer.sample("kserver_operation_latency_seconds_sum"
+                          "{device=\"%s\",operation=\"%s\"} %.9g\n",
+                          dev_name, op_name, to_seconds(hist.sum));
+            writer.sample("kserver_operation_latency_seconds_count"
+                          "{device=\"%s\",operation=\"%s\"} %" PRIu64 "\n",
+                          dev_name, op_name, hist.count);
+        }
+    }
+
+    // Devices queues
+
+    writer.family("kserver_device_queue_depth", "gauge",
+                  "Number of commands waiting for or being executed by a device");
+
+    for (device_id dev = 1; dev < device_num; dev++)
+        writer.sample("kserver_device_queue_depth{device=\"%s\"} %" PRIu64 "\n",
+                      devices_names[dev].data(), dev_manager.queue_depth.depth(dev));
+
+    writer.family("kserver_coalesced_requests_total", "counter",
+                  "Number of requests served by an identical call in flight");
+    writer.sample("kserver_coalesced_requests_total %" PRIu64 "\n",
+                  dev_manager.flights.coalesced_num());
+
+    writer.family("kserver_polling_allocations_total", "counter",
+                  "Number of snapshots allocated while a session sent the previous one");
+    writer.sample("kserver_polling_allocations_total %" PRIu64 "\n",
+                  polling.allocated_num());
+
+    writer.family("kserver_stream_blocks_total", "counter",
+                  "Number of blocks pushed by the devices on the streams");
+
+    dev_manager.streams.for_each_stream([&](const Stream& stream) {
+        writer.sample("kserver_stream_blocks_total{device=\"%s\",stream=\"%u\"} %" PRIu64 "\n",
+                      devices_names[stream.dev].data(), stream.index, stream.pushed_num());
+    });
+
+    writer.family("kserver_stream_dropped_total", "counter",
+                  "Number of blocks dropped because the stream ring was full");
+
+    dev_manager.streams.for_each_stream([&](const Stream& stream) {
+        writer.sample("kserver_stream_dropped_total{device=\"%s\",stream=\"%u\"} %" PRIu64 "\n",
+                      devices_names[stream.dev].data(), stream.index, stream.dropped_num());
+    });
+
+    // PubSub
+
+    writer.family("kserver_pubsub_sent_total", "counter",
+                  "Number of messages sent to the subscribers");
+
+    for (uint16_t channel = 0; channel < PubSub::channels_count; channel++)
+        writer.sample("kserver_pubsub_sent_total{channel=\"%s\"} %" PRIu64 "\n",
+                      pubsub_channels_names[channel], syslog.pubsub.sent_num(channel));
+
+    writer.family("kserver_pubsub_dropped_total", "counter",
+                  "Number of messages that could not be sent to a subscriber");
+
+    for (uint16_t channel = 0; channel < PubSub::channels_count; channel++)
+        writer.sample("kserver_pubsub_dropped_total{channel=\"%s\"} %" PRIu64 "\n",
+                      pubsub_channels_names[channel], syslog.pubsub.dropped_num(channel));
+
+    // Allocator
+
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#  if __GLIBC_PREREQ(2, 33)
+    const auto mem = mallinfo2();
+#  else
+    const auto mem = mallinfo();
+#  endif
+
+    const auto malloc_gauge = [&](const char *name, const char *help, uint64_t value) {
+        writer.family(name, "gauge", help);
+        writer.sample("%s %" PRIu64 "\n", name, value);
+    };
+
+    malloc_gauge("kserver_malloc_arena_bytes",
+                 "Memory allocated from the system by malloc (non-mmapped)",
+                 static_cast<uint64_t>(mem.arena));
+    malloc_gauge("kserver_malloc_mmap_bytes",
+                 "Memory allocated by malloc with mmap",
+                 static_cast<uint64_t>(mem.hblkhd));
+    malloc_gauge("kserver_malloc_used_bytes",
+                 "Memory in use in the malloc arenas",
+                 static_cast<uint64_t>(mem.uordblks));
+    malloc_gauge("kserver_malloc_free_bytes",
+                 "Free memory in the malloc arenas",
+                 static_cast<uint64_t>(mem.fordblks));
+#endif
+
+    return out;
+}
+
+} // namespace kserver
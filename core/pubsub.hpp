@@ -17,6 +17,7 @@
 #endif
 
 #include "kserver_defs.hpp"
+#include "counters.hpp"
 #include "signal_handler.hpp"
 
 namespace kserver {
@@ -68,6 +69,7 @@ struct Subscribers
 };
 
 class SessionManager;
+struct Snapshot;
 
 class PubSub
 {
@@ -82,11 +84,17 @@ class PubSub
 
     // Session sid subscribes to a channel
     int subscribe(uint16_t channel, SessID sid) {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(subscribers_mutex);
+#endif
         return subscribers.subscribe(channel, sid);
     }
 
     // Must be called when a session is closed
     void unsubscribe(SessID sid) {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(subscribers_mutex);
+#endif
         subscribers.unsubscribe(sid);
     }
 
@@ -100,10 +108,18 @@ class PubSub
     template<uint16_t channel, uint16_t event, typename... Args>
     int emit(const char *str, Args&&... args);
 
+    // Push the snapshot of a polled operation (see polling.hpp).
+    // The message is the response of the operation.
+    // Can be called from outside the sessions threads.
+    template<uint16_t channel>
+    int emit_snapshot(const Snapshot& snapshot);
+
     enum Channels {
         SERVER_CHANNEL,        ///< Server events
         SYSLOG_CHANNEL,        ///< Syslog events
         DEVICES_CHANNEL,       ///< Device notifications
+        POLLING_CHANNEL,       ///< Snapshots of the polled operations
+        STREAMS_CHANNEL,       ///< Blocks of the opened streams (KServer::OPEN_STREAM)
         channels_count
     };
 
@@ -113,13 +129,39 @@ class PubSub
         server_chan_events_num
     };
 
+    /// Number of messages sent on a channel
+    uint64_t sent_num(uint16_t channel) const {
+        return sent[channel].load();
+    }
+
+    /// Number of messages that failed to be sent on a channel
+    uint64_t dropped_num(uint16_t channel) const {
+        return dropped[channel].load();
+    }
+
   private:
     SessionManager& session_manager;
     SignalHandler& sig_handler;
     Subscribers<channels_count> subscribers;
 
+#if KSERVER_HAS_THREADS
+    std::mutex subscribers_mutex;
+#endif
+
+    std::array<ShardedCounter, channels_count> sent;
+    std::array<ShardedCounter, channels_count> dropped;
+
+    void count_message(uint16_t channel, int err) {
+        if (unlikely(err < 0))
+            dropped[channel].add();
+        else
+            sent[channel].add();
+    }
+
     static constexpr int32_t FMT_BUFF_LEN = 1024;
     char fmt_buffer[FMT_BUFF_LEN];
+
+friend class StreamManager;
 };
 
 } // namespace kserver
@@ -5,6 +5,8 @@
 
 #include "pubsub.hpp"
 #include "kserver_session.hpp"
+#include "session_manager.hpp"
+#include "polling.hpp"
 
 namespace kserver {
 
@@ -23,6 +25,8 @@ inline int PubSub::emit(Args&&... args)
         int r = session_manager.get_session(sid)
                     .template send<channel, event>(std::forward<Args>(args)...);
 
+        count_message(channel, r);
+
         if (unlikely(r < 0))
             err = r;
     }
@@ -59,6 +63,8 @@ inline int PubSub::emit(const char *str, Args&&... args)
             int r = session_manager.get_session(sid)
                         .template send<channel, event>(fmt_buffer);
 
+            count_message(channel, r);
+
             if (unlikely(r < 0))
                 err = r;
         }
@@ -67,6 +73,60 @@ inline int PubSub::emit(const char *str, Args&&... args)
     return err;
 }
 
+template<uint16_t channel>
+inline int PubSub::emit_snapshot(const Snapshot& snapshot)
+{
+    static_assert(channel < channels_count, "Invalid channel");
+
+    // We don't emit if connections are closed
+    if (sig_handler.interrupt())
+        return 0;
+
+    std::vector<SessID> sids;
+
+    {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(subscribers_mutex);
+#endif
+        sids = subscribers.get<channel>();
+    }
+
+    if (sids.empty())
+        return 0;
+
+    // The referenced sessions cannot be deleted while they are sent the
+    // snapshot. The messages are written out of the session manager lock.
+    SessionRefs refs;
+    session_manager.get_sessions(sids, refs);
+
+    if (refs.empty())
+        return 0;
+
+    // An ID may have been reused by a session not subscribed to the channel
+    {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(subscribers_mutex);
+#endif
+        sids = subscribers.get<channel>();
+    }
+
+    int err = 0;
+
+    refs.for_each([&](SessID sid, SessionAbstract& session) {
+        if (std::find(sids.begin(), sids.end(), sid) == sids.end())
+            return;
+
+        // Dropped if the client doesn't read fast enough
+        const int r = session.send_snapshot(snapshot);
+        count_message(channel, r);
+
+        if (unlikely(r < 0))
+            err = r;
+    });
+
+    return err;
+}
+
 } // namespace kserver
 
 #endif // __PUBSUB_TPP__
@@ -0,0 +1,271 @@
+/// Reduction of the numeric containers of the responses
+///
+/// A session can attach a reduction stage to any operation returning
+/// a std::vector or a std::array of numbers (KServer::SET_REDUCTION).
+/// The container is reduced before serialization and the response
+/// carries instead:
+/// - DECIMATE: std::vector<T>, one element every ceil(n / points)
+/// - ENVELOPE: std::vector<T>, minimum and maximum of each bucket (interleaved)
+/// - MEAN: std::vector<double>, mean of each bucket
+/// - HISTOGRAM: double min, double max and std::vector<uint32_t>
+///   with the counts of the points bins of equal width between min and max
+///
+/// The buckets are min(n, points) contiguous ranges of the container,
+/// of lengths differing by one at most.
+/// The float minimum/maximum kernel runs 4 floats at a time with SSE
+/// or NEON, and the float sums with SSE2.
+///
+/// (c) Koheron
+
+#ifndef __REDUCTIONS_HPP__
+#define __REDUCTIONS_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace kserver {
+
+namespace reductions {
+
+enum Reduction : uint32_t {
+    NONE = 0,
+    DECIMATE = 1,
+    ENVELOPE = 2,
+    MEAN = 3,
+    HISTOGRAM = 4,
+    reductions_num
+};
+
+struct Stage {
+    Reduction reduction;
+    uint32_t points;     ///< Number of output points, buckets or bins
+};
+
+// Containers that can be reduced
+
+template<typename T>
+struct is_numeric_container : std::false_type {};
+
+template<typename T, typename Alloc>
+struct is_numeric_container<std::vector<T, Alloc>>
+: std::integral_constant<bool, std::is_arithmetic<T>::value && !std::is_same<T, bool>::value> {};
+
+template<typename T, size_t N>
+struct is_numeric_container<std::array<T, N>>
+: std::integral_constant<bool, std::is_arithmetic<T>::value && !std::is_same<T, bool>::value> {};
+
+template<typename T>
+constexpr bool is_numeric_container_v = is_numeric_container<T>::value;
+
+/// Output buffer of the reductions, reused between responses
+template<typename T>
+inline std::vector<T>& buffer()
+{
+    static thread_local std::vector<T> buf;
+    return buf;
+}
+
+// ------------------------------------------
+// Kernels
+// ------------------------------------------
+
+/// Minimum and maximum of n > 0 elements
+template<typename T>
+inline void minmax(const T *data, size_t n, T& min, T& max)
+{
+    T lo = data[0];
+    T hi = data[0];
+
+    for (size_t i = 1; i < n; i++) {
+        lo = std::min(lo, data[i]);
+        hi = std::max(hi, data[i]);
+    }
+
+    min = lo;
+    max = hi;
+}
+
+// The compiler vectorizes the integer loop, but not the floating
+// point one (std::min is not commutative with NaNs).
+// NaNs are ignored, except in the first 4 elements.
+#if defined(__SSE2__) || defined(__ARM_NEON)
+template<>
+inline void minmax<float>(const float *data, size_t n, float& min, float& max)
+{
+    const size_t vec_end = n - n % 4;
+    size_t i = 0;
+    float lo = data[0];
+    float hi = data[0];
+
+    if (vec_end > 0) {
+#if defined(__SSE2__)
+        __m128 vlo = _mm_loadu_ps(data);
+        __m128 vhi = vlo;
+
+        for (i = 4; i < vec_end; i += 4) {
+            const __m128 x = _mm_loadu_ps(data + i);
+            vlo = _mm_min_ps(x, vlo);
+            vhi = _mm_max_ps(x, vhi);
+        }
+
+        float tmp[4];
+        _mm_storeu_ps(tmp, vlo);
+        lo = *std::min_element(tmp, tmp + 4);
+        _mm_storeu_ps(tmp, vhi);
+        hi = *std::max_element(tmp, tmp + 4);
+#else
+        float32x4_t vlo = vld1q_f32(data);
+        float32x4_t vhi = vlo;
+
+        for (i = 4; i < vec_end; i += 4) {
+            const float32x4_t x = vld1q_f32(data + i);
+            vlo = vminq_f32(vlo, x);
+            vhi = vmaxq_f32(vhi, x);
+        }
+
+        float tmp[4];
+        vst1q_f32(tmp, vlo);
+        lo = *std::min_element(tmp, tmp + 4);
+        vst1q_f32(tmp, vhi);
+        hi = *std::max_element(tmp, tmp + 4);
+#endif
+    }
+
+    for (; i < n; i++) {
+        lo = std::min(lo, data[i]);
+        hi = std::max(hi, data[i]);
+    }
+
+    min = lo;
+    max = hi;
+}
+#endif // __SSE2__ || __ARM_NEON
+
+/// Sum of n elements (integers summed exactly on 64 bits)
+template<typename T>
+inline double sum(const T *data, size_t n)
+{
+    using Acc = std::conditional_t<std::is_floating_point<T>::value, double,
+                    std::conditional_t<std::is_signed<T>::value, int64_t, uint64_t>>;
+    Acc acc = 0;
+
+    for (size_t i = 0; i < n; i++)
+        acc += data[i];
+
+    return static_cast<double>(acc);
+}
+
+#if defined(__SSE2__)
+// Floats are accumulated as doubles, two by two
+template<>
+inline double sum<float>(const float *data, size_t n)
+{
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_loadu_ps(data + i);
+        acc0 = _mm_add_pd(acc0, _mm_cvtps_pd(x));
+        acc1 = _mm_add_pd(acc1, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+    }
+
+    double tmp[2];
+    _mm_storeu_pd(tmp, _mm_add_pd(acc0, acc1));
+    double acc = tmp[0] + tmp[1];
+
+    for (; i < n; i++)
+        acc += data[i];
+
+    return acc;
+}
+#endif
+
+// ------------------------------------------
+// Reductions
+// ------------------------------------------
+
+/// First element of the bucket k among buckets
+inline size_t bucket_begin(size_t n, size_t buckets, size_t k)
+{
+    // No overflow: buckets <= KSERVER_REDUCTION_MAX_POINTS
+    return static_cast<size_t>(static_cast<uint64_t>(n) * k / buckets);
+}
+
+template<typename T>
+inline void decimate(const T *data, size_t n, size_t points, std::vector<T>& out)
+{
+    const size_t stride = std::max<size_t>(1, (n + points - 1) / points);
+    out.resize((n + stride - 1) / stride);
+
+    for (size_t i = 0; i < out.size(); i++)
+        out[i] = data[i * stride];
+}
+
+template<typename T>
+inline void envelope(const T *data, size_t n, size_t points, std::vector<T>& out)
+{
+    const size_t buckets = std::min(n, points);
+    out.resize(2 * buckets);
+
+    for (size_t k = 0; k < buckets; k++) {
+        const size_t begin = bucket_begin(n, buckets, k);
+        minmax(data + begin, bucket_begin(n, buckets, k + 1) - begin, out[2 * k], out[2 * k + 1]);
+    }
+}
+
+template<typename T>
+inline void mean(const T *data, size_t n, size_t points, std::vector<double>& out)
+{
+    const size_t buckets = std::min(n, points);
+    out.resize(buckets);
+
+    for (size_t k = 0; k < buckets; k++) {
+        const size_t begin = bucket_begin(n, buckets, k);
+        const size_t len = bucket_begin(n, buckets, k + 1) - begin;
+        out[k] = sum(data + begin, len) / len;
+    }
+}
+
+template<typename T>
+inline void histogram(const T *data, size_t n, size_t points,
+                      double& min, double& max, std::vector<uint32_t>& out)
+{
+    out.assign(points, 0);
+    min = max = 0;
+
+    if (n == 0)
+        return;
+
+    T lo, hi;
+    minmax(data, n, lo, hi);
+    min = lo;
+    max = hi;
+    const double scale = (max > min) ? points / (max - min) : 0.0;
+    const double last_bin = points - 1;
+
+    for (size_t i = 0; i < n; i++) {
+        const double bin = (data[i] - min) * scale;
+
+        // NaNs are not counted. The bin is converted with a signed
+        // integer: the conversion to unsigned is slower on x86.
+        if (bin >= 0)
+            out[static_cast<int32_t>(std::min(bin, last_bin))]++;
+    }
+}
+
+} // namespace reductions
+
+} // namespace kserver
+
+#endif // __REDUCTIONS_HPP__
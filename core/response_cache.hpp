@@ -0,0 +1,194 @@
+/// Cache of the responses of the idempotent operations
+///
+/// The operations annotated with @cache in the device header (see devgen)
+/// are memoized: the response frame is stored per (device, operation,
+/// arguments) and sent again to the sessions of the same byte order
+/// without calling the device, nor taking its lock.
+///
+///     /// @cache
+///     const std::array<float, 64>& get_calibration(uint32_t channel);
+///
+///     /// @cache 500
+///     uint64_t get_temperature();
+///
+/// The optional integer is a time to live in milliseconds.
+/// The devices invalidate their cached responses when the state returned
+/// changes (ContextBase::invalidate_cache). GET_CMDS and GET_VERSION
+/// are cached for the lifetime of the server.
+///
+/// The sessions with response codecs (KServer::SET_RESPONSE_CODECS)
+/// or a reduction stage on the operation (KServer::SET_REDUCTION)
+/// bypass the cache.
+///
+/// (c) Koheron
+
+#ifndef __RESPONSE_CACHE_HPP__
+#define __RESPONSE_CACHE_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <initializer_list>
+#include <unordered_map>
+#include <type_traits>
+#if KSERVER_HAS_THREADS
+#include <mutex>
+#endif
+
+#include "kserver_defs.hpp"
+#include "clock.hpp"
+
+namespace kserver {
+
+class ResponseCache
+{
+  public:
+    using Frame = std::shared_ptr<const std::vector<unsigned char>>;
+
+    // ------------------------------------------
+    // Keys
+    // ------------------------------------------
+
+    /// Key of the arguments of a call
+    template<typename... Args>
+    static std::string make_key(const Args&... args) {
+        std::string key;
+        (void)std::initializer_list<int>{(append_key(key, args), 0)...};
+        return key;
+    }
+
+    // ------------------------------------------
+    // Entries
+    // ------------------------------------------
+
+    /// Frame cached for the key of the operation op = (class_id << 16) | func_id,
+    /// or nullptr if none or expired
+    Frame find(uint32_t op, const std::string& key) {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(mutex);
+#endif
+        const auto op_it = entries.find(op);
+
+        if (op_it == entries.end())
+            return nullptr;
+
+        const auto it = op_it->second.find(key);
+
+        if (it == op_it->second.end())
+            return nullptr;
+
+        if (it->second.expiry_ns != 0 && clock_ns() >= it->second.expiry_ns) {
+            op_it->second.erase(it);
+            return nullptr;
+        }
+
+        return it->second.frame;
+    }
+
+    /// To be read before calling the device on a miss (see store)
+    uint64_t generation() const {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(mutex);
+#endif
+        return invalidations;
+    }
+
+    /// Store the frame, unless an invalidation occured since generation.
+    /// ttl_ns = 0 for no expiry.
+    void store(uint32_t op, std::string&& key, Frame frame,
+               uint64_t ttl_ns, uint64_t generation) {
+        const uint64_t expiry_ns = (ttl_ns == 0) ? 0 : clock_ns() + ttl_ns;
+
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+        if (generation != invalidations)
+            return;
+
+        auto& op_entries = entries[op];
+
+        // The entries of an operation are bounded:
+        // start again when they are all used.
+        if (op_entries.size() >= KSERVER_RESPONSE_CACHE_MAX_ENTRIES)
+            op_entries.clear();
+
+        op_entries[std::move(key)] = {std::move(frame), expiry_ns};
+    }
+
+    // ------------------------------------------
+    // Invalidation
+    // ------------------------------------------
+
+    /// Invalidate the responses of an operation
+    void invalidate(uint32_t op) {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(mutex);
+#endif
+        invalidations++;
+        entries.erase(op);
+    }
+
+    /// Invalidate the responses of all the operations of a device
+    void invalidate_device(uint16_t dev) {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(mutex);
+#endif
+        invalidations++;
+
+        for (auto it = entries.begin(); it != entries.end();) {
+            if ((it->first >> 16) == dev)
+                it = entries.erase(it);
+            else
+                ++it;
+        }
+    }
+
+  private:
+    struct Entry {
+        Frame frame;
+        uint64_t expiry_ns; ///< 0 if the entry does not expire
+    };
+
+    // Entries per operation, then per arguments key
+    std::unordered_map<uint32_t, std::unordered_map<std::string, Entry>> entries;
+    uint64_t invalidations = 0;
+
+#if KSERVER_HAS_THREADS
+    mutable std::mutex mutex;
+#endif
+
+    // The arguments are appended with their bytes,
+    // the containers preceded by their length.
+
+    template<typename T>
+    static std::enable_if_t<std::is_arithmetic<T>::value>
+    append_key(std::string& key, const T& value) {
+        key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T, size_t N>
+    static void append_key(std::string& key, const std::array<T, N>& arr) {
+        static_assert(std::is_arithmetic<T>::value, "Invalid cached operation argument");
+        key.append(reinterpret_cast<const char*>(arr.data()), N * sizeof(T));
+    }
+
+    template<typename T>
+    static void append_key(std::string& key, const std::vector<T>& vec) {
+        static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                      "Invalid cached operation argument");
+        append_key(key, static_cast<uint64_t>(vec.size()));
+        key.append(reinterpret_cast<const char*>(vec.data()), vec.size() * sizeof(T));
+    }
+
+    static void append_key(std::string& key, const std::string& str) {
+        append_key(key, static_cast<uint64_t>(str.size()));
+        key.append(str);
+    }
+};
+
+} // namespace kserver
+
+#endif // __RESPONSE_CACHE_HPP__
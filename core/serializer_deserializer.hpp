@@ -5,11 +5,16 @@
 #ifndef __SERIALIZER_DESERIALIZER_HPP__
 #define __SERIALIZER_DESERIALIZER_HPP__
 
+#include <cstdint>
 #include <cstring>
 #include <tuple>
 #include <array>
 #include <vector>
 #include <string>
+#include <utility>
+#include <type_traits>
+#include <initializer_list>
+#include <limits>
 
 namespace kserver {
 
@@ -64,161 +69,181 @@ inline void append<int8_t>(unsigned char *buff, int8_t value)
     buff[0] = reinterpret_cast<uint8_t&>(value);
 }
 
-// uint16_t
+// Multi-bytes scalars are transmitted in big-endian.
+// They are loaded with a single (unaligned) memory access
+// and swapped with __builtin_bswap (bswap/movbe on x86, rev on ARM).
 
-template<> constexpr size_t size_of<uint16_t> = 2;
-
-template<>
-inline uint16_t extract<uint16_t>(const char *buff)
-{
-    return (unsigned char)buff[1] + ((unsigned char)buff[0] << 8);
-}
-
-template<>
-inline void append<uint16_t>(unsigned char *buff, uint16_t value)
-{
-    buff[0] = (value >> 8) & 0xff;
-    buff[1] = value & 0xff;
-}
+namespace detail {
+    template<size_t N> struct uint_of_size;
+    template<> struct uint_of_size<2> {using type = uint16_t;};
+    template<> struct uint_of_size<4> {using type = uint32_t;};
+    template<> struct uint_of_size<8> {using type = uint64_t;};
 
-// int16_t
+    inline uint16_t bswap(uint16_t x) {return __builtin_bswap16(x);}
+    inline uint32_t bswap(uint32_t x) {return __builtin_bswap32(x);}
+    inline uint64_t bswap(uint64_t x) {return __builtin_bswap64(x);}
 
-template<> constexpr size_t size_of<int16_t> = 2;
+    template<typename T>
+    inline T to_big_endian(T x)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return x;
+#else
+        return bswap(x);
+#endif
+    }
 
-template<>
-inline int16_t extract<int16_t>(const char *buff)
-{
-    uint16_t tmp = extract<uint16_t>(buff);
-    return *reinterpret_cast<int16_t*>(&tmp);
-}
+    template<typename Tp>
+    inline Tp load_big_endian(const char *buff)
+    {
+        using U = typename uint_of_size<sizeof(Tp)>::type;
+        U u;
+        std::memcpy(&u, buff, sizeof(U));
+        return pseudo_cast<Tp, U>(to_big_endian(u));
+    }
 
-template<>
-inline void append<int16_t>(unsigned char *buff, int16_t value)
-{
-    append<uint16_t>(buff, reinterpret_cast<uint16_t&>(value));
+    template<typename Tp>
+    inline void store_big_endian(unsigned char *buff, Tp value)
+    {
+        using U = typename uint_of_size<sizeof(Tp)>::type;
+        const U u = to_big_endian(pseudo_cast<U, Tp>(value));
+        std::memcpy(buff, &u, sizeof(U));
+    }
 }
 
-// uint32_t
+#define KSERVER_BIG_ENDIAN_SCALAR(type)                         \
+    template<> constexpr size_t size_of<type> = sizeof(type);   \
+                                                                \
+    template<>                                                  \
+    inline type extract<type>(const char *buff)                 \
+    {                                                           \
+        return detail::load_big_endian<type>(buff);             \
+    }                                                           \
+                                                                \
+    template<>                                                  \
+    inline void append<type>(unsigned char *buff, type value)   \
+    {                                                           \
+        detail::store_big_endian<type>(buff, value);            \
+    }
 
-template<> constexpr size_t size_of<uint32_t> = 4;
+KSERVER_BIG_ENDIAN_SCALAR(uint16_t)
+KSERVER_BIG_ENDIAN_SCALAR(int16_t)
+KSERVER_BIG_ENDIAN_SCALAR(uint32_t)
+KSERVER_BIG_ENDIAN_SCALAR(int32_t)
+KSERVER_BIG_ENDIAN_SCALAR(uint64_t)
+KSERVER_BIG_ENDIAN_SCALAR(int64_t)
+KSERVER_BIG_ENDIAN_SCALAR(float)
+KSERVER_BIG_ENDIAN_SCALAR(double)
 
-template<>
-inline uint32_t extract<uint32_t>(const char *buff)
-{
-    return (unsigned char)buff[3] + ((unsigned char)buff[2] << 8) 
-           + ((unsigned char)buff[1] << 16) + ((unsigned char)buff[0] << 24);
-}
+#undef KSERVER_BIG_ENDIAN_SCALAR
 
-template<>
-inline void append<uint32_t>(unsigned char *buff, uint32_t value)
-{
-    buff[0] = (value >> 24) & 0xff;
-    buff[1] = (value >> 16) & 0xff;
-    buff[2] = (value >>  8) & 0xff;
-    buff[3] = value & 0xff;
-}
+static_assert(size_of<float> == size_of<uint32_t>, "Invalid float size");
+static_assert(size_of<double> == size_of<uint64_t>, "Invalid double size");
 
-// int32_t
+// bool
 
-template<> constexpr size_t size_of<int32_t> = 4;
+template<> constexpr size_t size_of<bool> = 1;
 
 template<>
-inline int32_t extract<int32_t>(const char *buff)
+inline bool extract<bool>(const char *buff)
 {
-    uint32_t tmp = extract<uint32_t>(buff);
-    return *reinterpret_cast<int32_t*>(&tmp);
+    return (unsigned char)buff[0] == 1;
 }
 
 template<>
-inline void append<int32_t>(unsigned char *buff, int32_t value)
+inline void append<bool>(unsigned char *buff, bool value)
 {
-    append<uint32_t>(buff, reinterpret_cast<uint32_t&>(value));
+    value ? buff[0] = 1 : buff[0] = 0;
 }
 
-// uint64_t
+// ------------------------
+// Byte order
+// ------------------------
 
-template<> constexpr size_t size_of<uint64_t> = 8;
+// Scalars are transmitted in network byte order (big-endian) by default.
+// A session can switch to the host byte order (KServer::SET_BYTE_ORDER)
+// when the client has the same endianness as the server.
+// Command and response headers are always in network byte order.
 
-template<>
-inline uint64_t extract<uint64_t>(const char *buff)
+enum class ByteOrder {NETWORK, NATIVE};
+
+template<typename Tp>
+inline Tp extract_native(const char *buff)
 {
-    uint32_t u1 = extract<uint32_t>(buff);
-    uint32_t u2 = extract<uint32_t>(buff + size_of<uint32_t>);
-    return static_cast<uint64_t>(u2) + (static_cast<uint64_t>(u1) << 32);
+    Tp value;
+    std::memcpy(&value, buff, sizeof(Tp));
+    return value;
 }
 
 template<>
-inline void append<uint64_t>(unsigned char *buff, uint64_t value)
+inline bool extract_native<bool>(const char *buff)
 {
-    append<uint32_t>(buff, (value >> 32));
-    append<uint32_t>(buff + size_of<uint32_t>, value);
+    return extract<bool>(buff);
 }
 
-// int64_t
-
-template<> constexpr size_t size_of<int64_t> = 8;
-
-template<>
-inline int64_t extract<int64_t>(const char *buff)
+template<typename Tp>
+inline void append_native(unsigned char *buff, Tp value)
 {
-    uint64_t tmp = extract<uint64_t>(buff);
-    return *reinterpret_cast<int64_t*>(&tmp);
+    std::memcpy(buff, &value, sizeof(Tp));
 }
 
 template<>
-inline void append<int64_t>(unsigned char *buff, int64_t value)
+inline void append_native<bool>(unsigned char *buff, bool value)
 {
-    append<uint64_t>(buff, reinterpret_cast<uint64_t&>(value));
+    append<bool>(buff, value);
 }
 
-// float
+namespace detail {
+    template<ByteOrder order> struct ScalarCodec;
 
-template<> constexpr size_t size_of<float> = size_of<uint32_t>;
-static_assert(sizeof(float) == size_of<float>, "Invalid float size");
+    template<>
+    struct ScalarCodec<ByteOrder::NETWORK> {
+        template<typename Tp>
+        static Tp extract(const char *buff) {return kserver::extract<Tp>(buff);}
 
-template<>
-inline float extract<float>(const char *buff)
-{
-    return pseudo_cast<float, uint32_t>(extract<uint32_t>(buff));
-}
+        template<typename Tp>
+        static void append(unsigned char *buff, Tp value) {kserver::append<Tp>(buff, value);}
+    };
 
-template<>
-inline void append<float>(unsigned char *buff, float value)
-{
-    append<uint32_t>(buff, pseudo_cast<uint32_t, float>(value));
+    template<>
+    struct ScalarCodec<ByteOrder::NATIVE> {
+        template<typename Tp>
+        static Tp extract(const char *buff) {return extract_native<Tp>(buff);}
+
+        template<typename Tp>
+        static void append(unsigned char *buff, Tp value) {append_native<Tp>(buff, value);}
+    };
 }
 
-// double
+// ------------------------
+// Scalar packs
+// ------------------------
 
-template<> constexpr size_t size_of<double> = size_of<uint64_t>;
-static_assert(sizeof(double) == size_of<double>, "Invalid double size");
+// The layout of a pack of scalars Tp... is known at compile time:
+// each scalar is decoded from (or encoded to) its offset directly.
 
-template<>
-inline double extract<double>(const char *buff)
-{
-    return pseudo_cast<double, uint64_t>(extract<uint64_t>(buff));
-}
-
-template<>
-inline void append<double>(unsigned char *buff, double value)
-{
-    append<uint64_t>(buff, pseudo_cast<uint64_t, double>(value));
-}
+namespace detail {
+    // Offset of the I-th scalar in the pack
+    template<typename... Tp>
+    constexpr size_t pack_offset(size_t I)
+    {
+        constexpr size_t sizes[] = {0, size_of<Tp>...};
+        size_t offset = 0;
 
-// bool
+        for (size_t i = 1; i <= I; i++)
+            offset += sizes[i];
 
-template<> constexpr size_t size_of<bool> = 1;
+        return offset;
+    }
 
-template<>
-inline bool extract<bool>(const char *buff)
-{
-    return (unsigned char)buff[0] == 1;
+    template<size_t I, typename... Tp>
+    constexpr size_t pack_offset_v = pack_offset<Tp...>(I);
 }
 
-template<>
-inline void append<bool>(unsigned char *buff, bool value)
+template<typename... Tp>
+constexpr size_t required_buffer_size()
 {
-    value ? buff[0] = 1 : buff[0] = 0;
+    return detail::pack_offset<Tp...>(sizeof...(Tp));
 }
 
 // ------------------------
@@ -226,58 +251,25 @@ inline void append<bool>(unsigned char *buff, bool value)
 // ------------------------
 
 namespace detail {
-    template<size_t position, typename... Tp>
-    inline std::enable_if_t<0 == sizeof...(Tp), std::tuple<Tp...>>
-    deserialize(const char *buff)
+    template<ByteOrder order, size_t position, typename... Tp, size_t... I>
+    inline std::tuple<Tp...> deserialize(const char *buff, std::index_sequence<I...>)
     {
-        return std::make_tuple();
-    }
-
-    template<size_t position, typename Tp0, typename... Tp>
-    inline std::enable_if_t<0 == sizeof...(Tp), std::tuple<Tp0, Tp...>>
-    deserialize(const char *buff)
-    {
-        return std::make_tuple(extract<Tp0>(&buff[position]));
-    }
-
-    template<size_t position, typename Tp0, typename... Tp>
-    inline std::enable_if_t<0 < sizeof...(Tp), std::tuple<Tp0, Tp...>>
-    deserialize(const char *buff)
-    {
-        return std::tuple_cat(std::make_tuple(extract<Tp0>(&buff[position])),
-                              deserialize<position + size_of<Tp0>, Tp...>(buff));
-    }
-
-    // Required buffer size
-    template<typename... Tp>
-    constexpr std::enable_if_t<0 == sizeof...(Tp), size_t>
-    required_buffer_size() {
-        return 0;
-    }
-
-    template<typename Tp0, typename... Tp>
-    constexpr std::enable_if_t<0 == sizeof...(Tp), size_t>
-    required_buffer_size() {
-        return size_of<Tp0>;
-    }
-
-    template<typename Tp0, typename... Tp>
-    constexpr std::enable_if_t<0 < sizeof...(Tp), size_t>
-    required_buffer_size() {
-        return size_of<Tp0> + required_buffer_size<Tp...>();
+        using codec = ScalarCodec<order>;
+        return std::tuple<Tp...>(
+            codec::template extract<Tp>(buff + position + pack_offset_v<I, Tp...>)...);
     }
 }
 
-template<typename... Tp>
-constexpr size_t required_buffer_size()
+template<ByteOrder order, size_t position, typename... Tp>
+inline std::tuple<Tp...> deserialize(const char *buff)
 {
-    return detail::required_buffer_size<Tp...>();
+    return detail::deserialize<order, position, Tp...>(buff, std::index_sequence_for<Tp...>());
 }
 
 template<size_t position, typename... Tp>
 inline std::tuple<Tp...> deserialize(const char *buff)
 {
-    return detail::deserialize<position, Tp...>(buff);
+    return deserialize<ByteOrder::NETWORK, position, Tp...>(buff);
 }
 
 // ------------------------
@@ -285,30 +277,41 @@ inline std::tuple<Tp...> deserialize(const char *buff)
 // ------------------------
 
 namespace detail {
-    template<size_t buff_pos, size_t I, typename... Tp>
-    inline std::enable_if_t<I == sizeof...(Tp), void>
-    serialize(const std::tuple<Tp...>& t, unsigned char *buff)
-    {}
+    template<ByteOrder order, typename... Tp, size_t... I>
+    inline void serialize(const std::tuple<Tp...>& t, unsigned char *buff,
+                          std::index_sequence<I...>)
+    {
+        using codec = ScalarCodec<order>;
 
-    template<size_t buff_pos, size_t I, typename... Tp>
-    inline std::enable_if_t<I < sizeof...(Tp), void>
-    serialize(const std::tuple<Tp...>& t, unsigned char *buff)
+        (void)std::initializer_list<int>{
+            (codec::template append<Tp>(buff + pack_offset_v<I, Tp...>, std::get<I>(t)), 0)...
+        };
+    }
+
+    // Write the pack at buff
+    template<ByteOrder order, typename... Tp>
+    inline void serialize(const std::tuple<Tp...>& t, unsigned char *buff)
     {
-        using type = typename std::tuple_element_t<I, std::tuple<Tp...>>;
-        append<type>(&buff[buff_pos], std::get<I>(t));
-        serialize<buff_pos + size_of<type>, I + 1, Tp...>(t, &buff[0]);
+        serialize<order>(t, buff, std::index_sequence_for<Tp...>());
     }
 }
 
-template<typename... Tp>
+template<ByteOrder order, typename... Tp>
 inline std::array<unsigned char, required_buffer_size<Tp...>()>
 serialize(const std::tuple<Tp...>& t)
 {
     std::array<unsigned char, required_buffer_size<Tp...>()> arr;
-    detail::serialize<0, 0, Tp...>(t, arr.data());
+    detail::serialize<order, Tp...>(t, arr.data());
     return arr;
 }
 
+template<typename... Tp>
+inline std::array<unsigned char, required_buffer_size<Tp...>()>
+serialize(const std::tuple<Tp...>& t)
+{
+    return serialize<ByteOrder::NETWORK, Tp...>(t);
+}
+
 template<typename... Tp>
 inline std::array<unsigned char, required_buffer_size<Tp...>()>
 serialize(Tp... t)
@@ -320,8 +323,28 @@ serialize(Tp... t)
 // Commands serializer
 // ---------------------------
 
-template<size_t SCALAR_PACK_LEN>
+/// Container sent from its own memory instead of being
+/// copied into the command buffer
+struct DataReference {
+    size_t offset;              ///< Position of the data in the command buffer
+    const unsigned char *data;
+    size_t len;
+    size_t elem_size;           ///< Size of the container elements (bytes)
+};
+
+template<size_t SCALAR_PACK_LEN, ByteOrder order = ByteOrder::NETWORK>
 class DynamicSerializer {
+  public:
+    /// Containers of at least reference_threshold_ bytes are not
+    /// copied into the command buffer but referenced (see references()).
+    DynamicSerializer(size_t reference_threshold_ = std::numeric_limits<size_t>::max())
+    : reference_threshold(reference_threshold_)
+    {}
+
+    void set_reference_threshold(size_t reference_threshold_) {
+        reference_threshold = reference_threshold_;
+    }
+
   private:
     // Dynamic container
     // http://stackoverflow.com/questions/12042824/how-to-write-a-type-trait-is-container-or-is-vector
@@ -412,9 +435,11 @@ class DynamicSerializer {
   private:
     // Scalars
 
+    using codec = detail::ScalarCodec<order>;
+
     template<typename T>
     void append(T t) {
-        kserver::append<T>(&scal_data[scal_size], t);
+        codec::template append<T>(&scal_data[scal_size], t);
         scal_size += size_of<T>;
     }
 
@@ -439,22 +464,32 @@ class DynamicSerializer {
         command_serializer(buffer, std::forward<Tp>(args)...);
     }
 
+    // Containers data
+
+    void dump_bytes(std::vector<unsigned char>& buffer, const unsigned char *bytes,
+                    size_t n_bytes, size_t elem_size, bool can_reference) {
+        if (can_reference && n_bytes >= reference_threshold)
+            refs.push_back({buffer.size(), bytes, n_bytes, elem_size});
+        else
+            buffer.insert(buffer.end(), bytes, bytes + n_bytes);
+    }
+
     // Dynamic containers (vector, string)
 
     template<typename Container>
     void dump_container_to_buffer(std::vector<unsigned char>& buffer,
-                                  const Container& container) {
+                                  const Container& container,
+                                  bool can_reference = true) {
         static_assert(is_container_v<Container>, "");
 
         using T = typename Container::value_type;
         const uint32_t n_bytes = container.size() * sizeof(T);
         buffer.resize(buffer.size() + size_of<uint32_t>);
-        kserver::append(buffer.data() + buffer.size() - size_of<uint32_t>, n_bytes);
+        codec::template append<uint32_t>(buffer.data() + buffer.size() - size_of<uint32_t>, n_bytes);
 
-        if (n_bytes > 0) {
-            const auto bytes = reinterpret_cast<const unsigned char*>(container.data());
-            buffer.insert(buffer.end(), bytes, bytes + n_bytes);
-        }
+        if (n_bytes > 0)
+            dump_bytes(buffer, reinterpret_cast<const unsigned char*>(container.data()),
+                       n_bytes, sizeof(T), can_reference);
     }
 
     template<typename Tp0, typename... Tp>
@@ -480,10 +515,9 @@ class DynamicSerializer {
         using T = typename Array::value_type;
         constexpr auto n_bytes = std::tuple_size<Array>::value * sizeof(T);
 
-        if (n_bytes > 0) {
-            const auto bytes = reinterpret_cast<const unsigned char*>(arr.data());
-            buffer.insert(buffer.end(), bytes, bytes + n_bytes);
-        }
+        if (n_bytes > 0)
+            dump_bytes(buffer, reinterpret_cast<const unsigned char*>(arr.data()),
+                       n_bytes, sizeof(T), true);
     }
 
     template<typename Tp0, typename... Tp>
@@ -507,46 +541,73 @@ class DynamicSerializer {
     std::enable_if_t<0 == sizeof...(Tp) && is_c_string_v<Tp0>, void>
     command_serializer(std::vector<unsigned char>& buffer, Tp0&& t, Tp&&... args) {
         dump_scalar_pack(buffer);
-        dump_container_to_buffer(buffer, std::string(std::forward<Tp0>(t)));
+        dump_container_to_buffer(buffer, std::string(std::forward<Tp0>(t)), false);
     }
 
     template <typename Tp0, typename... Tp>
     std::enable_if_t<0 < sizeof...(Tp) && is_c_string_v<Tp0>, void>
     command_serializer(std::vector<unsigned char>& buffer, Tp0&& t, Tp&&... args) {
         dump_scalar_pack(buffer);
-        dump_container_to_buffer(buffer, std::string(std::forward<Tp0>(t)));
+        dump_container_to_buffer(buffer, std::string(std::forward<Tp0>(t)), false);
         command_serializer(buffer, std::forward<Tp>(args)...);
     }
 
-    // Tuples are unpacked before serialization
+    // Tuples are unpacked before serialization.
+    // They are taken by reference since their containers may be referenced.
 
     template<uint16_t class_id, uint16_t func_id,
              std::size_t... I, typename... Args>
     void call_command_serializer(std::vector<unsigned char>& buffer,
                                  std::index_sequence<I...>,
-                                 std::tuple<Args...> tup_args) {
+                                 const std::tuple<Args...>& tup_args) {
         build_command<class_id, func_id>(buffer, std::get<I>(tup_args)...);
     }
 
+    // Scalars only: the whole pack is serialized at once
+
+    template<bool...> struct bool_pack {};
+
+    template<typename... Tp>
+    static constexpr bool are_scalars_v = std::is_same<
+        bool_pack<true, is_scalar_v<Tp>...>,
+        bool_pack<is_scalar_v<Tp>..., true>
+    >::value;
+
+    static_assert(are_scalars_v<uint32_t, float, bool>, "");
+    static_assert(!are_scalars_v<uint32_t, std::vector<float>>, "");
+
+    template<typename... Tp>
+    void build_payload(std::vector<unsigned char>& buffer, std::true_type, Tp&&... args) {
+        constexpr auto header_len = kserver::required_buffer_size<uint32_t, uint16_t, uint16_t>();
+        buffer.resize(header_len + kserver::required_buffer_size<std::decay_t<Tp>...>());
+        detail::serialize<order, std::decay_t<Tp>...>(std::make_tuple(args...),
+                                                      buffer.data() + header_len);
+    }
+
+    template<typename... Tp>
+    void build_payload(std::vector<unsigned char>& buffer, std::false_type, Tp&&... args) {
+        scal_size = 0;
+        command_serializer(buffer, std::forward<Tp>(args)...);
+        dump_scalar_pack(buffer);
+    }
+
   public:
     template<uint16_t class_id, uint16_t func_id, typename Tp0, typename... Args>
     std::enable_if_t<0 <= sizeof...(Args) &&
-                     !is_std_tuple_v<
-                         typename std::remove_reference<Tp0>::type
-                     >, void>
+                     !is_std_tuple_v<std::decay_t<Tp0>>, void>
     build_command(std::vector<unsigned char>& buffer, Tp0&& arg0, Args&&... args) {
+        refs.clear();
         const auto& header = serialize(0U, class_id, func_id);
         buffer.resize(kserver::required_buffer_size<uint32_t, uint16_t, uint16_t>());
         std::move(header.begin(), header.end(), buffer.begin());
-        scal_size = 0;
-        command_serializer(buffer, std::forward<Tp0>(arg0),
-                           std::forward<Args>(args)...);
-        dump_scalar_pack(buffer);
+        build_payload(buffer, std::integral_constant<bool, are_scalars_v<Tp0, Args...>>(),
+                      std::forward<Tp0>(arg0), std::forward<Args>(args)...);
     }
 
     template<uint16_t class_id, uint16_t func_id, typename... Args>
     std::enable_if_t< 0 == sizeof...(Args), void >
     build_command(std::vector<unsigned char>& buffer, Args&&... args) {
+        refs.clear();
         const auto& header = serialize(0U, class_id, func_id);
         buffer.resize(kserver::required_buffer_size<uint32_t, uint16_t, uint16_t>());
         std::move(header.begin(), header.end(), buffer.begin());
@@ -554,14 +615,22 @@ class DynamicSerializer {
 
     template<uint16_t class_id, uint16_t func_id, typename... Args>
     void build_command(std::vector<unsigned char>& buffer,
-                       std::tuple<Args...> tup_args) {
+                       const std::tuple<Args...>& tup_args) {
         call_command_serializer<class_id, func_id>(buffer,
                 std::index_sequence_for<Args...>{}, tup_args);
     }
 
+    /// Containers referenced by the last built command, by increasing offset.
+    /// The message is the command buffer with each reference data inserted
+    /// at its offset. The data are only valid as long as the arguments of
+    /// build_command.
+    const std::vector<DataReference>& references() const {return refs;}
+
   private:
     std::array<unsigned char, SCALAR_PACK_LEN> scal_data;
     uint64_t scal_size = 0;
+    size_t reference_threshold;
+    std::vector<DataReference> refs;
 };
 
 } // namespace kserver
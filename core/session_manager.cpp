@@ -73,52 +73,96 @@ std::vector<SessID> SessionManager::get_current_ids()
     return res;
 }
 
-void SessionManager::delete_session(SessID id)
+SessionRefs::~SessionRefs()
+{
+    for (auto& ref : refs)
+        ref.second->refs_num.fetch_sub(1, std::memory_order_release);
+}
+
+void SessionManager::get_sessions(const std::vector<SessID>& ids, SessionRefs& refs)
 {
 #if KSERVER_HAS_THREADS
     std::lock_guard<std::mutex> lock(mutex);
 #endif
 
-    int sess_fd;
+    for (auto id : ids) {
+        const auto it = session_pool.find(id);
 
-    if (!is_current_id(id)) {
-        kserver.syslog.print<INFO>(
-                             "Not allocated session ID: %u\n", id);
-        return;
+        if (it != session_pool.end()) {
+            it->second->refs_num.fetch_add(1, std::memory_order_relaxed);
+            refs.refs.emplace_back(id, it->second.get());
+        }
     }
+}
 
-    // Unsubscribe from any broadcast channel
-    kserver.syslog.pubsub.unsubscribe(id);
+void SessionManager::delete_session(SessID id)
+{
+    std::unique_ptr<SessionAbstract> session;
+    int sess_fd = -1;
 
-    if (session_pool[id] != nullptr) {
-        switch (session_pool[id]->kind) {
+    {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+        if (!is_current_id(id)) {
+            kserver.syslog.print<INFO>(
+                                 "Not allocated session ID: %u\n", id);
+            return;
+        }
+
+        // Unsubscribe from any broadcast channel
+        kserver.syslog.pubsub.unsubscribe(id);
+        dev_manager.streams.close_all(id);
+
+        // The statistics are merged into the listener in the critical section
+        // removing the session from the pool: ListeningChannel::get_stats
+        // counts each session exactly once.
+        if (session_pool[id] != nullptr) {
+            switch (session_pool[id]->kind) {
 #if KSERVER_HAS_TCP
-          case TCP:
-            sess_fd = cast_to_session<TCP>(session_pool[id])->comm_fd;
-            break;
+              case TCP:
+                sess_fd = cast_to_session<TCP>(session_pool[id])->comm_fd;
+                kserver.tcp_listener.stats.add_session(cast_to_session<TCP>(session_pool[id])->get_stats());
+                break;
 #endif
 #if KSERVER_HAS_UNIX_SOCKET
-          case UNIX:
-            sess_fd = cast_to_session<UNIX>(session_pool[id])->comm_fd;
-            break;
+              case UNIX:
+                sess_fd = cast_to_session<UNIX>(session_pool[id])->comm_fd;
+                kserver.unix_listener.stats.add_session(cast_to_session<UNIX>(session_pool[id])->get_stats());
+                break;
 #endif
 #if KSERVER_HAS_WEBSOCKET
-          case WEBSOCK:
-            sess_fd = cast_to_session<WEBSOCK>(session_pool[id])->comm_fd;
-            break;
+              case WEBSOCK:
+                sess_fd = cast_to_session<WEBSOCK>(session_pool[id])->comm_fd;
+                kserver.websock_listener.stats.add_session(cast_to_session<WEBSOCK>(session_pool[id])->get_stats());
+                break;
 #endif
-          default: assert(false);
+              default: assert(false);
+            }
         }
 
-        if (shutdown(sess_fd, SHUT_RDWR) < 0)
-            kserver.syslog.print<WARNING>(
-                         "Cannot shutdown socket for session ID: %u\n", id);
-        close(sess_fd);
+        session = std::move(session_pool[id]);
+        session_pool.erase(id);
+        reusable_ids.push_back(id);
+        num_sess--;
     }
 
-    session_pool.erase(id);
-    reusable_ids.push_back(id);
-    num_sess--;
+    if (session == nullptr)
+        return;
+
+    // Out of the lock: the shutdown unblocks the threads pushing to the
+    // session, which release it before the socket is closed.
+    if (shutdown(sess_fd, SHUT_RDWR) < 0)
+        kserver.syslog.print<WARNING>(
+                     "Cannot shutdown socket for session ID: %u\n", id);
+
+#if KSERVER_HAS_THREADS
+    while (session->refs_num.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+#endif
+
+    close(sess_fd);
 }
 
 void SessionManager::delete_all()
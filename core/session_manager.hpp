@@ -24,6 +24,34 @@ template<int sock_type> class Session;
 class DeviceManager;
 class KServer;
 
+/// Sessions referenced by a thread pushing messages (polling, streams)
+///
+/// The messages are written without holding the session manager lock:
+/// delete_session waits for the references to be released before
+/// closing the socket and destroying the session.
+class SessionRefs
+{
+  public:
+    SessionRefs() {}
+    SessionRefs(const SessionRefs&) = delete;
+    SessionRefs& operator=(const SessionRefs&) = delete;
+    ~SessionRefs();
+
+    bool empty() const {return refs.empty();}
+
+    /// Call func(id, session) on each referenced session
+    template<typename Func>
+    void for_each(Func&& func) {
+        for (auto& ref : refs)
+            func(ref.first, *ref.second);
+    }
+
+  private:
+    std::vector<std::pair<SessID, SessionAbstract*>> refs;
+
+friend class SessionManager;
+};
+
 class SessionManager
 {
   public:
@@ -43,9 +71,23 @@ class SessionManager
 
     SessionAbstract& get_session(SessID id) const {return *session_pool.at(id);}
 
+    /// Reference the running sessions among ids
+    void get_sessions(const std::vector<SessID>& ids, SessionRefs& refs);
+
     void delete_session(SessID id);
     void delete_all();
 
+    /// Call func(id, session) on each running session.
+    /// Sessions cannot be created or deleted during the iteration.
+    template<typename Func>
+    void for_each_session(Func&& func);
+
+    /// Call init() then func(id, session) on each running session
+    /// in the same critical section. The sessions deleted before init
+    /// are seen by init only, those deleted after by func only.
+    template<typename Init, typename Func>
+    void for_each_session(Init&& init, Func&& func);
+
     KServer& kserver;
     DeviceManager& dev_manager;
 
@@ -91,6 +133,30 @@ SessID SessionManager::create_session(const std::shared_ptr<KServerConfig>& conf
     return new_id;
 }
 
+template<typename Func>
+void SessionManager::for_each_session(Func&& func)
+{
+#if KSERVER_HAS_THREADS
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    for (auto& sess : session_pool)
+        func(sess.first, *sess.second);
+}
+
+template<typename Init, typename Func>
+void SessionManager::for_each_session(Init&& init, Func&& func)
+{
+#if KSERVER_HAS_THREADS
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    init();
+
+    for (auto& sess : session_pool)
+        func(sess.first, *sess.second);
+}
+
 } // namespace kserver
 
 #endif //__SESSION_MANAGER_HPP__
@@ -25,7 +25,8 @@ int SignalHandler::init(KServer *kserver_)
 
     if (set_interrup_signals() < 0 ||
         set_ignore_signals()   < 0 ||
-        set_crash_signals()    < 0)
+        set_crash_signals()    < 0 ||
+        set_trace_signals()    < 0)
         return -1;
         
     return 0;
@@ -61,6 +62,34 @@ int SignalHandler::set_interrup_signals()
     return 0;
 }
 
+// Trace dump signal
+//
+// The dump itself is done by KServer::run,
+// out of the signal handler.
+
+int volatile SignalHandler::s_dump_trace = 0;
+
+void dump_trace_signal_handler(int s)
+{
+    SignalHandler::s_dump_trace = 1;
+}
+
+int SignalHandler::set_trace_signals()
+{
+    struct sigaction sig_trace_handler;
+
+    sig_trace_handler.sa_handler = dump_trace_signal_handler;
+    sigemptyset(&sig_trace_handler.sa_mask);
+    sig_trace_handler.sa_flags = SA_RESTART;
+
+    if (sigaction(SIGUSR1, &sig_trace_handler, nullptr) < 0) {
+        kserver->syslog.print<CRITICAL>("Cannot set SIGUSR1 handler\n");
+        return -1;
+    }
+
+    return 0;
+}
+
 // Ignored signals
 
 int SignalHandler::set_ignore_signals()
@@ -16,7 +16,17 @@ class SignalHandler
 
     int interrupt() const {return s_interrupted;}
 
+    /// True once after SIGUSR1 was received
+    bool dump_trace_requested() {
+        if (!s_dump_trace)
+            return false;
+
+        s_dump_trace = 0;
+        return true;
+    }
+
     static int volatile s_interrupted;
+    static int volatile s_dump_trace;
     static KServer *kserver;
 
   private:
@@ -25,6 +35,7 @@ class SignalHandler
     int set_interrup_signals();
     int set_ignore_signals();
     int set_crash_signals();
+    int set_trace_signals();
 };
 
 } // namespace kserver
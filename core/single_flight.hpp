@@ -0,0 +1,130 @@
+/// Coalescing of identical concurrent requests
+///
+/// The operations annotated with @shared in the device header (see devgen)
+/// are executed once for all the identical requests (same device, operation,
+/// arguments and byte order, see ResponseCache::make_key) received while
+/// a call is in flight.
+/// The session leading the flight calls the device; the others wait for
+/// its response frame and send it unchanged.
+///
+///     /// @shared
+///     const std::vector<uint32_t>& get_capture();
+///
+/// The leader only copies the response into a shared frame when other
+/// sessions have joined the flight. The sessions with response codecs
+/// (KServer::SET_RESPONSE_CODECS) or a reduction stage on the operation
+/// (KServer::SET_REDUCTION) neither lead nor join flights.
+///
+/// (c) Koheron
+
+#ifndef __SINGLE_FLIGHT_HPP__
+#define __SINGLE_FLIGHT_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#if KSERVER_HAS_THREADS
+#include <mutex>
+#include <condition_variable>
+#endif
+
+#include "kserver_defs.hpp"
+#include "counters.hpp"
+
+namespace kserver {
+
+class SingleFlight
+{
+  public:
+    using Frame = std::shared_ptr<const std::vector<unsigned char>>;
+
+    struct Flight {
+        Frame frame;
+        bool landed = false;
+        uint32_t followers = 0;
+    };
+
+    /// Join the flight of the key of the operation op = (class_id << 16) | func_id.
+    /// Returns the flight if the caller is a follower (see wait), else starts
+    /// a new flight led by the caller and returns nullptr (see land).
+    std::shared_ptr<Flight> join(uint32_t op, const std::string& key) {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& flight = flights[op][key];
+
+        if (flight != nullptr) {
+            flight->followers++;
+            coalesced.add();
+            return flight;
+        }
+
+        flight = std::make_shared<Flight>();
+#endif
+        return nullptr;
+    }
+
+    /// Wait for the frame of the flight
+    Frame wait(const std::shared_ptr<Flight>& flight) {
+#if KSERVER_HAS_THREADS
+        std::unique_lock<std::mutex> lock(mutex);
+        landed_cond.wait(lock, [&] { return flight->landed; });
+#endif
+        return flight->frame;
+    }
+
+    /// End the flight led by the caller: later requests start a new flight.
+    /// Returns the flight if followers wait for its frame (see publish).
+    std::shared_ptr<Flight> land(uint32_t op, const std::string& key) {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto op_it = flights.find(op);
+
+        if (op_it == flights.end())
+            return nullptr;
+
+        const auto it = op_it->second.find(key);
+
+        if (it == op_it->second.end())
+            return nullptr;
+
+        auto flight = std::move(it->second);
+        op_it->second.erase(it);
+
+        if (flight->followers > 0)
+            return flight;
+#endif
+        return nullptr;
+    }
+
+    /// Send the frame to the followers of a landed flight
+    void publish(const std::shared_ptr<Flight>& flight, Frame frame) {
+#if KSERVER_HAS_THREADS
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            flight->frame = std::move(frame);
+            flight->landed = true;
+        }
+
+        landed_cond.notify_all();
+#endif
+    }
+
+    /// Number of requests served by another in-flight call
+    uint64_t coalesced_num() const {return coalesced.load();}
+
+  private:
+#if KSERVER_HAS_THREADS
+    std::mutex mutex;
+    std::condition_variable landed_cond;
+#endif
+
+    // Flights in progress per operation, then per arguments key
+    std::unordered_map<uint32_t, std::unordered_map<std::string, std::shared_ptr<Flight>>> flights;
+    ShardedCounter coalesced;
+};
+
+} // namespace kserver
+
+#endif // __SINGLE_FLIGHT_HPP__
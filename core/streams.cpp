@@ -0,0 +1,255 @@
+/// Implementation of streams.hpp
+///
+/// (c) Koheron
+
+#include "streams.hpp"
+
+#include <cerrno>
+#include <algorithm>
+
+#if KSERVER_HAS_THREADS
+extern "C" {
+  #include <poll.h>
+  #include <unistd.h>
+  #include <sys/eventfd.h>
+}
+#endif
+
+#include "kserver.hpp"
+#include "kserver_session.hpp"
+#include "syslog.tpp"
+
+namespace kserver {
+
+StreamManager::StreamManager(KServer *kserver_)
+: kserver(kserver_)
+{
+    streams_num.store(0);
+
+#if KSERVER_HAS_THREADS
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+#endif
+}
+
+StreamManager::~StreamManager()
+{
+    stop();
+
+#if KSERVER_HAS_THREADS
+    if (wake_fd >= 0)
+        ::close(wake_fd);
+
+    if (stop_fd >= 0)
+        ::close(stop_fd);
+#endif
+}
+
+Stream* StreamManager::add(device_id dev, uint32_t block_size, uint32_t capacity)
+{
+#if KSERVER_HAS_THREADS
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    const uint32_t id = streams_num.load();
+
+    if (id >= KSERVER_MAX_STREAMS) {
+        kserver->syslog.print<ERROR>("Streams: Cannot add a stream to %s: Maximum number of streams reached\n",
+                                     devices_names[dev].data());
+        return nullptr;
+    }
+
+    if (block_size == 0 || capacity == 0) {
+        kserver->syslog.print<ERROR>("Streams: Invalid stream of %s\n", devices_names[dev].data());
+        return nullptr;
+    }
+
+    const uint16_t index = std::count_if(streams.begin(), streams.begin() + id,
+                                         [&](const auto& stream) { return stream->dev == dev; });
+
+    streams[id] = std::make_unique<Stream>(*this, id, dev, index, block_size, capacity);
+    streams_num.store(id + 1);
+
+    kserver->syslog.print<INFO>("Streams: Stream #%u is stream %u of %s (%u bytes blocks)\n",
+                                id, index, devices_names[dev].data(), block_size);
+    return streams[id].get();
+}
+
+Stream* StreamManager::find(device_id dev, uint16_t index)
+{
+    const uint32_t n = streams_num.load();
+
+    for (uint32_t i = 0; i < n; i++)
+        if (streams[i]->dev == dev && streams[i]->index == index)
+            return streams[i].get();
+
+    return nullptr;
+}
+
+int StreamManager::open(uint16_t stream_id, SessID sid)
+{
+    if (stream_id >= streams_num.load())
+        return -1;
+
+#if KSERVER_HAS_THREADS
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    auto& stream = *streams[stream_id];
+
+    if (std::find(stream.sessions.begin(), stream.sessions.end(), sid) == stream.sessions.end()) {
+        stream.sessions.push_back(sid);
+        stream.readers++;
+    }
+
+    return 0;
+}
+
+void StreamManager::close(uint16_t stream_id, SessID sid)
+{
+    if (stream_id >= streams_num.load())
+        return;
+
+#if KSERVER_HAS_THREADS
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    auto& sessions = streams[stream_id]->sessions;
+    const auto it = std::find(sessions.begin(), sessions.end(), sid);
+
+    if (it != sessions.end()) {
+        sessions.erase(it);
+        streams[stream_id]->readers--;
+    }
+}
+
+void StreamManager::close_all(SessID sid)
+{
+    const uint32_t n = streams_num.load();
+
+    for (uint32_t i = 0; i < n; i++)
+        close(i, sid);
+}
+
+void StreamManager::deliver(Stream& stream)
+{
+    StreamRing::Block block;
+
+    if (!stream.ring.front(block))
+        return;
+
+    std::vector<SessID> sids;
+
+    {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(mutex);
+#endif
+        sids = stream.sessions;
+    }
+
+    // The referenced sessions cannot be deleted while they are sent the
+    // blocks. The blocks are written out of the session manager lock.
+    SessionRefs refs;
+    kserver->session_manager.get_sessions(sids, refs);
+
+    // An ID may have been reused by a session which didn't open the stream
+    {
+#if KSERVER_HAS_THREADS
+        std::lock_guard<std::mutex> lock(mutex);
+#endif
+        sids = stream.sessions;
+    }
+
+    do {
+        refs.for_each([&](SessID sid, SessionAbstract& session) {
+            if (std::find(sids.begin(), sids.end(), sid) == sids.end())
+                return;
+
+            // A block not written to a full socket is dropped for the session
+            const int r = session.send_stream_block(stream.id, block.sequence, stream.dropped_num(),
+                                                    block.data, block.len);
+            kserver->syslog.pubsub.count_message(PubSub::STREAMS_CHANNEL, r);
+        });
+
+        stream.ring.pop();
+    } while (stream.ring.front(block));
+}
+
+#if KSERVER_HAS_THREADS
+
+void StreamManager::wake()
+{
+    // Non-blocking: the counter is read by the streams thread
+    const uint64_t one = 1;
+
+    if (write(wake_fd, &one, sizeof(one)) < 0)
+        return;
+}
+
+int StreamManager::start()
+{
+    if (wake_fd < 0 || stop_fd < 0) {
+        kserver->syslog.print<CRITICAL>("Streams: Cannot create eventfd\n");
+        return -1;
+    }
+
+    stream_thread = std::thread(&StreamManager::run, this);
+    return 0;
+}
+
+void StreamManager::run()
+{
+    std::array<struct pollfd, 2> fds = {{{wake_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}}};
+
+    while (true) {
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            kserver->syslog.print<CRITICAL>("Streams: poll failed\n");
+            return;
+        }
+
+        if (fds[1].revents & POLLIN)
+            return;
+
+        uint64_t pushed;
+
+        if (read(wake_fd, &pushed, sizeof(pushed)) < 0 && errno != EAGAIN)
+            return;
+
+        const uint32_t n = streams_num.load();
+
+        for (uint32_t i = 0; i < n; i++)
+            deliver(*streams[i]);
+    }
+}
+
+void StreamManager::stop()
+{
+    if (!stream_thread.joinable())
+        return;
+
+    const uint64_t one = 1;
+
+    if (write(stop_fd, &one, sizeof(one)) == sizeof(one))
+        stream_thread.join();
+    else
+        stream_thread.detach();
+}
+
+#else
+
+void StreamManager::wake() {}
+
+int StreamManager::start()
+{
+    kserver->syslog.print<WARNING>("Streams: The blocks are not delivered without threads\n");
+    return 0;
+}
+
+void StreamManager::stop() {}
+
+#endif // KSERVER_HAS_THREADS
+
+} // namespace kserver
@@ -0,0 +1,279 @@
+/// Streams of blocks pushed by the devices
+///
+/// A device registers its streams at construction (ContextBase::add_stream),
+/// then pushes blocks from its own acquisition thread:
+///
+///     Adc(Context& ctx)
+///     : stream(ctx.add_stream<Adc>(sizeof(samples), 64))
+///     {}
+///
+///     // Acquisition thread
+///     stream->push(samples);
+///
+/// The blocks are copied into a ring of preallocated slots. The streams
+/// thread writes them to the sessions which opened the stream
+/// (KServer::OPEN_STREAM) directly from the ring, without further copy.
+/// A block pushed while the ring is full is dropped.
+///
+/// Each block is sent as a message of the PubSub::STREAMS_CHANNEL:
+///
+/// |      RESERVED     | CHANNEL |  STREAM |  SEQUENCE  |  DROPPED  |  LENGTH   | DATA
+/// |  0 |  1 |  2 |  3 |  4 |  5 |  6 |  7 |  8 ... 15  | 16 ... 23 | 24 ... 27 | ...
+///
+/// The sequence numbers count all the pushed blocks: a dropped block leaves
+/// a gap. DROPPED is the total number of blocks dropped by the stream.
+/// A block is also dropped for a session whose socket is full: the gap is
+/// then not accounted in DROPPED.
+/// SEQUENCE, DROPPED and LENGTH follow the byte order of the session
+/// (KServer::SET_BYTE_ORDER). The data are sent as pushed.
+///
+/// (c) Koheron
+
+#ifndef __STREAMS_HPP__
+#define __STREAMS_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <type_traits>
+
+#include "kserver_defs.hpp"
+#if KSERVER_HAS_THREADS
+#include <thread>
+#include <mutex>
+#endif
+
+#include "counters.hpp"
+#include <devices_table.hpp>
+
+namespace kserver {
+
+class KServer;
+
+/// Single producer, single consumer ring of blocks
+class StreamRing
+{
+  public:
+    struct Block {
+        uint64_t sequence;
+        const unsigned char *data;
+        uint32_t len;
+    };
+
+    /// The capacity is rounded up to a power of two
+    StreamRing(uint32_t block_size_, uint32_t capacity)
+    : block_size(block_size_)
+    , mask(round_up_pow2(capacity) - 1)
+    , data(size_t(mask + 1) * block_size)
+    , meta(mask + 1)
+    {
+        head.value.store(0);
+        tail.value.store(0);
+    }
+
+    uint32_t get_block_size() const {return block_size;}
+
+    /// Copy a block into the ring (producer).
+    /// Returns false if the ring is full.
+    bool push(const unsigned char *bytes, uint32_t len, uint64_t sequence) {
+        const uint64_t h = head.value.load(std::memory_order_relaxed);
+
+        if (h - tail.value.load(std::memory_order_acquire) > mask)
+            return false;
+
+        const size_t slot = h & mask;
+        std::memcpy(&data[slot * block_size], bytes, len);
+        meta[slot] = {sequence, len};
+        head.value.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Oldest block of the ring (consumer).
+    /// Returns false if the ring is empty.
+    bool front(Block& block) const {
+        const uint64_t t = tail.value.load(std::memory_order_relaxed);
+
+        if (t == head.value.load(std::memory_order_acquire))
+            return false;
+
+        const size_t slot = t & mask;
+        block = {meta[slot].sequence, &data[slot * block_size], meta[slot].len};
+        return true;
+    }
+
+    /// Release the oldest block to the producer (consumer)
+    void pop() {
+        tail.value.store(tail.value.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_release);
+    }
+
+  private:
+    struct BlockMeta {
+        uint64_t sequence;
+        uint32_t len;
+    };
+
+    // Padding rather than alignas (see ShardedCounter):
+    // the producer and the consumer index are on distinct cache lines.
+    struct Index {
+        std::atomic<uint64_t> value;
+        char padding[KSERVER_CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+    };
+
+    const uint32_t block_size;
+    const uint64_t mask;
+    std::vector<unsigned char> data;
+    std::vector<BlockMeta> meta;
+
+    Index head; ///< Written by the producer
+    Index tail; ///< Written by the consumer
+
+    static uint32_t round_up_pow2(uint32_t n) {
+        uint32_t pow2 = 1;
+
+        while (pow2 < n)
+            pow2 <<= 1;
+
+        return pow2;
+    }
+};
+
+class StreamManager;
+
+/// Stream of a device
+class Stream
+{
+  public:
+    Stream(StreamManager& manager_, uint16_t id_, device_id dev_, uint16_t index_,
+           uint32_t block_size, uint32_t capacity)
+    : id(id_)
+    , dev(dev_)
+    , index(index_)
+    , manager(manager_)
+    , ring(block_size, capacity)
+    {
+        readers.store(0);
+    }
+
+    const uint16_t id;    ///< Stream id in the messages
+    const device_id dev;  ///< Device of the stream
+    const uint16_t index; ///< Index of the stream in its device
+
+    /// Push a block. To be called from a single thread.
+    /// Returns false if the block is dropped.
+    bool push(const void *bytes, uint32_t len);
+
+    template<typename T, size_t N>
+    bool push(const std::array<T, N>& arr) {
+        static_assert(std::is_arithmetic<T>::value, "Invalid stream block type");
+        return push(arr.data(), N * sizeof(T));
+    }
+
+    template<typename T>
+    bool push(const std::vector<T>& vec) {
+        static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                      "Invalid stream block type");
+        return push(vec.data(), vec.size() * sizeof(T));
+    }
+
+    uint32_t block_size() const {return ring.get_block_size();}
+
+    /// Number of blocks pushed, dropped included
+    uint64_t pushed_num() const {return pushed.load();}
+
+    /// Number of blocks dropped because the ring was full
+    uint64_t dropped_num() const {return dropped.load();}
+
+  private:
+    StreamManager& manager;
+    StreamRing ring;
+
+    LocalCounter pushed;
+    LocalCounter dropped;
+
+    /// Number of sessions which opened the stream:
+    /// the blocks are not copied when there is none.
+    std::atomic<uint32_t> readers;
+    std::vector<SessID> sessions; ///< Guarded by the StreamManager mutex
+
+friend class StreamManager;
+};
+
+class StreamManager
+{
+  public:
+    StreamManager(KServer *kserver_);
+    ~StreamManager();
+
+    /// Register the stream index of the device dev (see ContextBase::add_stream).
+    /// Returns nullptr on failure.
+    Stream* add(device_id dev, uint32_t block_size, uint32_t capacity);
+
+    /// Stream index of the device dev, or nullptr
+    Stream* find(device_id dev, uint16_t index);
+
+    /// Deliver the blocks to the sessions which opened the stream
+    int open(uint16_t stream_id, SessID sid);
+    void close(uint16_t stream_id, SessID sid);
+
+    /// Must be called when a session is closed
+    void close_all(SessID sid);
+
+    int start();
+    void stop();
+
+    /// Call func(stream) on each stream
+    template<typename Func>
+    void for_each_stream(Func&& func) {
+        const uint32_t n = streams_num.load();
+
+        for (uint32_t i = 0; i < n; i++)
+            func(static_cast<const Stream&>(*streams[i]));
+    }
+
+  private:
+    KServer *kserver;
+
+    // The streams are never removed
+    std::array<std::unique_ptr<Stream>, KSERVER_MAX_STREAMS> streams;
+    std::atomic<uint32_t> streams_num;
+
+#if KSERVER_HAS_THREADS
+    std::mutex mutex;
+    int wake_fd = -1; ///< Signaled on each pushed block
+    int stop_fd = -1;
+    std::thread stream_thread;
+
+    void run();
+#endif
+
+    void wake();
+    void deliver(Stream& stream);
+
+friend class Stream;
+};
+
+inline bool Stream::push(const void *bytes, uint32_t len)
+{
+    const uint64_t sequence = pushed.load();
+    pushed.add();
+
+    if (readers.load(std::memory_order_relaxed) == 0)
+        return true;
+
+    if (len > ring.get_block_size()
+        || !ring.push(static_cast<const unsigned char*>(bytes), len, sequence)) {
+        dropped.add();
+        return false;
+    }
+
+    manager.wake();
+    return true;
+}
+
+} // namespace kserver
+
+#endif // __STREAMS_HPP__
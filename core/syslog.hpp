@@ -128,6 +128,8 @@ struct SysLog
 
 friend class KServer;
 friend class SessionManager;
+friend class PollingScheduler;
+friend class StreamManager;
 };
 
 template<unsigned int severity, typename... Args>
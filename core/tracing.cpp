@@ -0,0 +1,179 @@
+/// Implementation of tracing.hpp
+///
+/// (c) Koheron
+
+#include "tracing.hpp"
+
+#if KSERVER_HAS_TRACING
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+extern "C" {
+  #include <unistd.h>
+  #include <sys/syscall.h>
+}
+
+#include "metrics.hpp"
+
+namespace kserver {
+
+namespace trace {
+
+std::atomic<bool> enabled(false);
+
+void Buffer::read(std::vector<Event>& evts) const
+{
+    constexpr uint64_t len = KSERVER_TRACE_EVENTS_NUM;
+
+    const auto head_begin = head.load(std::memory_order_acquire);
+    const auto first = head_begin > len ? head_begin - len : 0;
+    const auto size = evts.size();
+
+    for (auto i = first; i < head_begin; i++)
+        evts.push_back(events[i % len]);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const auto head_end = head.load(std::memory_order_relaxed);
+
+    // Events with index <= head_end - len may have been
+    // overwritten by the writer during the copy.
+    if (head_end >= len && head_end - len + 1 > first) {
+        const auto overwritten = std::min(head_end - len + 1 - first,
+                                          head_begin - first);
+        evts.erase(evts.begin() + size, evts.begin() + size + overwritten);
+    }
+}
+
+namespace {
+
+/// Buffers are allocated on first use and recycled
+/// when the thread owning them terminates.
+class Registry
+{
+  public:
+    Buffer* acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto& buffer : buffers) {
+            if (!buffer->in_use.load()) {
+                buffer->in_use.store(true);
+                return buffer.get();
+            }
+        }
+
+        if (buffers.size() >= KSERVER_TRACE_MAX_THREADS)
+            return nullptr;
+
+        buffers.push_back(std::make_unique<Buffer>());
+        buffers.back()->in_use.store(true);
+        return buffers.back().get();
+    }
+
+    void release(Buffer *buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer->in_use.store(false);
+    }
+
+    std::vector<Event> collect() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Event> evts;
+
+        for (auto& buffer : buffers)
+            buffer->read(evts);
+
+        return evts;
+    }
+
+  private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+};
+
+Registry registry;
+
+struct ThreadBuffer
+{
+    ThreadBuffer()
+    : buffer(registry.acquire())
+    , tid(static_cast<uint32_t>(syscall(SYS_gettid)))
+    {}
+
+    ~ThreadBuffer() {
+        if (buffer != nullptr)
+            registry.release(buffer);
+    }
+
+    Buffer *buffer;
+    uint32_t tid;
+};
+
+constexpr std::array<const char*, phases_num> phases_names = {{
+    "read_command", "deserialize", "lock_wait", "device_call", "send_response"
+}};
+
+} // namespace
+
+void record(uint64_t begin_ns, uint64_t end_ns, Phase phase,
+            uint32_t device, int32_t operation)
+{
+    static thread_local ThreadBuffer thread_buffer;
+
+    if (unlikely(thread_buffer.buffer == nullptr))
+        return;
+
+    thread_buffer.buffer->push({begin_ns, end_ns, thread_buffer.tid,
+                                static_cast<uint16_t>(device),
+                                static_cast<uint16_t>(operation), phase});
+}
+
+int64_t dump(const char *filename)
+{
+    auto evts = registry.collect();
+
+    std::sort(evts.begin(), evts.end(), [](const Event& a, const Event& b) {
+        return a.begin_ns < b.begin_ns;
+    });
+
+    FILE *file = fopen(filename, "w");
+
+    if (file == nullptr)
+        return -1;
+
+    const int pid = getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    for (size_t i = 0; i < evts.size(); i++) {
+        const auto& evt = evts[i];
+        const char *dev_name = "Unknown";
+        const char *op_name = "unknown";
+
+        if (OperationsLatency::is_valid(evt.device, evt.operation)) {
+            dev_name = devices_names[evt.device].data();
+            op_name = operations_names[operations_offsets[evt.device] + evt.operation].data();
+        }
+
+        fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s.%s\",\"ph\":\"X\","
+                      "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+                      "\"args\":{\"device\":%u,\"operation\":%u}}",
+                i == 0 ? "" : ",",
+                phases_names[evt.phase], dev_name, op_name,
+                evt.begin_ns * 1E-3, (evt.end_ns - evt.begin_ns) * 1E-3,
+                pid, evt.tid, evt.device, evt.operation);
+    }
+
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0)
+        return -1;
+
+    return evts.size();
+}
+
+} // namespace trace
+
+} // namespace kserver
+
+#endif // KSERVER_HAS_TRACING
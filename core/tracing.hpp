@@ -0,0 +1,126 @@
+/// Commands tracing
+///
+/// Records the begin/end timestamps of the phases of each command
+/// into per-thread ring buffers. The buffers are dumped on demand
+/// (KServer::DUMP_TRACE or SIGUSR1) as a Chrome trace-event JSON file,
+/// which can be opened in chrome://tracing or https://ui.perfetto.dev
+///
+/// When tracing is disabled at runtime, a phase costs
+/// a relaxed atomic load and a branch.
+///
+/// (c) Koheron
+
+#ifndef __TRACING_HPP__
+#define __TRACING_HPP__
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include "kserver_defs.hpp"
+#include "clock.hpp"
+
+namespace kserver {
+
+namespace trace {
+
+enum Phase : uint8_t {
+    READ_COMMAND,   ///< Read the command header from the socket
+    DESERIALIZE,    ///< Receive and deserialize the arguments
+    LOCK_WAIT,      ///< Wait for the device mutex
+    DEVICE_CALL,    ///< Call of the device function
+    SEND_RESPONSE,  ///< Serialize and write the response
+    phases_num
+};
+
+struct Event
+{
+    uint64_t begin_ns;
+    uint64_t end_ns;
+    uint32_t tid;
+    uint16_t device;
+    uint16_t operation;
+    Phase phase;
+};
+
+/// Ring buffer of events with a single writer thread.
+///
+/// The writer never waits: the reader copies the events
+/// then checks that they have not been overwritten meanwhile.
+class Buffer
+{
+  public:
+    Buffer() {
+        head.store(0, std::memory_order_relaxed);
+        in_use.store(false, std::memory_order_relaxed);
+    }
+
+    void push(const Event& event) {
+        const auto h = head.load(std::memory_order_relaxed);
+        events[h % KSERVER_TRACE_EVENTS_NUM] = event;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    /// Append the valid events to evts
+    void read(std::vector<Event>& evts) const;
+
+    /// True when the buffer is owned by a thread
+    std::atomic<bool> in_use;
+
+  private:
+    std::atomic<uint64_t> head; ///< Number of events pushed
+    std::array<Event, KSERVER_TRACE_EVENTS_NUM> events;
+};
+
+#if KSERVER_HAS_TRACING
+
+extern std::atomic<bool> enabled;
+
+/// Store an event in the buffer of the calling thread
+void record(uint64_t begin_ns, uint64_t end_ns, Phase phase,
+            uint32_t device, int32_t operation);
+
+/// Write the events of all the threads to a Chrome trace JSON file.
+/// Returns the number of events written, or -1 on error.
+int64_t dump(const char *filename);
+
+inline uint64_t begin()
+{
+    if (likely(!enabled.load(std::memory_order_relaxed)))
+        return 0;
+
+    return clock_ns();
+}
+
+inline void end(uint64_t begin_ns, Phase phase, uint32_t device, int32_t operation)
+{
+    if (likely(begin_ns == 0))
+        return;
+
+    record(begin_ns, clock_ns(), phase, device, operation);
+}
+
+#endif // KSERVER_HAS_TRACING
+
+} // namespace trace
+
+} // namespace kserver
+
+/// Trace a phase of a command:
+///
+///     KSERVER_TRACE_BEGIN(name);
+///     ...
+///     KSERVER_TRACE_END(name, PHASE, cmd);
+#if KSERVER_HAS_TRACING
+# define KSERVER_TRACE_BEGIN(name) \
+    const uint64_t trace_begin_##name = kserver::trace::begin()
+# define KSERVER_TRACE_END(name, phase, cmd)                            \
+    kserver::trace::end(trace_begin_##name, kserver::trace::phase,      \
+                        (cmd).device, (cmd).operation)
+#else
+# define KSERVER_TRACE_BEGIN(name)
+# define KSERVER_TRACE_END(name, phase, cmd)
+#endif
+
+#endif // __TRACING_HPP__
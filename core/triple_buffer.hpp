@@ -0,0 +1,134 @@
+/// Buffers written by a device while the sessions read the previous one
+///
+/// The device fills a buffer, then publishes it:
+///
+///     kserver::TripleBuffer<std::vector<float>> traces{std::vector<float>(16384)};
+///
+///     // Acquisition
+///     if (auto *trace = traces.begin_write()) {
+///         read_trace_from_hardware(*trace);
+///         traces.publish();
+///     }
+///
+/// An operation returning a read lease on the last published buffer is sent
+/// without the device lock (see devgen), directly from the buffer:
+///
+///     kserver::Lease<std::vector<float>> get_trace() {
+///         return traces.read();
+///     }
+///
+/// Neither the writer nor the readers block. The writer fills a buffer
+/// that is neither published nor leased; begin_write returns nullptr
+/// if slow readers still lease both the other buffers.
+///
+/// (c) Koheron
+
+#ifndef __TRIPLE_BUFFER_HPP__
+#define __TRIPLE_BUFFER_HPP__
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+
+namespace kserver {
+
+template<typename T> class TripleBuffer;
+
+/// Read lease on a published buffer.
+/// The buffer is not written until the lease is destroyed.
+template<typename T>
+class Lease
+{
+  public:
+    Lease(Lease&& other)
+    : value(other.value)
+    , readers(other.readers)
+    {
+        other.readers = nullptr;
+    }
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+    Lease& operator=(Lease&&) = delete;
+
+    ~Lease() {
+        if (readers != nullptr)
+            readers->fetch_sub(1);
+    }
+
+    const T& operator*() const {return *value;}
+    const T* operator->() const {return value;}
+
+  private:
+    Lease(const T *value_, std::atomic<uint32_t> *readers_)
+    : value(value_)
+    , readers(readers_)
+    {}
+
+    const T *value;
+    std::atomic<uint32_t> *readers;
+
+friend class TripleBuffer<T>;
+};
+
+/// Single writer, multiple readers
+template<typename T>
+class TripleBuffer
+{
+  public:
+    /// All the buffers are initialized with value
+    /// (e.g. to preallocate vectors).
+    TripleBuffer(const T& value = T())
+    : slots{{value, value, value}}
+    {
+        for (auto& r : readers)
+            r.store(0);
+
+        front.store(0);
+    }
+
+    /// Lease the last published buffer (the initial value before any publication)
+    Lease<T> read() {
+        while (true) {
+            const uint32_t slot = front.load();
+            readers[slot].fetch_add(1);
+
+            // The slot may have been released by publish,
+            // and taken by begin_write, before being leased.
+            if (front.load() == slot)
+                return Lease<T>(&slots[slot], &readers[slot]);
+
+            readers[slot].fetch_sub(1);
+        }
+    }
+
+    /// Buffer to fill before publish,
+    /// or nullptr if the readers lease all the other buffers.
+    T* begin_write() {
+        const uint32_t published = front.load();
+
+        for (uint32_t slot = 0; slot < slots.size(); slot++) {
+            if (slot != published && readers[slot].load() == 0) {
+                writing = slot;
+                return &slots[slot];
+            }
+        }
+
+        return nullptr;
+    }
+
+    /// Publish the buffer of begin_write
+    void publish() {
+        front.store(writing);
+    }
+
+  private:
+    std::array<T, 3> slots;
+    std::array<std::atomic<uint32_t>, 3> readers;
+    std::atomic<uint32_t> front;
+    uint32_t writing = 0; ///< Writer only
+};
+
+} // namespace kserver
+
+#endif // __TRIPLE_BUFFER_HPP__
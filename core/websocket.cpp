@@ -5,11 +5,17 @@
 /// (c) Koheron
 
 #include "websocket.hpp"
+#include "websocket_mask.hpp"
+#include "writev.hpp"
+#include "clock.hpp"
 
 #include <cstring>
+#include <strings.h>
 #include <sstream>
 #include <iostream>
 #include <cstdlib>
+#include <algorithm>
+#include <limits>
 
 extern "C" {
     #include <sys/socket.h>	// socket definitions
@@ -25,15 +31,25 @@ extern "C" {
 
 namespace kserver {
 
-WebSocket::WebSocket(std::shared_ptr<KServerConfig> config_, SysLog& syslog_)
+WebSocket::WebSocket(std::shared_ptr<KServerConfig> config_, SysLog& syslog_,
+                     SessionStats& stats_)
 : config(config_),
   syslog(syslog_),
+  stats(stats_),
   comm_fd(-1),
-  read_str_len(0),
-  connection_closed(false)
+  read_begin(0),
+  read_end(0),
+  message_size(0),
+  message_compressed(false),
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+  tail_fed(false),
+  inflated_size(0),
+#endif
+  connection_closed(false),
+  metrics_request(false)
 {
-    bzero(read_str, WEBSOCK_READ_STR_LEN);
-    bzero(sha_str, 21);
+    header.fin = true;
+    header.remaining = 0;
 }
 
 void WebSocket::set_id(int comm_fd_)
@@ -46,93 +62,202 @@ int WebSocket::authenticate()
     if (read_http_packet() < 0)
         return -1;
 
-    static const std::string WSKeyIdentifier("Sec-WebSocket-Key: ");
-    static const std::string WSProtocolIdentifier("Sec-WebSocket-Protocol: ");
-    static const std::string WSMagic("258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+    static constexpr char MetricsRequest[] = "GET /metrics";
+    static constexpr size_t MetricsRequestLen = sizeof(MetricsRequest) - 1;
 
-    bool is_protocol 
-        = (http_packet.find(WSProtocolIdentifier) != std::string::npos);
+    // Prometheus scrape: answered by the session (see send_metrics)
+    if (memcmp(read_str, MetricsRequest, MetricsRequestLen) == 0) {
+        const char next = read_str[MetricsRequestLen];
 
-    std::size_t pos = http_packet.find(WSKeyIdentifier);
+        if (next == ' ' || next == '?') {
+            metrics_request = true;
+            return 0;
+        }
+    }
+
+    size_t key_len;
+    const char *key = find_http_field("Sec-WebSocket-Key", key_len);
+
+    // Base64 encoding of a 16 bytes nonce
+    static constexpr size_t WSKeyLen = 24;
 
-    if (pos == std::string::npos) {
+    if (key == nullptr || key_len != WSKeyLen) {
         syslog.print<CRITICAL>("WebSocket: No WebSocket Key");
         return -1;
     }
 
-    std::string key;
+    static constexpr char WSMagic[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    static constexpr size_t WSMagicLen = sizeof(WSMagic) - 1;
 
-    try {
-        static const int WSKeyLen = 24;
-        key = http_packet.substr(pos + WSKeyIdentifier.length(), WSKeyLen);
-    } catch (std::out_of_range &err) {
-        return -1;
-    }
+    unsigned char accept_src[WSKeyLen + WSMagicLen];
+    memcpy(accept_src, key, WSKeyLen);
+    memcpy(accept_src + WSKeyLen, WSMagic, WSMagicLen);
 
-    key.append(WSMagic);
+    unsigned char sha[20];
+    SHA1(accept_src, sizeof(accept_src), sha);
 
-    SHA1(reinterpret_cast<const unsigned char*>(key.c_str()),
-         key.length(), sha_str);
-    std::string final_str = base64_encode(sha_str, 20);
+    // The response is built from preformatted lines
+    static constexpr char ResponseHeader[] =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: ";
+    static constexpr char ProtocolLine[] = "Sec-WebSocket-Protocol: chat\r\n";
+    static constexpr char ExtensionsField[] = "Sec-WebSocket-Extensions: ";
 
-    std::ostringstream oss;
-    oss << "HTTP/1.1 101 Switching Protocols\r\n";
-    oss << "Upgrade: websocket\r\n";
-    oss << "Connection: Upgrade\r\n";
-    oss << "Sec-WebSocket-Accept: " << final_str << "\r\n";
+    char response[WEBSOCK_HANDSHAKE_RESPONSE_LEN];
+    size_t len = 0;
+
+    const auto append = [&](const char *str, size_t n) {
+        memcpy(&response[len], str, n);
+        len += n;
+    };
+
+    append(ResponseHeader, sizeof(ResponseHeader) - 1);
+    base64_encode(sha, sizeof(sha), &response[len]);
+    len += 28;
+    append("\r\n", 2);
 
     // Chrome is not happy when the Protocol wasn't
     // specified in the HTTP request:
     // "Response must not include 'Sec-WebSocket-Protocol'
     // header if not present in request: chat"
     // so only answer protocol if requested
-    if (is_protocol)
-        oss << "Sec-WebSocket-Protocol: chat\r\n";
+    size_t field_len;
+
+    if (find_http_field("Sec-WebSocket-Protocol", field_len) != nullptr)
+        append(ProtocolLine, sizeof(ProtocolLine) - 1);
+
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+    const char *offers = find_http_field("Sec-WebSocket-Extensions", field_len);
+
+    if (config->websock_deflate && offers != nullptr) {
+        char extension[PerMessageDeflate::RESPONSE_LEN];
+        const int status = deflate.negotiate(offers, field_len,
+                                             config->websock_deflate_context_takeover,
+                                             extension);
+
+        if (status < 0) {
+            syslog.print<CRITICAL>("WebSocket: Cannot initialize compression\n");
+            return -1;
+        }
+
+        if (status == 1) {
+            append(ExtensionsField, sizeof(ExtensionsField) - 1);
+            append(extension, strlen(extension));
+            append("\r\n", 2);
+            syslog.print<DEBUG>("WebSocket: %s\n", extension);
+        }
+    }
+#endif
+
+    append("\r\n", 2);
+    return send_request(reinterpret_cast<const unsigned char*>(response), len);
+}
+
+// Value of the field name of the HTTP header, or nullptr if not found.
+// Field names are case-insensitive (RFC 7230, section 3.2).
+const char* WebSocket::find_http_field(const char *name, size_t& value_len) const
+{
+    const size_t name_len = strlen(name);
+    const char *end = &read_str[read_begin - 2];
+
+    // Skip the request line
+    const char *line = static_cast<const char*>(memmem(read_str, end - read_str, "\r\n", 2));
+
+    while (line != nullptr && line < end) {
+        line += 2;
+        auto line_end = static_cast<const char*>(memmem(line, end - line, "\r\n", 2));
+
+        if (line_end == nullptr)
+            line_end = end;
+
+        if (line_end - line > static_cast<int64_t>(name_len)
+            && line[name_len] == ':' && strncasecmp(line, name, name_len) == 0) {
+            const char *value = line + name_len + 1;
+
+            while (value < line_end && (*value == ' ' || *value == '\t'))
+                value++;
+
+            const char *value_end = line_end;
+
+            while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+                value_end--;
+
+            value_len = value_end - value;
+            return value;
+        }
+
+        line = line_end;
+    }
+
+    return nullptr;
+}
 
+int WebSocket::send_metrics(const std::string& metrics)
+{
+    std::ostringstream oss;
+    oss << "HTTP/1.1 200 OK\r\n";
+    oss << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+    oss << "Content-Length: " << metrics.length() << "\r\n";
+    oss << "Connection: close\r\n";
     oss << "\r\n";
+    oss << metrics;
 
     return send_request(oss.str());
 }
 
+// Read the HTTP header, which may span several reads.
+// The header is kept at the beginning of read_str, and
+// the frames that follow it in the buffer are not lost.
 int WebSocket::read_http_packet()
 {
-    reset_read_buff();
+    read_begin = 0;
+    read_end = 0;
+    int64_t searched = 0;
 
-    int nb_bytes_rcvd = read(comm_fd, read_str, WEBSOCK_READ_STR_LEN);
+    while (true) {
+        if (read_end == WEBSOCK_READ_STR_LEN) {
+            syslog.print<CRITICAL>("WebSocket: Read buffer overflow\n");
+            return -1;
+        }
 
-    // Check reception ...
-    if (nb_bytes_rcvd < 0) {
-        syslog.print<CRITICAL>("WebSocket: Read error\n");
-        return -1;
-    }
+        const auto nb_bytes_rcvd = read(comm_fd, &read_str[read_end],
+                                        WEBSOCK_READ_STR_LEN - read_end);
+        stats.recv_calls.add();
 
-    if (nb_bytes_rcvd == KSERVER_READ_STR_LEN) {
-        syslog.print<CRITICAL>("WebSocket: Read buffer overflow\n");
-        return -1;
-    }
+        if (nb_bytes_rcvd == 0) { // Connection closed by client
+            connection_closed = true;
+            return -1;
+        }
 
-    if (nb_bytes_rcvd == 0) { // Connection closed by client
-        connection_closed = true;
-        return -1;
-    }
+        if (nb_bytes_rcvd < 0) {
+            syslog.print<CRITICAL>("WebSocket: Read error\n");
+            return -1;
+        }
 
-    http_packet = std::string(read_str);
-    std::size_t delim_pos = http_packet.find("\r\n\r\n");
+        stats.bytes_rcvd.add(nb_bytes_rcvd);
+        read_end += nb_bytes_rcvd;
 
-    if (delim_pos == std::string::npos) {
-        syslog.print<CRITICAL>("WebSocket: No HTML header found\n");
-        return -1;
+        const auto delim = static_cast<const char*>(
+                memmem(&read_str[searched], read_end - searched, "\r\n\r\n", 4));
+
+        if (delim != nullptr) {
+            read_begin = delim - read_str + 4;
+            break;
+        }
+
+        // The delimiter may straddle two reads
+        searched = std::max<int64_t>(0, read_end - 3);
     }
 
     syslog.print<DEBUG>("[R] HTTP header\n");
-    return nb_bytes_rcvd;
+    return read_begin;
 }
 
 int WebSocket::set_send_header(unsigned char *bits, long long data_len,
                                unsigned int format)
 {
-    memset(bits, 0, 10 + data_len);
-
     bits[0] = format;
     int mask_offset = 0;
 
@@ -162,101 +287,433 @@ int WebSocket::set_send_header(unsigned char *bits, long long data_len,
     return mask_offset;
 }
 
-int WebSocket::exit()
+int WebSocket::send_binary(struct iovec *iov, int iovcnt, bool push)
 {
-    return send_request(send_buf, set_send_header(send_buf, 0, (1 << 7) + CONNECTION_CLOSE));
-}
+    if (connection_closed)
+        return 0;
+
+    uint64_t payload_len = 0;
 
-#define WEBSOCK_RCV(type, arg_type, arg_name)                              \
-int WebSocket::receive##type(arg_type arg_name)                            \
-{                                                                          \
-    if (connection_closed)                                                 \
-        return 0;                                                          \
-                                                                           \
-    int err = read_stream();                                               \
-                                                                           \
-    if (unlikely(err < 0))                                                 \
-        return -1;                                                         \
-    else if (err == 1) /* Connection closed by client*/                    \
-        return 0;                                                          \
-                                                                           \
-    if (unlikely(decode_raw_stream##type(arg_name) < 0)) {                 \
-        syslog.print<CRITICAL>(                                            \
-                        "WebSocket: Cannot decode command stream\n");      \
-        return -1;                                                         \
-    }                                                                      \
-                                                                           \
-    syslog.print<DEBUG>(                                                   \
-            "[R] WebSocket: command of %u bytes\n", header.payload_size);  \
-    return header.payload_size;                                            \
+    for (int i = 1; i < iovcnt; i++)
+        payload_len += iov[i].iov_len;
+
+    unsigned int format = (1 << 7) + BINARY_FRAME;
+
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+    struct iovec compressed_iov[2];
+
+    if (deflate.is_active() && payload_len >= config->websock_deflate_threshold) {
+        const auto start = clock_ns();
+
+        if (unlikely(deflate.compress(iov + 1, iovcnt - 1, deflate_buf) < 0)) {
+            syslog.print<ERROR>("WebSocket: Cannot compress message\n");
+            return -1;
+        }
+
+        stats.deflate_ns.add(clock_ns() - start);
+        stats.deflate_in.add(payload_len);
+        stats.deflate_out.add(deflate_buf.size());
+
+        compressed_iov[1].iov_base = deflate_buf.data();
+        compressed_iov[1].iov_len = deflate_buf.size();
+        iov = compressed_iov;
+        iovcnt = 2;
+        payload_len = deflate_buf.size();
+        format |= RSV1;
+    }
+#endif
+
+    unsigned char header_bits[BIG_OFFSET];
+    iov[0].iov_base = header_bits;
+    iov[0].iov_len = set_send_header(header_bits, payload_len, format);
+
+    // With context takeover, a compressed frame which is not sent
+    // desynchronizes the client decompressor: it cannot be dropped.
+    const auto bytes_send = push ? writev_push(comm_fd, iov, iovcnt, stats, !(format & RSV1))
+                                 : writev_all(comm_fd, iov, iovcnt, stats);
+
+    if (bytes_send == 0) {
+        connection_closed = true;
+        syslog.print<INFO>("WebSocket: Connection closed by client\n");
+        return 0;
+    }
+
+    if (push && bytes_send < 0 && errno == EAGAIN) {
+        syslog.print<DEBUG>("WebSocket: Pushed frame dropped\n");
+        return -1;
+    }
+
+    if (unlikely(bytes_send < 0)) {
+        connection_closed = true;
+        syslog.print<ERROR>("WebSocket: Cannot send binary frame\n");
+        return -1;
+    }
+
+    syslog.print<DEBUG>("[S] %lu bytes\n", bytes_send);
+    return std::min<int64_t>(bytes_send, std::numeric_limits<int>::max());
 }
 
-WEBSOCK_RCV(_cmd, Command&, cmd) // receive_cmd
-WEBSOCK_RCV(,,)                  // receive
+int WebSocket::exit()
+{
+    unsigned char header_bits[BIG_OFFSET];
+    return send_request(header_bits, set_send_header(header_bits, 0, (1 << 7) + CONNECTION_CLOSE));
+}
 
-int WebSocket::decode_raw_stream_cmd(Command& cmd)
+int WebSocket::receive_cmd(Command& cmd)
 {
-    if (unlikely(read_str_len < (int)header.header_size + 1))
+    if (connection_closed)
+        return 0;
+
+    // Arguments not read by the previous operation
+    if (unlikely(discard_message() < 0))
+        return -1;
+
+    const int err = read_header();
+
+    if (unlikely(err < 0)) {
+        syslog.print<CRITICAL>("WebSocket: Cannot read header\n");
+        return -1;
+    }
+
+    if (connection_closed)
+        return 0;
+
+    if (unlikely(header.opcode == CONTINUATION_FRAME)) {
+        syslog.print<CRITICAL>("WebSocket: Unexpected continuation frame\n");
         return -1;
+    }
 
-    char *mask = read_str + header.mask_offset;
-    char *payload_ptr = read_str + header.mask_offset + 4;
+    if (!message_compressed && header.fin && header.payload_size < Command::HEADER_SIZE) {
+        syslog.print<ERROR>("WebSocket: Command too small\n");
+        return -1;
+    }
 
-    for (int64_t i = 0; i < Command::HEADER_SIZE; ++i)
-        cmd.header.data()[i] = (payload_ptr[i] ^ mask[i % 4]);
+    const int bytes_read = read_payload(cmd.header.data(), Command::HEADER_SIZE);
 
-    for (int64_t i = Command::HEADER_SIZE; i < header.payload_size; ++i)
-        cmd.payload.data()[i - Command::HEADER_SIZE] = (payload_ptr[i] ^ mask[i % 4]);
+    if (bytes_read <= 0)
+        return bytes_read;
 
-    return 0;
+    syslog.print<DEBUG>("[R] WebSocket: command of %lu bytes\n", message_size);
+    return bytes_read;
 }
 
-int WebSocket::decode_raw_stream()
+int WebSocket::read_payload(char *data, uint64_t len)
 {
-    if (unlikely(read_str_len < (int)header.header_size + 1))
-        return -1;
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+    if (message_compressed) {
+        const auto n = inflate_message(data, len);
 
-    char *mask = read_str + header.mask_offset;
-    payload = read_str + header.mask_offset + 4;
+        if (n < 0 || connection_closed)
+            return n < 0 ? -1 : 0;
 
-    for (int64_t i = 0; i < header.payload_size; ++i)
-        payload[i] = (payload[i] ^ mask[i % 4]);
+        if (static_cast<uint64_t>(n) < len) {
+            syslog.print<ERROR>("WebSocket: Message shorter than the command arguments\n");
+            return -1;
+        }
 
-    return 0;
+        return n;
+    }
+#endif
+
+    uint64_t bytes_read = 0;
+
+    while (bytes_read < len) {
+        if (header.remaining == 0) {
+            const int err = read_continuation_header();
+
+            if (err <= 0)
+                return err;
+
+            continue;
+        }
+
+        const int64_t n = std::min<uint64_t>(len - bytes_read, header.remaining);
+        const int err = read_data(data + bytes_read, n);
+
+        if (err <= 0)
+            return err;
+
+        unmask(data + bytes_read, n, header.payload_size - header.remaining);
+        header.remaining -= n;
+        bytes_read += n;
+    }
+
+    return bytes_read;
 }
 
-int WebSocket::read_stream()
+uint64_t WebSocket::remaining_quota() const
 {
-    reset_read_buff();
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+    if (message_compressed)
+        return config->websock_max_message_size - inflated_size;
+#endif
 
-    int read_head_err = read_header();
+    if (header.fin)
+        return header.remaining;
 
-    if (unlikely(read_head_err < 0)) {
-        syslog.print<CRITICAL>("WebSocket: Cannot read header\n");
+    // Payload bytes of the received frames already read
+    const uint64_t consumed = message_size - header.remaining;
+    return config->websock_max_message_size - consumed;
+}
+
+// Payload byte i of a frame is masked with mask[i % 4]
+void WebSocket::unmask(char *data, int64_t len, int64_t frame_offset)
+{
+    unsigned char mask[4];
+
+    for (int k = 0; k < 4; k++)
+        mask[k] = header.mask[(frame_offset + k) % 4];
+
+    apply_mask(reinterpret_cast<unsigned char*>(data), len, mask);
+}
+
+// Read the header of the next frame of a fragmented message.
+// Returns 1 on success, 0 if the connection is closed and -1 on error.
+int WebSocket::read_continuation_header()
+{
+    if (header.fin) {
+        syslog.print<ERROR>("WebSocket: Message shorter than the command arguments\n");
         return -1;
     }
 
-    if (read_head_err == 1) // Connection closed
-        return read_head_err;
-
-    // Read payload
-    int err = read_n_bytes(header.payload_size, header.payload_size);
+    const int err = read_header();
 
     if (unlikely(err < 0)) {
-        syslog.print<CRITICAL>("WebSocket: Cannot read payload\n");
+        syslog.print<CRITICAL>("WebSocket: Cannot read header\n");
         return -1;
     }
 
-    return err;
+    if (connection_closed)
+        return 0;
+
+    if (unlikely(header.opcode != CONTINUATION_FRAME)) {
+        syslog.print<CRITICAL>("WebSocket: Expected a continuation frame\n");
+        return -1;
+    }
+
+    return 1;
+}
+
+int WebSocket::discard_message()
+{
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+    if (message_compressed)
+        return discard_compressed_message();
+#endif
+
+    while (header.remaining > 0 || !header.fin) {
+        if (header.remaining == 0) {
+            const int err = read_continuation_header();
+
+            if (err <= 0)
+                return err;
+
+            continue;
+        }
+
+        if (read_begin == read_end) {
+            const int err = fill_read_buffer(1);
+
+            if (err <= 0)
+                return err;
+        }
+
+        const int64_t n = std::min<int64_t>(header.remaining, read_end - read_begin);
+        read_begin += n;
+        header.remaining -= n;
+    }
+
+    return 1;
+}
+
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+
+// Returns the number of bytes decompressed, which is lower than len
+// at the end of the message or if the connection is closed, and -1 on error.
+int64_t WebSocket::inflate_message(char *data, uint64_t len)
+{
+    uint64_t bytes_read = 0;
+
+    while (true) {
+        const auto start = clock_ns();
+        const auto n = deflate.inflate(reinterpret_cast<unsigned char*>(data) + bytes_read,
+                                       len - bytes_read);
+        stats.inflate_ns.add(clock_ns() - start);
+
+        if (unlikely(n < 0)) {
+            syslog.print<ERROR>("WebSocket: Cannot decompress message\n");
+            return -1;
+        }
+
+        stats.inflate_out.add(n);
+        bytes_read += n;
+        inflated_size += n;
+
+        if (unlikely(inflated_size > config->websock_max_message_size)) {
+            syslog.print<CRITICAL>("WebSocket: Message larger than the session quota\n");
+            return -1;
+        }
+
+        if (bytes_read == len)
+            return bytes_read;
+
+        const int err = feed_inflater();
+
+        if (err < 0)
+            return -1;
+
+        if (err == 0)
+            return bytes_read;
+    }
+}
+
+// The whole message is decompressed, so that the
+// inflater context stays in sync with the client.
+int WebSocket::discard_compressed_message()
+{
+    char scratch[4096];
+    int64_t n;
+
+    do {
+        n = inflate_message(scratch, sizeof(scratch));
+
+        if (n < 0)
+            return -1;
+
+        if (connection_closed)
+            return 0;
+    } while (n == sizeof(scratch));
+
+    message_compressed = false;
+    return 1;
+}
+
+// Give the next compressed bytes of the message to the inflater.
+// The bytes are unmasked in place in the receive buffer.
+// Returns 1 on success, 0 at the end of the message or
+// if the connection is closed and -1 on error.
+int WebSocket::feed_inflater()
+{
+    if (header.remaining == 0) {
+        if (!header.fin)
+            return read_continuation_header();
+
+        if (tail_fed)
+            return 0;
+
+        deflate.set_input(PerMessageDeflate::tail, sizeof(PerMessageDeflate::tail));
+        tail_fed = true;
+        return 1;
+    }
+
+    if (read_begin == read_end) {
+        const int err = fill_read_buffer(1);
+
+        if (err <= 0)
+            return err;
+    }
+
+    const int64_t n = std::min<int64_t>(header.remaining, read_end - read_begin);
+    char *input = &read_str[read_begin];
+    unmask(input, n, header.payload_size - header.remaining);
+    deflate.set_input(reinterpret_cast<const unsigned char*>(input), n);
+    stats.inflate_in.add(n);
+    read_begin += n;
+    header.remaining -= n;
+    return 1;
+}
+
+#endif // KSERVER_HAS_WEBSOCKET_DEFLATE
+
+// Returns len on success, 0 if the connection is closed and -1 on error.
+int WebSocket::read_data(char *data, int64_t len)
+{
+    // Buffered bytes first
+    int64_t bytes_read = std::min<int64_t>(len, read_end - read_begin);
+    memcpy(data, &read_str[read_begin], bytes_read);
+    read_begin += bytes_read;
+
+    if (bytes_read == len)
+        return len;
+
+    // Small remainders go through the buffer, so that the
+    // frames following them are received with the same read.
+    if (len - bytes_read <= WEBSOCK_READ_STR_LEN / 4) {
+        const int err = fill_read_buffer(len - bytes_read);
+
+        if (err <= 0)
+            return err;
+
+        memcpy(data + bytes_read, &read_str[read_begin], len - bytes_read);
+        read_begin += len - bytes_read;
+        return len;
+    }
+
+    // Large ones are read in place
+    while (bytes_read < len) {
+        const auto n = read(comm_fd, data + bytes_read, len - bytes_read);
+        stats.recv_calls.add();
+
+        if (n == 0) {
+            syslog.print<INFO>("WebSocket: Connection closed by client\n");
+            connection_closed = true;
+            return 0;
+        }
+
+        if (unlikely(n < 0)) {
+            syslog.print<ERROR>("WebSocket: Cannot read data\n");
+            return -1;
+        }
+
+        stats.bytes_rcvd.add(n);
+        bytes_read += n;
+    }
+
+    return bytes_read;
+}
+
+// Make at least len bytes available in read_str, reading
+// as much as the socket has. Returns 1 on success,
+// 0 if the connection is closed and -1 on error.
+int WebSocket::fill_read_buffer(int64_t len)
+{
+    if (read_end - read_begin >= len)
+        return 1;
+
+    // Move the partial frame to the beginning of the buffer
+    if (read_begin + len > WEBSOCK_READ_STR_LEN) {
+        memmove(read_str, &read_str[read_begin], read_end - read_begin);
+        read_end -= read_begin;
+        read_begin = 0;
+    }
+
+    while (read_end - read_begin < len) {
+        const auto n = read(comm_fd, &read_str[read_end], WEBSOCK_READ_STR_LEN - read_end);
+        stats.recv_calls.add();
+
+        if (n == 0) {
+            syslog.print<INFO>("WebSocket: Connection closed by client\n");
+            connection_closed = true;
+            return 0;
+        }
+
+        if (unlikely(n < 0)) {
+            syslog.print<ERROR>("WebSocket: Cannot read data\n");
+            return -1;
+        }
+
+        stats.bytes_rcvd.add(n);
+        read_end += n;
+    }
+
+    return 1;
 }
 
 int WebSocket::check_opcode(unsigned int opcode)
 {
     switch (opcode) {
       case CONTINUATION_FRAME:
-        syslog.print<CRITICAL>(
-                    "WebSocket: Continuation frame is not suported\n");
-        return -1;
+        break;
       case TEXT_FRAME:
         break;
       case BINARY_FRAME:
@@ -285,20 +742,21 @@ int WebSocket::check_opcode(unsigned int opcode)
 
 int WebSocket::read_header()
 {
-    if (read_n_bytes(6,6) < 0)
-        return -1;
-
-    if (connection_closed)
-        return 0;
+    if (read_begin == read_end) {
+        read_begin = 0;
+        read_end = 0;
+    }
 
-//    printf("%s\n", read_str);
+    if (fill_read_buffer(2) <= 0)
+        return connection_closed ? 0 : -1;
 
-    header.fin = read_str[0] & 0x80;
+    header.fin = read_str[read_begin] & 0x80;
+    header.compressed = read_str[read_begin] & RSV1;
 
-    header.masked = read_str[1] & 0x80;
-    unsigned char stream_size = read_str[1] & 0x7F;
+    header.masked = read_str[read_begin + 1] & 0x80;
+    unsigned char stream_size = read_str[read_begin + 1] & 0x7F;
 
-    header.opcode = read_str[0] & 0x0F;
+    header.opcode = read_str[read_begin] & 0x0F;
 
     int opcode_err = check_opcode(header.opcode);
 
@@ -311,85 +769,76 @@ int WebSocket::read_header()
 
     if (stream_size <= SMALL_STREAM) {
         header.header_size = SMALL_HEADER;
-        header.payload_size = stream_size;
         header.mask_offset = SMALL_OFFSET;
     }
     else if (stream_size == MEDIUM_STREAM) {
-        if (read_n_bytes(2, 2) < 0)
-            return -1;
-
-        if (connection_closed)
-            return 0;
-
         header.header_size = MEDIUM_HEADER;
-        unsigned short s = 0;
-        memcpy(&s, (const char*)&read_str[2], 2);
-        header.payload_size = ntohs(s);
         header.mask_offset = MEDIUM_OFFSET;
     }
     else if (stream_size == BIG_STREAM) {
-        if (read_n_bytes(8, 8) < 0)
-            return -1;
-
-        if (connection_closed)
-            return 0;
-
         header.header_size = BIG_HEADER;
-        unsigned long long l = 0;
-        memcpy(&l, (const char*)&read_str[2], 8);
-
-        header.payload_size = be64toh(l);
         header.mask_offset = BIG_OFFSET;
     } else {
         syslog.print<CRITICAL>("WebSocket: Couldn't decode stream size\n");
         return -1;
     }
 
-    if (unlikely(header.payload_size > WEBSOCK_READ_STR_LEN - 56)) {
-        syslog.print<CRITICAL>("WebSocket: Message too large\n");
+    if (fill_read_buffer(header.header_size) <= 0)
+        return connection_closed ? 0 : -1;
+
+    const char *bits = &read_str[read_begin];
+
+    if (stream_size <= SMALL_STREAM) {
+        header.payload_size = stream_size;
+    }
+    else if (stream_size == MEDIUM_STREAM) {
+        unsigned short s = 0;
+        memcpy(&s, &bits[2], 2);
+        header.payload_size = ntohs(s);
+    } else {
+        unsigned long long l = 0;
+        memcpy(&l, &bits[2], 8);
+        header.payload_size = be64toh(l);
+    }
+
+    if (unlikely(!header.masked)) {
+        syslog.print<CRITICAL>("WebSocket: Client frames must be masked\n");
         return -1;
     }
 
-    return 0;
-}
+    // RSV1 is only valid on the first frame of a message,
+    // once permessage-deflate is negotiated
+    if (unlikely((read_str[read_begin] & (RSV2 | RSV3))
+                 || (header.compressed && (!deflate_active()
+                                           || header.opcode == CONTINUATION_FRAME)))) {
+        syslog.print<CRITICAL>("WebSocket: Invalid reserved bits\n");
+        return -1;
+    }
 
-int WebSocket::read_n_bytes(int64_t bytes, int64_t expected)
-{
-    int64_t remaining = bytes;
-    int64_t bytes_read = -1;
-
-    while (expected > 0) {
-        while ((remaining > 0) && 
-               ((bytes_read 
-                   = read(comm_fd, &read_str[read_str_len], remaining)) > 0)) {
-
-            if (bytes_read > 0) {
-                read_str_len += bytes_read;
-                remaining -= bytes_read;
-                expected -= bytes_read;	
-            }
-
-            if (unlikely(bytes_read < 0)) {
-                syslog.print<ERROR>("WebSocket: Cannot read data\n");
-                return -1;
-            }
-
-            if (expected < 0)
-                expected = 0;
-        }
+    if (header.opcode != CONTINUATION_FRAME) {
+        message_size = 0;
+        message_compressed = header.compressed;
 
-        if (bytes_read == 0) {
-            syslog.print<INFO>("WebSocket: Connection closed by client\n");
-            connection_closed = true;
-            return 1;
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+        if (message_compressed) {
+            deflate.begin_message();
+            tail_fed = false;
+            inflated_size = 0;
         }
+#endif
+    }
 
-        if (unlikely(read_str_len == KSERVER_READ_STR_LEN)) {
-            syslog.print<CRITICAL>("WebSocket: Read buffer overflow\n");
-            return -1;
-        }
+    message_size += header.payload_size;
+
+    if (unlikely(header.payload_size < 0
+                 || message_size > config->websock_max_message_size)) {
+        syslog.print<CRITICAL>("WebSocket: Message larger than the session quota\n");
+        return -1;
     }
 
+    memcpy(header.mask, &bits[header.mask_offset], 4);
+    header.remaining = header.payload_size;
+    read_begin += header.header_size;
     return 0;
 }
 
@@ -410,7 +859,10 @@ int WebSocket::send_request(const unsigned char *bits, long long len)
 
     while ((remaining > 0) && 
            (bytes_send = write(comm_fd, &bits[offset], remaining)) > 0) {
+        stats.send_calls.add();
+
         if (bytes_send > 0) {
+            stats.bytes_sent.add(bytes_send);
             offset += bytes_send;
             remaining -= bytes_send;
         }
@@ -432,10 +884,4 @@ int WebSocket::send_request(const unsigned char *bits, long long len)
     return bytes_send;
 }
 
-void WebSocket::reset_read_buff()
-{
-    bzero(read_str, read_str_len);
-    read_str_len = 0;
-}
-
 } // namespace kserver
@@ -6,10 +6,18 @@
 #define __WEBSOCKET_HPP__
 
 #include <string>
+#include <vector>
+#include <atomic>
+
+extern "C" {
+    #include <sys/uio.h>
+}
 
 #include "kserver_defs.hpp"
 #include "config.hpp"
 #include "commands.hpp"
+#include "counters.hpp"
+#include "websocket_deflate.hpp"
 
 namespace kserver {
 
@@ -18,39 +26,64 @@ class SysLog;
 class WebSocket
 {
   public:
-    WebSocket(std::shared_ptr<KServerConfig> config_, SysLog& syslog_);
+    WebSocket(std::shared_ptr<KServerConfig> config_, SysLog& syslog_,
+              SessionStats& stats_);
 
     void set_id(int comm_fd_);
     int authenticate();
-    int receive();                  // General purpose data reception
-    int receive_cmd(Command& cmd);  // Specialization to receive a command
+
+    /// Receive the header of the next command.
+    /// The rest of the previous message is discarded.
+    int receive_cmd(Command& cmd);
+
+    /// Read len bytes of the current message payload into data.
+    /// The frames of a fragmented message are read as they arrive and
+    /// unmasked in place, so the message size is only limited by
+    /// the session quota (websocket max_message_size).
+    /// Compressed messages are decompressed as they are read.
+    int read_payload(char *data, uint64_t len);
+
+    /// Maximum number of payload bytes the current message can still
+    /// deliver: the rest of its last frame, or the unused session quota
+    /// if more frames follow or the message is compressed.
+    uint64_t remaining_quota() const;
 
     /// Send binary blob
     template<class T> int send(const T *data, unsigned int len);
 
-    char* get_payload_no_copy() {return payload;}
-    int64_t payload_size() const {return header.payload_size;}
-    
+    /// Send the iovecs as the payload of a binary frame.
+    /// iov[0] is reserved for the frame header, which is
+    /// built on the stack and written with the payload.
+    /// If permessage-deflate is negotiated, payloads of at least
+    /// websocket deflate_threshold bytes are sent compressed.
+    /// With push, the frame is written with writev_push (see writev.hpp)
+    int send_binary(struct iovec *iov, int iovcnt, bool push = false);
+
     bool is_closed() const {return connection_closed;}
 
+    /// True if the client sent a plain HTTP GET /metrics
+    /// instead of a WebSocket upgrade request
+    bool is_metrics_request() const {return metrics_request;}
+
+    /// Send the metrics as an HTTP response
+    int send_metrics(const std::string& metrics);
+
     int exit();
 
   private:
     std::shared_ptr<KServerConfig> config;
     SysLog& syslog;
+    SessionStats& stats;
 
     int comm_fd;
 
     // Buffers
-    int read_str_len;
+    // Receive buffer: the bytes between read_begin and read_end are
+    // received but not parsed yet. The socket is read as far as the
+    // buffer allows, so pipelined frames are parsed without new reads.
+    int64_t read_begin;
+    int64_t read_end;
     char read_str[WEBSOCK_READ_STR_LEN];
-    char *payload;
-    unsigned char sha_str[21];
-    unsigned char send_buf[WEBSOCK_SEND_BUF_LEN];
-
-    void reset_read_buff();
-
-    std::string http_packet;
 
     struct {
         unsigned int header_size;
@@ -58,11 +91,26 @@ class WebSocket
         int64_t payload_size;
         bool fin;
         bool masked;
+        bool compressed;    ///< RSV1: first frame of a compressed message
         unsigned char opcode;
         unsigned char res[3];
+        unsigned char mask[4];
+        int64_t remaining;  ///< Payload bytes of the frame not read yet
     } header;
 
-    bool connection_closed;
+    uint64_t message_size;  ///< Payload size of the frames of the current message
+    bool message_compressed;
+
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+    PerMessageDeflate deflate;
+    std::vector<unsigned char> deflate_buf;
+    bool tail_fed;          ///< Compressed message trailer given to the inflater
+    uint64_t inflated_size; ///< Decompressed size of the current message
+#endif
+
+    /// Also set by the pushes of the polling and streams threads
+    std::atomic<bool> connection_closed;
+    bool metrics_request;
 
     enum OpCode {
         CONTINUATION_FRAME = 0x0,
@@ -73,6 +121,12 @@ class WebSocket
         PONG               = 0xA
     };
 
+    enum ReservedBits {
+        RSV1 = 0x40,    ///< Compressed message (permessage-deflate)
+        RSV2 = 0x20,
+        RSV3 = 0x10
+    };
+
     enum StreamSize {
         SMALL_STREAM  = 125,
         MEDIUM_STREAM = 126,
@@ -93,12 +147,28 @@ class WebSocket
 
     // Internal functions
     int read_http_packet();
-    int decode_raw_stream();
-    int decode_raw_stream_cmd(Command& cmd);
-    int read_stream();
+    const char* find_http_field(const char *name, size_t& value_len) const;
     int read_header();
+    int read_continuation_header();
+    int discard_message();
     int check_opcode(unsigned int opcode);
-    int read_n_bytes(int64_t bytes, int64_t expected);
+    int fill_read_buffer(int64_t len);
+    int read_data(char *data, int64_t len);
+    void unmask(char *data, int64_t len, int64_t frame_offset);
+
+    bool deflate_active() const {
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+        return deflate.is_active();
+#else
+        return false;
+#endif
+    }
+
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+    int64_t inflate_message(char *data, uint64_t len);
+    int discard_compressed_message();
+    int feed_inflater();
+#endif
 
     int set_send_header(unsigned char *bits, long long data_len,
                         unsigned int format);
@@ -109,17 +179,10 @@ class WebSocket
 template<class T>
 inline int WebSocket::send(const T *data, unsigned int len)
 {
-    if (connection_closed)
-        return 0;
-
-    long unsigned int char_data_len = len * sizeof(T) / sizeof(char);
-
-    if (char_data_len + 10 > WEBSOCK_SEND_BUF_LEN)
-        return -1;
-
-    int mask_offset = set_send_header(send_buf, char_data_len, (1 << 7) + BINARY_FRAME);
-    memcpy(&send_buf[mask_offset], data, char_data_len);
-    return send_request(send_buf, mask_offset + char_data_len);
+    struct iovec iov[2];
+    iov[1].iov_base = const_cast<T*>(data);
+    iov[1].iov_len = len * sizeof(T);
+    return send_binary(iov, 2);
 }
 
 } // namespace kserver
@@ -0,0 +1,291 @@
+/// Implementation of websocket_deflate.hpp
+///
+/// (c) Koheron
+
+#include "websocket_deflate.hpp"
+
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+namespace kserver {
+
+const unsigned char PerMessageDeflate::tail[4] = {0x00, 0x00, 0xff, 0xff};
+
+PerMessageDeflate::PerMessageDeflate()
+: deflater_init(false),
+  inflater_init(false),
+  active(false),
+  server_context_takeover(true),
+  client_context_takeover(true),
+  server_max_window_bits(15)
+{
+    memset(&deflater, 0, sizeof(deflater));
+    memset(&inflater, 0, sizeof(inflater));
+}
+
+PerMessageDeflate::~PerMessageDeflate()
+{
+    if (deflater_init)
+        deflateEnd(&deflater);
+
+    if (inflater_init)
+        inflateEnd(&inflater);
+}
+
+// Offers are parsed in place, without copy
+struct Token
+{
+    const char *begin;
+    const char *end;
+
+    bool operator==(const char *str) const {
+        const size_t len = strlen(str);
+        return static_cast<size_t>(end - begin) == len && memcmp(begin, str, len) == 0;
+    }
+
+    bool empty() const {return begin == end;}
+};
+
+static Token trim(const char *begin, const char *end)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t'))
+        begin++;
+
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+
+    return {begin, end};
+}
+
+static const char* find_char(const char *begin, const char *end, char c)
+{
+    const auto pos = static_cast<const char*>(memchr(begin, c, end - begin));
+    return pos == nullptr ? end : pos;
+}
+
+// Returns 1 if the offer is acceptable, 0 otherwise
+int PerMessageDeflate::parse_offer(const char *begin, const char *end)
+{
+    const char *next = find_char(begin, end, ';');
+
+    if (!(trim(begin, next) == "permessage-deflate"))
+        return 0;
+
+    server_context_takeover = true;
+    client_context_takeover = true;
+    server_max_window_bits = 15;
+    bool window_bits_set = false;
+
+    while (next < end) {
+        begin = next + 1;
+        next = find_char(begin, end, ';');
+        const char *eq = find_char(begin, next, '=');
+        const Token name = trim(begin, eq);
+        Token value = trim(eq + (eq < next), next);
+
+        if (value.end - value.begin >= 2 && *value.begin == '"' && value.end[-1] == '"')
+            value = {value.begin + 1, value.end - 1};
+
+        if (name == "server_no_context_takeover" && value.empty()) {
+            server_context_takeover = false;
+        }
+        else if (name == "client_no_context_takeover" && value.empty()) {
+            client_context_takeover = false;
+        }
+        else if (name == "server_max_window_bits" && !window_bits_set) {
+            // zlib raw deflate streams use at least 9 window bits
+            const auto len = value.end - value.begin;
+
+            if (len != 1 && len != 2)
+                return 0;
+
+            server_max_window_bits = 0;
+
+            for (const char *c = value.begin; c < value.end; c++) {
+                if (*c < '0' || *c > '9')
+                    return 0;
+
+                server_max_window_bits = 10 * server_max_window_bits + (*c - '0');
+            }
+
+            window_bits_set = true;
+
+            if (server_max_window_bits < 9 || server_max_window_bits > 15)
+                return 0;
+        }
+        else if (name == "client_max_window_bits") {
+            // Any window size is decompressed with a 15 bits window
+            continue;
+        } else {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int PerMessageDeflate::negotiate(const char *offers, size_t len, bool context_takeover,
+                                 char *response)
+{
+    const char *end = offers + len;
+
+    for (const char *begin = offers; begin < end; ) {
+        const char *next = find_char(begin, end, ',');
+
+        if (parse_offer(begin, next) == 1) {
+            active = true;
+            break;
+        }
+
+        begin = next + 1;
+    }
+
+    if (!active)
+        return 0;
+
+    if (!context_takeover) {
+        server_context_takeover = false;
+        client_context_takeover = false;
+    }
+
+    if (deflateInit2(&deflater, WEBSOCKET_DEFLATE_LEVEL, Z_DEFLATED,
+                     -server_max_window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+
+    deflater_init = true;
+
+    if (inflateInit2(&inflater, -15) != Z_OK)
+        return -1;
+
+    inflater_init = true;
+
+    snprintf(response, RESPONSE_LEN, "permessage-deflate%s%s",
+             server_context_takeover ? "" : "; server_no_context_takeover",
+             client_context_takeover ? "" : "; client_no_context_takeover");
+
+    if (server_max_window_bits < 15) {
+        const size_t n = strlen(response);
+        snprintf(response + n, RESPONSE_LEN - n, "; server_max_window_bits=%d",
+                 server_max_window_bits);
+    }
+
+    return 1;
+}
+
+int PerMessageDeflate::compress(const struct iovec *iov, int iovcnt,
+                                std::vector<unsigned char>& out)
+{
+    uint64_t len = 0;
+
+    for (int i = 0; i < iovcnt; i++)
+        len += iov[i].iov_len;
+
+    // Room for the sync flush trailer
+    out.resize(deflateBound(&deflater, len) + 16);
+    deflater.next_out = out.data();
+    deflater.avail_out = std::min<uint64_t>(out.size(), UINT_MAX);
+
+    const auto grow = [&]() {
+        const auto used = out.size() - deflater.avail_out;
+        out.resize(2 * out.size());
+        deflater.next_out = out.data() + used;
+        deflater.avail_out = std::min<uint64_t>(out.size() - used, UINT_MAX);
+    };
+
+    for (int i = 0; i < iovcnt; i++) {
+        auto data = static_cast<unsigned char*>(iov[i].iov_base);
+        uint64_t remaining = iov[i].iov_len;
+
+        while (remaining > 0) {
+            deflater.next_in = data;
+            deflater.avail_in = std::min<uint64_t>(remaining, UINT_MAX);
+            const uint64_t chunk = deflater.avail_in;
+
+            while (deflater.avail_in > 0) {
+                if (deflater.avail_out == 0)
+                    grow();
+
+                if (deflate(&deflater, Z_NO_FLUSH) == Z_STREAM_ERROR)
+                    return -1;
+            }
+
+            data += chunk;
+            remaining -= chunk;
+        }
+    }
+
+    do {
+        if (deflater.avail_out == 0)
+            grow();
+
+        if (deflate(&deflater, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+            return -1;
+    } while (deflater.avail_out == 0);
+
+    const auto used = static_cast<unsigned char*>(deflater.next_out) - out.data();
+
+    if (used < 4 || memcmp(out.data() + used - 4, tail, 4) != 0)
+        return -1;
+
+    out.resize(used - 4);
+
+    if (!server_context_takeover)
+        deflateReset(&deflater);
+
+    return 0;
+}
+
+void PerMessageDeflate::begin_message()
+{
+    inflater.avail_in = 0;
+
+    if (!client_context_takeover)
+        inflateReset(&inflater);
+}
+
+void PerMessageDeflate::set_input(const unsigned char *data, uint64_t len)
+{
+    // zlib does not write to the input (next_in is only const with ZLIB_CONST)
+    inflater.next_in = const_cast<unsigned char*>(data);
+    inflater.avail_in = len;
+}
+
+int64_t PerMessageDeflate::inflate(unsigned char *data, uint64_t len)
+{
+    uint64_t bytes_out = 0;
+
+    while (bytes_out < len) {
+        inflater.next_out = data + bytes_out;
+        inflater.avail_out = std::min<uint64_t>(len - bytes_out, UINT_MAX);
+        const uint64_t chunk = inflater.avail_out;
+
+        const int ret = ::inflate(&inflater, Z_SYNC_FLUSH);
+        bytes_out += chunk - inflater.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            // The client ended the deflate stream (final block)
+            inflateReset(&inflater);
+            continue;
+        }
+
+        // No progress possible without more input
+        if (ret == Z_BUF_ERROR)
+            break;
+
+        if (ret != Z_OK)
+            return -1;
+
+        if (inflater.avail_in == 0 && inflater.avail_out > 0)
+            break;
+    }
+
+    return bytes_out;
+}
+
+} // namespace kserver
+
+#endif // KSERVER_HAS_WEBSOCKET_DEFLATE
@@ -0,0 +1,93 @@
+/// WebSocket permessage-deflate extension
+///
+/// Compression of the message payloads with zlib (RFC 7692).
+/// The parameters are negotiated during the opening handshake.
+/// Messages are compressed as raw deflate blocks ended by a sync
+/// flush, whose 4 bytes trailer (00 00 ff ff) is not transmitted.
+///
+/// (c) Koheron
+
+#ifndef __WEBSOCKET_DEFLATE_HPP__
+#define __WEBSOCKET_DEFLATE_HPP__
+
+#include "kserver_defs.hpp"
+
+#if KSERVER_HAS_WEBSOCKET_DEFLATE
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+extern "C" {
+    #include <sys/uio.h>
+    #include <zlib.h>
+}
+
+namespace kserver {
+
+class PerMessageDeflate
+{
+  public:
+    PerMessageDeflate();
+    ~PerMessageDeflate();
+
+    PerMessageDeflate(const PerMessageDeflate&) = delete;
+    PerMessageDeflate& operator=(const PerMessageDeflate&) = delete;
+
+    /// Select the first acceptable offer of a Sec-WebSocket-Extensions
+    /// header value and write the extension to answer in response
+    /// (null terminated, at most RESPONSE_LEN bytes).
+    /// If context_takeover is false, each message is compressed
+    /// and decompressed independently.
+    /// Returns 1 if an offer is accepted, 0 if none and -1 on error.
+    int negotiate(const char *offers, size_t len, bool context_takeover,
+                  char *response);
+
+    static constexpr size_t RESPONSE_LEN = 128;
+
+    bool is_active() const {return active;}
+
+    // Send
+
+    /// Compress the payload given by the iovecs into out
+    /// Returns 0 on success and -1 on error.
+    int compress(const struct iovec *iov, int iovcnt,
+                 std::vector<unsigned char>& out);
+
+    // Receive
+
+    /// Start the decompression of a new message
+    void begin_message();
+
+    /// Set the compressed data to decompress. The data
+    /// must stay valid until they are consumed (see has_input).
+    void set_input(const unsigned char *data, uint64_t len);
+
+    bool has_input() const {return inflater.avail_in > 0;}
+
+    /// Decompress up to len bytes into data.
+    /// Returns the number of bytes written, which is lower than len
+    /// only if more input is needed, or -1 on error.
+    int64_t inflate(unsigned char *data, uint64_t len);
+
+    /// Trailer removed from the end of each compressed message
+    static const unsigned char tail[4];
+
+  private:
+    z_stream deflater;
+    z_stream inflater;
+    bool deflater_init;
+    bool inflater_init;
+
+    bool active;
+    bool server_context_takeover;
+    bool client_context_takeover;
+    int server_max_window_bits;
+
+    int parse_offer(const char *begin, const char *end);
+};
+
+} // namespace kserver
+
+#endif // KSERVER_HAS_WEBSOCKET_DEFLATE
+#endif // __WEBSOCKET_DEFLATE_HPP__
@@ -0,0 +1,73 @@
+/// WebSocket payload masking
+///
+/// XOR of the payload with the 4 bytes frame mask (RFC 6455, section 5.3).
+/// The mask is broadcast in a vector register and applied
+/// 32 (AVX2) or 16 (SSE2, NEON) bytes at a time.
+///
+/// (c) Koheron
+
+#ifndef __WEBSOCKET_MASK_HPP__
+#define __WEBSOCKET_MASK_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace kserver {
+
+/// Apply the mask in place: data[i] ^= mask[i % 4]
+inline void apply_mask(unsigned char *data, size_t len, const unsigned char mask[4])
+{
+    // Mask bytes in memory order, whatever the host endianness
+    uint32_t mask32;
+    memcpy(&mask32, mask, sizeof(mask32));
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i mask256 = _mm256_set1_epi32(static_cast<int>(mask32));
+
+    for (; i + 32 <= len; i += 32) {
+        const auto ptr = reinterpret_cast<__m256i*>(data + i);
+        _mm256_storeu_si256(ptr, _mm256_xor_si256(_mm256_loadu_si256(ptr), mask256));
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i mask128 = _mm_set1_epi32(static_cast<int>(mask32));
+
+    for (; i + 16 <= len; i += 16) {
+        const auto ptr = reinterpret_cast<__m128i*>(data + i);
+        _mm_storeu_si128(ptr, _mm_xor_si128(_mm_loadu_si128(ptr), mask128));
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t mask128 = vreinterpretq_u8_u32(vdupq_n_u32(mask32));
+
+    for (; i + 16 <= len; i += 16)
+        vst1q_u8(data + i, veorq_u8(vld1q_u8(data + i), mask128));
+#endif
+
+    const uint64_t mask64 = (static_cast<uint64_t>(mask32) << 32) | mask32;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, data + i, sizeof(chunk));
+        chunk ^= mask64;
+        memcpy(data + i, &chunk, sizeof(chunk));
+    }
+
+    // i is a multiple of 4 here
+    for (; i < len; ++i)
+        data[i] ^= mask[i % 4];
+}
+
+} // namespace kserver
+
+#endif // __WEBSOCKET_MASK_HPP__
@@ -0,0 +1,120 @@
+/// Scatter-gather socket writes
+///
+/// (c) Koheron
+
+#ifndef __WRITEV_HPP__
+#define __WRITEV_HPP__
+
+#include <cstdint>
+#include <cerrno>
+#include <algorithm>
+
+extern "C" {
+    #include <sys/uio.h>
+    #include <sys/socket.h>
+    #include <poll.h>
+    #include <limits.h>
+}
+
+#include "kserver_defs.hpp"
+#include "counters.hpp"
+#include "clock.hpp"
+
+namespace kserver {
+
+/// Skip the first written bytes of the iovecs
+inline void advance_iovecs(struct iovec *&iov, int& iovcnt, size_t written)
+{
+    while (iovcnt > 0 && written >= iov->iov_len) {
+        written -= iov->iov_len;
+        ++iov;
+        --iovcnt;
+    }
+
+    if (written > 0) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+        iov->iov_len -= written;
+    }
+}
+
+/// Write the iovecs, resuming after partial writes.
+/// The iovecs are updated as they are written.
+/// Returns the number of bytes written, 0 if the connection is closed
+/// and -1 on error.
+inline int64_t writev_all(int fd, struct iovec *iov, int iovcnt, SessionStats& stats)
+{
+    int64_t bytes_send = 0;
+
+    while (iovcnt > 0) {
+        const auto n = ::writev(fd, iov, std::min(iovcnt, IOV_MAX));
+        stats.send_calls.add();
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n <= 0)
+            return n;
+
+        stats.bytes_sent.add(n);
+        bytes_send += n;
+        advance_iovecs(iov, iovcnt, n);
+    }
+
+    return bytes_send;
+}
+
+/// Write the iovecs of a message pushed from another thread
+/// (snapshots, stream blocks) without blocking on a slow client.
+///
+/// If the socket is full, a droppable message is not written:
+/// returns -1 with errno EAGAIN. A message partially written (or not
+/// droppable) is completed within KSERVER_PUSH_TIMEOUT_MS, else the
+/// connection is shut down, since the client cannot resynchronize:
+/// returns -1 with errno ETIMEDOUT.
+inline int64_t writev_push(int fd, struct iovec *iov, int iovcnt,
+                           SessionStats& stats, bool droppable)
+{
+    const uint64_t deadline = clock_ns() + KSERVER_PUSH_TIMEOUT_MS * 1000000ULL;
+    int64_t bytes_send = 0;
+
+    while (iovcnt > 0) {
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = std::min(iovcnt, IOV_MAX);
+        const auto n = ::sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        stats.send_calls.add();
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (droppable && bytes_send == 0)
+                return -1;
+
+            const uint64_t now = clock_ns();
+
+            if (now < deadline) {
+                struct pollfd pfd = {fd, POLLOUT, 0};
+                ::poll(&pfd, 1, (deadline - now) / 1000000 + 1);
+                continue;
+            }
+
+            ::shutdown(fd, SHUT_RDWR);
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        if (n <= 0)
+            return n;
+
+        stats.bytes_sent.add(n);
+        bytes_send += n;
+        advance_iovecs(iov, iovcnt, n);
+    }
+
+    return bytes_send;
+}
+
+} // namespace kserver
+
+#endif // __WRITEV_HPP__
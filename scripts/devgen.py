@@ -10,7 +10,7 @@ import json
 # Code generation
 # -----------------------------------------------------------------------------------------
 
-def generate(devices_list, base_dir, build_dir):
+def generate(devices_list, base_dir, build_dir, polling=None):
     print devices_list
     devices = [] # List of generated devices
     obj_files = []  # Object file names
@@ -19,19 +19,27 @@ def generate(devices_list, base_dir, build_dir):
         if path.endswith('.hpp') or path.endswith('.h'):
             device = Device(path, base_dir)
             device.id = dev_id
-            device.calls = cmd_calls(device.raw, dev_id)
             dev_id +=1
-            print('Generating ' + device.name + '...')
-            render_device(device, build_dir)
             devices.append(device)
 
+    polled_operations = get_polled_operations(devices, polling or [])
+
+    for device in devices:
+        device.unlocked_operations = [op for op in device.operations if op.get('unlocked')]
+        device.polled_operations = [op for op in device.operations if 'polled' in op]
+        device.calls = cmd_calls(device.raw, device.id)
+        print('Generating ' + device.name + '...')
+        render_device(device, build_dir)
+
     render_templates(devices, build_dir,
         ['devices_table.hpp',
          'devices_json.hpp',
          'context.cpp',
          'devices.hpp',
          'ks_devices.hpp',
-         'operations.hpp'])
+         'operations.hpp',
+         'polling_table.hpp'],
+        polled_operations)
 
 class Device:
     def __init__(self, path, base_dir):
@@ -43,6 +51,8 @@ class Device:
 
         self.path = path
         self.operations = dev['operations']
+        self.unlocked_operations = [op for op in self.operations if op.get('unlocked')]
+        self.polled_operations = []
         self.tag = dev['tag']
         self.name = dev['name']
         self.class_name = 'KS_' + self.tag.capitalize()
@@ -52,19 +62,30 @@ class Device:
         self.id = None
         self.calls = None
 
+# Operations of the KServer device (see KServer::Operation in core/kserver.hpp)
+KSERVER_OPERATIONS = [
+    {'name': 'get_version', 'id': 0, 'args': [], 'ret_type': 'const char *'},
+    {'name': 'get_cmds', 'id': 1, 'args': [], 'ret_type': 'std::string'},
+    {'name': 'get_stats', 'id': 2, 'args': [], 'ret_type': 'const char *'},
+    {'name': 'get_dev_status', 'id': 3, 'args': [], 'ret_type': 'void'},
+    {'name': 'get_running_sessions', 'id': 4, 'args': [], 'ret_type': 'const char *'},
+    {'name': 'subscribe_pubsub', 'id': 5, 'args': [{'name': 'channel', 'type': 'uint32_t'}], 'ret_type': 'void'},
+    {'name': 'pubsub_ping', 'id': 6, 'args': [], 'ret_type': 'void'},
+    {'name': 'get_ops_latency', 'id': 7, 'args': [], 'ret_type': 'std::tuple<std::string, std::vector<uint64_t>>'},
+    {'name': 'set_tracing', 'id': 8, 'args': [{'name': 'enable', 'type': 'bool'}], 'ret_type': 'void'},
+    {'name': 'dump_trace', 'id': 9, 'args': [], 'ret_type': 'uint64_t'},
+    {'name': 'set_byte_order', 'id': 10, 'args': [{'name': 'byte_order_mark', 'type': 'std::array<uint8_t, 4>'}], 'ret_type': 'bool'},
+    {'name': 'set_response_codecs', 'id': 11, 'args': [{'name': 'codecs', 'type': 'uint32_t'}, {'name': 'threshold', 'type': 'uint32_t'}], 'ret_type': 'uint32_t'},
+    {'name': 'set_reduction', 'id': 12, 'args': [{'name': 'dev_id', 'type': 'uint16_t'}, {'name': 'op_id', 'type': 'uint16_t'}, {'name': 'reduction', 'type': 'uint32_t'}, {'name': 'points', 'type': 'uint32_t'}], 'ret_type': 'bool'},
+    {'name': 'open_stream', 'id': 13, 'args': [{'name': 'dev_id', 'type': 'uint16_t'}, {'name': 'index', 'type': 'uint16_t'}], 'ret_type': 'int32_t'},
+    {'name': 'close_stream', 'id': 14, 'args': [{'name': 'stream_id', 'type': 'uint16_t'}], 'ret_type': 'void'}
+]
+
 def get_json(devices):
     data = [{
         'class': 'KServer',
         'id': 1,
-        'functions': [
-            {'name': 'get_version', 'id': 0, 'args': [], 'ret_type': 'const char *'},
-            {'name': 'get_cmds', 'id': 1, 'args': [], 'ret_type': 'std::string'},
-            {'name': 'get_stats', 'id': 2, 'args': [], 'ret_type': 'const char *'},
-            {'name': 'get_dev_status', 'id': 3, 'args': [], 'ret_type': 'void'},
-            {'name': 'get_running_sessions', 'id': 4, 'args': [], 'ret_type': 'const char *'},
-            {'name': 'subscribe_pubsub', 'id': 5, 'args': [{'name': 'channel', 'type': 'uint32_t'}], 'ret_type': 'void'},
-            {'name': 'pubsub_ping', 'id': 6, 'args': [], 'ret_type': 'void'}
-        ]
+        'functions': KSERVER_OPERATIONS
     }]
 
     for device in devices:
@@ -76,6 +97,13 @@ def get_json(devices):
 
     return json.dumps(data, separators=(',', ':')).replace('"', '\\"').replace('\\\\','')
 
+def get_operations_names(devices):
+    ''' Names of all the operations, listed device after device '''
+    names = [op['name'] for op in KSERVER_OPERATIONS]
+    for device in devices:
+        names += [op['name'] for op in device.operations]
+    return names
+
 def get_template(filename):
     renderer = jinja2.Environment(
       block_start_string = '{%',
@@ -96,28 +124,100 @@ def get_template(filename):
     renderer.filters['get_exact_ret_type'] = get_exact_ret_type
     return renderer.get_template(os.path.join('scripts/templates', filename))
 
-def render_templates(devices, build_dir, filenames):
+def render_templates(devices, build_dir, filenames, polled_operations=[]):
     for filename in filenames:
         with open(os.path.join(build_dir, filename), 'w') as output:
-            output.write(get_template(filename).render(devices=devices, json=get_json(devices)))
+            output.write(get_template(filename).render(devices=devices, json=get_json(devices),
+                                                       kserver_operations=KSERVER_OPERATIONS,
+                                                       operations_names=get_operations_names(devices),
+                                                       polled_operations=polled_operations))
 
 def render_device(device, build_dir):
     for extension in ['.cpp', '.hpp']:
         with open(os.path.join(build_dir, device.ks_name + extension), 'w') as output:
             output.write(get_template('ks_device' + extension).render(device=device))
 
+# -----------------------------------------------------------------------------
+# Polling (see core/polling.hpp)
+# -----------------------------------------------------------------------------
+
+def get_polled_operations(devices, polling):
+    ''' Resolve the entries of the polling section of the configuration:
+
+        polling:
+          - operation: Device.operation
+            period_ms: 100
+            publish: yes
+    '''
+    polled_operations = []
+    for entry in polling:
+        devname, _, opname = str(entry.get('operation', '')).partition('.')
+        device = next((dev for dev in devices if dev.name == devname), None)
+        if device is None:
+            raise ValueError('[polling] Unknown device "{}".'.format(devname))
+        operation = next((op for op in device.operations if op['name'] == opname), None)
+        if operation is None:
+            raise ValueError('[{}::{}] Unknown polled operation.'.format(devname, opname))
+        if 'polled' in operation:
+            raise ValueError('[{}::{}] The operation is polled twice.'.format(devname, opname))
+        if operation.get('arguments'):
+            raise ValueError('[{}::{}] Only operations without arguments can be polled.'.format(devname, opname))
+        if operation['ret_type'] == 'void':
+            raise ValueError('[{}::{}] Only operations with a response can be polled.'.format(devname, opname))
+        if operation['unlocked']:
+            raise ValueError('[{}::{}] A cached, shared or leased operation cannot be polled.'.format(devname, opname))
+        period_ms = entry.get('period_ms')
+        if not isinstance(period_ms, int) or isinstance(period_ms, bool) or period_ms <= 0:
+            raise ValueError('[{}::{}] Invalid polling period "{}": Expected milliseconds.'.format(devname, opname, period_ms))
+
+        operation['polled'] = len(polled_operations)
+        operation['unlocked'] = True
+        polled_operations.append({'device': device, 'operation': operation,
+                                  'period_ms': period_ms, 'publish': bool(entry.get('publish', False))})
+    return polled_operations
+
 # -----------------------------------------------------------------------------
 # Parse device C++ header
 # -----------------------------------------------------------------------------
 
 def parse_header(hppfile):
     cpp_header = CppHeaderParser.CppHeader(hppfile)
+    annotations = parse_annotations(hppfile)
     devices = []
     for classname in cpp_header.classes:
-        devices.append(parse_header_device(cpp_header.classes[classname], hppfile))
+        devices.append(parse_header_device(cpp_header.classes[classname], hppfile, annotations))
     return devices
 
-def parse_header_device(_class, hppfile):
+def parse_annotations(hppfile):
+    ''' Annotations of the methods, in the comment lines
+        right above the declaration:
+
+            /// Calibration of the channel
+            /// @cache 500
+            const std::array<float, 64>& get_calibration(uint32_t channel);
+
+        Returns a dict {method name: {annotation: value}} '''
+    annotations = {}
+    pending = {}
+    with open(hppfile) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith('//'):
+                match = re.match(r'//+\s*@(\w+)\s*(.*)$', line)
+                if match:
+                    pending[match.group(1)] = match.group(2).strip()
+                continue
+            match = re.search(r'(~?\w+)\s*\(', line)
+            if match:
+                if pending:
+                    annotations[match.group(1)] = pending
+                pending = {}
+            elif line == '' or line.endswith(';') or line.endswith('}'):
+                pending = {}
+            # Else the return type is on its own line
+    return annotations
+
+def parse_header_device(_class, hppfile, annotations):
     device = {}
     device['name'] = _class['name']
     device['tag'] = '_'.join(re.findall('[A-Z][^A-Z]*', device['name'])).upper()
@@ -132,12 +232,24 @@ def parse_header_device(_class, hppfile):
     for method in _class['methods']['public']:
         # We eliminate constructor, destructor and templates
         if (not (method['name'] in [s + _class['name'] for s in ['','~']])) and not method['template']:
-            device['operations'].append(parse_header_operation(device['name'], method))
+            device['operations'].append(parse_header_operation(device['name'], method,
+                                                               annotations.get(method['name'], {})))
             device['operations'][-1]['id'] = op_id
             op_id += 1
+
+    # The companion operations are numbered after the methods:
+    # annotating a method does not change the ids of the others.
+    names = [op['name'] for op in device['operations']]
+    for operation in list(device['operations']):
+        if 'multi' in operation:
+            multi = build_multi_operation(operation, op_id)
+            if multi['name'] in names:
+                raise ValueError('[{}::{}] The operation {} already exists.'.format(device['name'], operation['name'], multi['name']))
+            device['operations'].append(multi)
+            op_id += 1
     return device
 
-def parse_header_operation(devname, method):
+def parse_header_operation(devname, method, annotations):
     operation = {}
     operation['tag'] = method['name'].upper()
     operation['name'] = method['name']
@@ -145,6 +257,20 @@ def parse_header_operation(devname, method):
 
     check_type(operation['ret_type'], devname, operation['name'])
 
+    operation['lease_type'] = get_lease_type(operation['ret_type'])
+
+    if 'cache' in annotations and 'shared' in annotations:
+        raise ValueError('[{}::{}] An operation cannot be both cached and shared.'.format(devname, operation['name']))
+    if operation['lease_type'] is not None and ('cache' in annotations or 'shared' in annotations):
+        raise ValueError('[{}::{}] An operation returning a lease cannot be cached or shared.'.format(devname, operation['name']))
+    if 'cache' in annotations:
+        operation['cache'] = parse_cache_annotation(annotations['cache'], devname, operation)
+    if 'shared' in annotations:
+        check_has_response(devname, operation)
+        operation['shared'] = True
+    # The device lock is only taken by the calls
+    operation['unlocked'] = 'cache' in operation or 'shared' in operation or operation['lease_type'] is not None
+
     if len(method['parameters']) > 0:
         operation['arguments'] = [] # Use for code generation
         operation['args_client'] = [] # Send to client
@@ -163,8 +289,78 @@ def parse_header_operation(devname, method):
             check_type(arg['type'], devname, operation['name'])
             operation['arguments'].append(arg)
             operation['args_client'].append({'name': arg['name'], 'type': format_type(arg['type'])})
+
+    if 'multi' in annotations:
+        operation['multi'] = parse_multi_annotation(devname, operation)
     return operation
 
+def get_lease_type(ret_type):
+    ''' T of a kserver::Lease<T> return type (see core/triple_buffer.hpp), else None '''
+    match = re.match(r'^(kserver::)?Lease\s*<(.*)>$', ret_type.strip())
+    return match.group(2).strip() if match else None
+
+def check_has_response(devname, operation):
+    if operation['ret_type'] == 'void':
+        raise ValueError('[{}::{}] Only operations with a response can be cached or shared.'.format(devname, operation['name']))
+
+def parse_cache_annotation(value, devname, operation):
+    ''' @cache [ttl_ms] (see core/response_cache.hpp) '''
+    check_has_response(devname, operation)
+    if value != '' and not value.isdigit():
+        raise ValueError('[{}::{}] Invalid cache time to live "{}": Expected milliseconds.'.format(devname, operation['name'], value))
+    return {'ttl_ms': int(value or 0)}
+
+# -----------------------------------------------------------------------------
+# Multi-calls (@multi)
+# -----------------------------------------------------------------------------
+
+MULTI_SCALAR_TYPES = ['bool', 'float', 'double', 'int8_t', 'uint8_t', 'int16_t', 'uint16_t',
+                      'int32_t', 'uint32_t', 'int64_t', 'uint64_t']
+
+def parse_multi_annotation(devname, operation):
+    ''' @multi: only for scalar arguments and scalar (or void) results.
+        Returns the type of the results. '''
+    if not operation.get('arguments'):
+        raise ValueError('[{}::{}] Only operations with arguments have a multi-call.'.format(devname, operation['name']))
+    for arg in operation['arguments']:
+        if arg['type'] not in MULTI_SCALAR_TYPES:
+            raise ValueError('[{}::{}] Invalid multi-call argument type "{}": Only scalars are supported.'.format(devname, operation['name'], arg['type']))
+    ret_type = re.sub(r'^const\s+|\s*&$', '', operation['ret_type'].strip())
+    if ret_type != 'void' and ret_type not in MULTI_SCALAR_TYPES:
+        raise ValueError('[{}::{}] Invalid multi-call return type "{}": Only scalars are supported.'.format(devname, operation['name'], operation['ret_type']))
+    if operation['unlocked']:
+        raise ValueError('[{}::{}] A cached, shared or leased operation cannot have a multi-call.'.format(devname, operation['name']))
+    return {'ret_type': ret_type}
+
+def get_multi_type(_type):
+    ''' Element type of the vectors of a multi-call (std::vector<bool> has no data) '''
+    return 'uint8_t' if _type == 'bool' else _type
+
+def build_multi_operation(operation, op_id):
+    ''' Companion operation of a method annotated @multi:
+
+            /// @multi
+            void set_dac(uint32_t channel, float value);
+
+        set_dac_multi takes a vector of each argument (std::vector<uint32_t> channel,
+        std::vector<float> value), calls set_dac for each index under a single
+        acquisition of the device lock, and returns the vector of the results.
+        The bool arguments and results are sent as uint8_t. '''
+    ret_type = operation['multi']['ret_type']
+    multi = {
+      'tag': operation['tag'] + '_MULTI',
+      'name': operation['name'] + '_multi',
+      'id': op_id,
+      'ret_type': 'void' if ret_type == 'void' else 'std::vector<{}>'.format(get_multi_type(ret_type)),
+      'lease_type': None,
+      'unlocked': False,
+      'multi_of': operation,
+      'arguments': [{'name': arg['name'], 'type': 'std::vector<{}>'.format(get_multi_type(arg['type']))}
+                    for arg in operation['arguments']]
+    }
+    multi['args_client'] = [{'name': arg['name'], 'type': arg['type']} for arg in multi['arguments']]
+    return multi
+
 # The following integers are forbiden since they are plateform
 # dependent and thus not compatible with network use.
 FORBIDDEN_INTS = ['short', 'int', 'unsigned', 'long', 'unsigned short', 'short unsigned',
@@ -183,19 +379,24 @@ def format_type(_type):
         return _type
 
 def get_exact_ret_type(classname, operation):
-    if 'auto' in operation['ret_type'] or is_std_array(operation['ret_type']):
-        decl_arg_list = []
-        for arg in operation.get('arguments', []):
-            decl_arg_list.append('std::declval<{}>()'.format(arg['type']))
-        return 'decltype(std::declval<{}>().{}({}))'.format(classname, operation['name'], ' ,'.join(decl_arg_list))
+    decl_arg_list = []
+    for arg in operation.get('arguments', []):
+        decl_arg_list.append('std::declval<{}>()'.format(arg['type']))
+    decl_call = 'std::declval<{}>().{}({})'.format(classname, operation['name'], ' ,'.join(decl_arg_list))
+    if operation.get('lease_type') is not None:
+        # The leased value is sent
+        return 'std::decay_t<decltype(*{})>'.format(decl_call)
+    elif 'auto' in operation['ret_type'] or is_std_array(operation['ret_type']):
+        return 'decltype({})'.format(decl_call)
     else:
         return operation['ret_type']
 
 def format_ret_type(classname, operation):
-    if 'auto' in operation['ret_type'] or is_std_array(operation['ret_type']):
+    ret_type = operation.get('lease_type') or operation['ret_type']
+    if 'auto' in ret_type or is_std_array(ret_type):
         return '" << get_type_str<{}>() << "'.format(get_exact_ret_type(classname, operation))
     else:
-        return operation['ret_type']
+        return ret_type
 
 
 # -----------------------------------------------------------------------------
@@ -214,12 +415,106 @@ def generate_call(device, dev_id, operation):
         call += ', '.join('args_' + operation['name'] + '.' + arg['name'] for arg in operation.get('arguments', []))
         return call + ')'
 
+    if operation.get('multi_of') is not None:
+        return generate_multi_call(device, dev_id, operation)
+    if operation.get('lease_type') is not None:
+        return generate_leased_call(device, dev_id, operation, build_func_call(device, operation))
+    if operation['unlocked']:
+        return generate_unlocked_call(device, dev_id, operation, build_func_call(device, operation))
+
     lines = []
+    lines.append('    KSERVER_TRACE_BEGIN(call);\n')
     if operation['ret_type'] == 'void':
         lines.append('    {};\n'.format(build_func_call(device, operation)))
+        lines.append('    KSERVER_TRACE_END(call, DEVICE_CALL, cmd);\n')
         lines.append('    return 0;\n')
     else:
-        lines.append('    return cmd.sess->send<{}, {}>({});\n'.format(dev_id, operation['id'], build_func_call(device, operation)))
+        lines.append('    auto&& ret = {};\n'.format(build_func_call(device, operation)))
+        lines.append('    KSERVER_TRACE_END(call, DEVICE_CALL, cmd);\n')
+        lines.append('    KSERVER_TRACE_BEGIN(send);\n')
+        lines.append('    const int bytes_send = sess.template send<{}, {}>(std::forward<decltype(ret)>(ret));\n'.format(dev_id, operation['id']))
+        lines.append('    KSERVER_TRACE_END(send, SEND_RESPONSE, cmd);\n')
+        lines.append('    return bytes_send;\n')
+    return ''.join(lines)
+
+def generate_multi_call(device, dev_id, operation):
+    ''' Companion operation of a method annotated @multi (see build_multi_operation) '''
+    args = ['args_' + operation['name'] + '.' + arg['name'] for arg in operation['arguments']]
+    func_call = '{}.{}({})'.format(device['objects'][0]['name'], operation['multi_of']['name'],
+                                   ', '.join(arg + '[i]' for arg in args))
+    lines = []
+    lines.append('    const size_t calls_num = {}.size();\n'.format(args[0]))
+    if len(args) > 1:
+        lines.append('\n    if ({}) {{\n'.format(' || '.join(arg + '.size() != calls_num' for arg in args[1:])))
+        lines.append('        kserver->syslog.print<ERROR>("[{} - {}] The arguments have different lengths.\\n");\n'.format(device['name'], operation['name']))
+        lines.append('        return -1;\n')
+        lines.append('    }\n')
+    lines.append('\n    KSERVER_TRACE_BEGIN(call);\n')
+    if operation['ret_type'] == 'void':
+        lines.append('    for (size_t i = 0; i < calls_num; i++)\n')
+        lines.append('        {};\n'.format(func_call))
+        lines.append('    KSERVER_TRACE_END(call, DEVICE_CALL, cmd);\n')
+        lines.append('    return 0;\n')
+    else:
+        lines.append('    {} ret(calls_num);\n'.format(operation['ret_type']))
+        lines.append('    for (size_t i = 0; i < calls_num; i++)\n')
+        lines.append('        ret[i] = {};\n'.format(func_call))
+        lines.append('    KSERVER_TRACE_END(call, DEVICE_CALL, cmd);\n')
+        lines.append('    KSERVER_TRACE_BEGIN(send);\n')
+        lines.append('    const int bytes_send = sess.template send<{}, {}>(ret);\n'.format(dev_id, operation['id']))
+        lines.append('    KSERVER_TRACE_END(send, SEND_RESPONSE, cmd);\n')
+        lines.append('    return bytes_send;\n')
+    return ''.join(lines)
+
+def generate_leased_call(device, dev_id, operation, func_call):
+    ''' Operations returning a kserver::Lease (see core/triple_buffer.hpp):
+        the leased value is sent after releasing the device lock '''
+    lines = []
+    lines.append('#if KSERVER_HAS_THREADS\n')
+    lines.append('    KSERVER_TRACE_BEGIN(lock);\n')
+    lines.append('    std::unique_lock<std::mutex> lock(mutex);\n')
+    lines.append('    KSERVER_TRACE_END(lock, LOCK_WAIT, cmd);\n')
+    lines.append('#endif\n')
+    lines.append('    KSERVER_TRACE_BEGIN(call);\n')
+    lines.append('    const auto lease = {};\n'.format(func_call))
+    lines.append('    KSERVER_TRACE_END(call, DEVICE_CALL, cmd);\n')
+    lines.append('#if KSERVER_HAS_THREADS\n')
+    lines.append('    lock.unlock();\n')
+    lines.append('#endif\n')
+    lines.append('    KSERVER_TRACE_BEGIN(send);\n')
+    lines.append('    const int bytes_send = sess.template send<{}, {}>(*lease);\n'.format(dev_id, operation['id']))
+    lines.append('    KSERVER_TRACE_END(send, SEND_RESPONSE, cmd);\n')
+    lines.append('    return bytes_send;\n')
+    return ''.join(lines)
+
+def generate_unlocked_call(device, dev_id, operation, func_call):
+    ''' Cached (@cache), shared (@shared) and polled operations: the device lock
+        is only taken by the session calling the device '''
+    key = 'ResponseCache::make_key({})'.format(', '.join('args_' + operation['name'] + '.' + arg['name'] for arg in operation.get('arguments', [])))
+    lines = []
+    if operation.get('polled') is not None:
+        lines.append('    return sess.template send_polled<{}, {}>(\n'.format(dev_id, operation['id']))
+        lines.append('        kserver->polling.snapshots({}),\n'.format(operation['polled']))
+    elif operation.get('cache') is not None:
+        lines.append('    return sess.template send_cached<{}, {}>(\n'.format(dev_id, operation['id']))
+        lines.append('        kserver->dev_manager.response_cache, {}, {}ULL,\n'.format(key, operation['cache']['ttl_ms'] * 1000000))
+    else:
+        lines.append('    return sess.template send_shared<{}, {}>(\n'.format(dev_id, operation['id']))
+        lines.append('        kserver->dev_manager.flights, {},\n'.format(key))
+    lines.append('        [&](auto&& sender) {\n')
+    lines.append('#if KSERVER_HAS_THREADS\n')
+    lines.append('            KSERVER_TRACE_BEGIN(lock);\n')
+    lines.append('            std::lock_guard<std::mutex> lock(mutex);\n')
+    lines.append('            KSERVER_TRACE_END(lock, LOCK_WAIT, cmd);\n')
+    lines.append('#endif\n')
+    lines.append('            KSERVER_TRACE_BEGIN(call);\n')
+    lines.append('            auto&& ret = {};\n'.format(func_call))
+    lines.append('            KSERVER_TRACE_END(call, DEVICE_CALL, cmd);\n')
+    lines.append('            KSERVER_TRACE_BEGIN(send);\n')
+    lines.append('            const int bytes_send = sender(std::forward<decltype(ret)>(ret));\n')
+    lines.append('            KSERVER_TRACE_END(send, SEND_RESPONSE, cmd);\n')
+    lines.append('            return bytes_send;\n')
+    lines.append('        });\n')
     return ''.join(lines)
 
 # -----------------------------------------------------------
@@ -235,11 +530,11 @@ def parser_generator(device, operation):
 
     if not has_vector:
         print_req_buff_size(lines, packs)
-        lines.append('    static_assert(req_buff_size <= cmd.payload.size(), "Buffer size too small");\n\n');
+        lines.append('    static_assert(req_buff_size <= CMD_PAYLOAD_BUFFER_LEN, "Buffer size too small");\n\n');
 
     for idx, pack in enumerate(packs):
         if pack['family'] == 'scalar':
-            lines.append('\n    auto args_tuple' + str(idx)  + ' = cmd.sess->deserialize<')
+            lines.append('\n    auto args_tuple' + str(idx)  + ' = sess.template deserialize<')
             print_type_list_pack(lines, pack)
             lines.append('>(cmd);\n')
             lines.append('    if (std::get<0>(args_tuple' + str(idx)  + ') < 0) {\n')
@@ -251,7 +546,7 @@ def parser_generator(device, operation):
                 lines.append('    args_' + operation['name'] + '.' + arg["name"] + ' = ' + 'std::get<' + str(i + 1) + '>(args_tuple' + str(idx) + ');\n');
 
         elif pack['family'] in ['vector', 'string', 'array']:
-            lines.append('    if (cmd.sess->recv(args_' + operation['name'] + '.' + pack['args']['name'] + ', cmd) < 0) {\n')
+            lines.append('    if (sess.recv(args_' + operation['name'] + '.' + pack['args']['name'] + ', cmd) < 0) {\n')
             lines.append('        kserver->syslog.print<ERROR>(\"[' + device.name + ' - ' + operation['name'] + '] Failed to receive '+ pack['family'] +'.\\n");\n')
             lines.append('        return -1;\n')
             lines.append('    }\n\n')
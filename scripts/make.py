@@ -41,7 +41,7 @@ def main(argv):
             json.dump(config, f)
 
     elif cmd == '--generate':
-        generate(get_devices(config), argv[2], tmp_dir)
+        generate(get_devices(config), argv[2], tmp_dir, config.get('polling', []))
 
     elif cmd == '--devices':
         hpp_files = []
@@ -7,6 +7,18 @@ Dev& ContextBase::get() const {
     return dm->get<dev_id_of<Dev>>();
 }
 
+void ContextBase::invalidate_cache(uint32_t op) {
+    dm->response_cache.invalidate(op);
+}
+
+void ContextBase::invalidate_device_cache(device_id dev) {
+    dm->response_cache.invalidate_device(dev);
+}
+
+kserver::Stream* ContextBase::add_device_stream(device_id dev, uint32_t block_size, uint32_t capacity) {
+    return dm->streams.add(dev, block_size, capacity);
+}
+
 {%- for device in devices -%}
 {% for object in device.objects %}
 template {{ device.objects[0]['type'] }}& ContextBase::get<{{ device.objects[0]['type'] }}>() const;
@@ -37,6 +37,24 @@ constexpr auto devices_names = kserver::make_array(
 
 static_assert(std::tuple_size<decltype(devices_names)>::value == device_num, "");
 
+// Number of operations of each device
+
+constexpr std::array<std::size_t, device_num> operations_num = {
+    0, // NoDevice
+    {{ kserver_operations|length }}, // KServer
+{%- for device in devices %}
+    {{ device.operations|length }}{% if not loop.last %},{% endif %} // {{ device.objects[0]['type'] }}
+{%- endfor %}
+};
+
+// Names of the operations, device after device
+
+constexpr auto operations_names = kserver::make_array(
+{%- for name in operations_names %}
+    kserver::str_const("{{ name }}"){% if not loop.last %},{% endif %}
+{%- endfor %}
+);
+
 // Devices are store as unique_ptr ensuring single
 // instantiation of each device.
 
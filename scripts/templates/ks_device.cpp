@@ -10,22 +10,38 @@
 #include <core/commands.hpp>
 #include <core/kserver.hpp>
 #include <core/kserver_session.hpp>
+#include <core/polling.hpp>
 #include <core/syslog.tpp>
+#include <core/tracing.hpp>
 #if KSERVER_HAS_DEVMEM
 #include <drivers/lib/memory_manager.hpp>
 #endif
 
 namespace kserver {
 
+// GCC requires an alias to define the member templates
+// of the specialization out of the class
+using KS_{{ device.tag|capitalize }} = KDevice<dev_id_of<{{ device.objects[0]["type"] }}>>;
+
 {% for operation in device.operations -%}
 /////////////////////////////////////
 // {{ operation['name'] }}
 
-template<>
-int KDevice<dev_id_of<{{ device.objects[0]["type"] }}>>::
-        execute_op<KDevice<dev_id_of<{{ device.objects[0]["type"] }}>>::{{ operation['tag'] }}>(Command& cmd)
+template<int sock_type>
+int KS_{{ device.tag|capitalize }}::execute_{{ operation['name'] }}(Command& cmd, Session<sock_type>& sess)
 {
+{%- if operation['unlocked'] %}
+    // Called without the device lock (see execute):
+    // the arguments are stored locally.
+{%- if operation['arguments'] %}
+    Argument_{{ operation['name'] }} args_{{ operation['name'] }};
+{%- endif %}
+{%- endif %}
+{%- if operation['arguments'] %}
+    KSERVER_TRACE_BEGIN(deserialize);
     {{ operation | get_parser(device) }}
+    KSERVER_TRACE_END(deserialize, DESERIALIZE, cmd);
+{%- endif %}
     {{ operation | get_fragment(device) }}
 }
 
@@ -33,14 +49,35 @@ int KDevice<dev_id_of<{{ device.objects[0]["type"] }}>>::
 
 int KDevice<dev_id_of<{{ device.objects[0]["type"] }}>>::execute(Command& cmd)
 {
+    return cmd.sess->dispatch([&](auto& sess) {
+        return this->execute(cmd, sess);
+    });
+}
+
+template<int sock_type>
+int KS_{{ device.tag|capitalize }}::execute(Command& cmd, Session<sock_type>& sess)
+{
+{%- if device.unlocked_operations %}
+    // Cached, shared, polled and leased operations only take the lock to call the device
+    switch (cmd.operation) {
+{% for operation in device.unlocked_operations -%}
+      case {{ operation['tag'] }}:
+        return execute_{{ operation['name'] }}(cmd, sess);
+{% endfor %}
+      default:
+        break;
+    }
+{% endif %}
 #if KSERVER_HAS_THREADS
+    KSERVER_TRACE_BEGIN(lock);
     std::lock_guard<std::mutex> lock(mutex);
+    KSERVER_TRACE_END(lock, LOCK_WAIT, cmd);
 #endif
 
     switch(cmd.operation) {
-{% for operation in device.operations -%}
+{% for operation in device.operations if not operation['unlocked'] -%}
       case {{ operation['tag'] }}: {
-        return execute_op<{{ operation['tag'] }}>(cmd);
+        return execute_{{ operation['name'] }}(cmd, sess);
       }
 {% endfor %}
       case {{ device.tag | lower }}_op_num:
@@ -50,4 +87,22 @@ int KDevice<dev_id_of<{{ device.objects[0]["type"] }}>>::execute(Command& cmd)
     }
 }
 
+int KDevice<dev_id_of<{{ device.objects[0]["type"] }}>>::poll(int op, SnapshotBuilder& builder, Snapshot& snapshot)
+{
+#if KSERVER_HAS_THREADS
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    switch (op) {
+{% for operation in device.polled_operations -%}
+      case {{ operation['tag'] }}:
+        builder.build<{{ device.id }}, {{ operation['id'] }}>(snapshot, {{ device.objects[0]["name"] }}.{{ operation['name'] }}());
+        return 0;
+{% endfor %}
+      default:
+          kserver->syslog.print<ERROR>("{{ device.class_name }}: Operation %d is not polled\n", op);
+          return -1;
+    }
+}
+
 } // namespace kserver
@@ -9,6 +9,7 @@
 #define __{{ device.class_name|upper }}_HPP__
 
 #include <memory>
+#include <vector>
 #if KSERVER_HAS_THREADS
 #include <mutex>
 #endif
@@ -26,7 +27,16 @@ class KDevice<dev_id_of<{{ device.objects[0]["type"] }}>> : public KDeviceAbstra
 {
   public:
     int execute(Command& cmd);
-    template<int op> int execute_op(Command& cmd);
+
+    /// Execute the command on the session of its type (see SessionAbstract::dispatch)
+    template<int sock_type> int execute(Command& cmd, Session<sock_type>& sess);
+
+{%- for operation in device.operations %}
+    template<int sock_type> int execute_{{ operation['name'] }}(Command& cmd, Session<sock_type>& sess);
+{%- endfor %}
+
+    /// Build the snapshot of a polled operation (see core/polling.hpp)
+    int poll(int op, SnapshotBuilder& builder, Snapshot& snapshot);
 
     KDevice(KServer *kserver, {{ device.objects[0]["type"] }}& {{ device.objects[0]["name"] }}_)
     : KDeviceAbstract(dev_id_of<{{ device.objects[0]["type"] }}>, kserver)
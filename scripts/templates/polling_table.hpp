@@ -0,0 +1,33 @@
+/// Generated by Devgen 
+/// DO NOT EDIT
+///
+/// (c) Koheron
+
+#ifndef __POLLING_TABLE_HPP__
+#define __POLLING_TABLE_HPP__
+
+#include <cstdint>
+#include <array>
+
+#include <devices_table.hpp>
+
+namespace kserver {
+
+// Operations polled by the server (see core/polling.hpp)
+
+struct PolledOperation {
+    device_id dev;
+    uint16_t op;
+    uint32_t period_ms;
+    bool publish; ///< Push the snapshots on PubSub::POLLING_CHANNEL
+};
+
+constexpr std::array<PolledOperation, {{ polled_operations|length }}> polled_operations = {{ '{{' }}
+{%- for polled in polled_operations %}
+    {{ '{' }}{{ polled['device'].id }}, {{ polled['operation']['id'] }}, {{ polled['period_ms'] }}, {{ 'true' if polled['publish'] else 'false' }}{{ '}' }}{% if not loop.last %},{% endif %} // {{ polled['device'].name }}.{{ polled['operation']['name'] }}
+{%- endfor %}
+{{ '}}' }};
+
+} // namespace kserver
+
+#endif // __POLLING_TABLE_HPP__
@@ -37,6 +37,11 @@ class Benchmarks
         return true;
     }
 
+    // Small command: dominated by the dispatch and the parsing
+    uint32_t scalars_round_trip(uint32_t a, uint32_t b) {
+        return a + b;
+    }
+
   private:
     std::vector<uint32_t> vector_u;
     std::vector<float> vector_f;
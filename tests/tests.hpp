@@ -20,7 +20,9 @@ class Tests
     Tests(Context& ct)
     : data(0)
     , buffer(0)
-    {}
+    {
+        status_table.fill(0);
+    }
 
     bool rcv_many_params(uint32_t u1, uint32_t u2, float f, bool b);
     bool set_float(float f);
@@ -101,6 +103,12 @@ class Tests
     double read_double();
     bool read_bool();
 
+    // Slowly changing table, polled by the clients
+    const std::array<uint32_t, 1024>& update_status_table(uint32_t index, uint32_t value) {
+        status_table[index % status_table.size()] = value;
+        return status_table;
+    }
+
     std::vector<float> data;
     std::vector<uint32_t> data_u;
     std::vector<int32_t> data_i;
@@ -116,6 +124,7 @@ class Tests
     std::array<float, 10> data_std_array;
     std::array<uint32_t, 512> data_std_array2;
     std::array<uint32_t, 2 * HALF_ARRAY_LEN> data_std_array3;
+    std::array<uint32_t, 1024> status_table;
 };
 
 #endif // __TESTS_TESTS_HPP__
@@ -1,7 +1,12 @@
 #ifndef __USES_CONTEXT_HPP__
 #define __USES_CONTEXT_HPP__
 
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
 #include "context.hpp"
+#include <core/streams.hpp>
 
 #include "tests.hpp"
 #include "benchmarks.hpp"
@@ -15,8 +20,14 @@ class UsesContext
     , tests(ctx.get<Tests>())
     , benchmarks(ctx.get<Benchmarks>())
     , exception_tests(ctx.get<ExceptionTests>())
+    , stream(ctx.add_stream<UsesContext>(sizeof(uint32_t) * 1024, 16))
     {}
 
+    ~UsesContext() {
+        if (acquisition.joinable())
+            acquisition.join();
+    }
+
     bool set_float_from_tests(float f) {
         return tests.set_float(f);
     }
@@ -33,12 +44,114 @@ class UsesContext
         ctx.notify<UsesContext>(msg.c_str());
     }
 
+    // Cached responses
+
+    /// @cache
+    const std::array<float, 64>& get_calibration(uint32_t channel) {
+        calibration_calls++;
+        calibration.fill(gains[channel % gains.size()]);
+        return calibration;
+    }
+
+    /// @multi
+    void set_gain(uint32_t channel, float gain) {
+        gains[channel % gains.size()] = gain;
+        ctx.invalidate_cache<UsesContext>();
+    }
+
+    uint32_t get_calibration_calls() {
+        return calibration_calls;
+    }
+
+    /// @cache 100
+    uint32_t get_counter() {
+        return counter++;
+    }
+
+    // Coalesced requests
+
+    /// 1 MB capture, acquired in 200 ms
+    /// @shared
+    const std::vector<uint32_t>& get_capture() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        capture_calls++;
+        std::fill(capture.begin(), capture.end(), capture_calls);
+        return capture;
+    }
+
+    uint32_t get_capture_calls() {
+        return capture_calls;
+    }
+
+    // Polled by the server (see config/config_local.yaml)
+    uint64_t get_sensor() {
+        return ++sensor_reads;
+    }
+
+    // Stream (see core/streams.hpp)
+
+    // Push n blocks from an acquisition thread
+    void start_acquisition(uint32_t n) {
+        if (acquisition.joinable())
+            acquisition.join();
+
+        acquisition = std::thread([this, n] {
+            std::array<uint32_t, 1024> block;
+
+            for (uint32_t i = 0; i < n; i++) {
+                block.fill(i);
+                stream->push(block);
+            }
+        });
+    }
+
+    // Triple buffer (see core/triple_buffer.hpp)
+
+    bool fill_trace(float value) {
+        auto *trace = traces.begin_write();
+
+        if (trace == nullptr)
+            return false;
+
+        std::fill(trace->begin(), trace->end(), value);
+        traces.publish();
+        return true;
+    }
+
+    kserver::Lease<std::vector<float>> get_trace() {
+        return traces.read();
+    }
+
+    // Multi-calls
+
+    /// @multi
+    float get_gain(uint32_t channel) {
+        return gains[channel % gains.size()];
+    }
+
+    /// @multi
+    bool has_gain(uint32_t channel, float gain) {
+        return gains[channel % gains.size()] == gain;
+    }
+
   private:
     Context& ctx;
 
+    std::array<float, 4> gains{{1.0f, 1.0f, 1.0f, 1.0f}};
+    std::array<float, 64> calibration;
+    uint32_t calibration_calls = 0;
+    uint32_t counter = 0;
+    std::vector<uint32_t> capture = std::vector<uint32_t>(262144);
+    uint32_t capture_calls = 0;
+    uint64_t sensor_reads = 0;
+    kserver::TripleBuffer<std::vector<float>> traces{std::vector<float>(65536)};
+
     Tests& tests;
     Benchmarks& benchmarks;
     ExceptionTests& exception_tests;
+
+    kserver::Stream *stream;
+    std::thread acquisition;
 };
 
 #endif // __USES_CONTEXT_HPP__
\ No newline at end of file